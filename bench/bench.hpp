@@ -0,0 +1,148 @@
+#pragma once
+
+// Minimal benchmark harness for the bench/ executables. Each benchmark is registered with a list of arguments and
+// runs with a growing iteration count until one run takes at least --min-time seconds; the best of --repetitions
+// such runs is reported. Results go to stdout as a table and, with --json=<path>, to a file in the JSON layout of
+// Google Benchmark so existing tooling can compare runs.
+//
+//   bench::add("chain", {2, 8, 64}, [](bench::state& s) {
+//     auto engine = make_chain(s.arg);                  // setup is not timed
+//     s.time([&] { for (auto i = 0; i < s.iterations; ++i) engine->execute(); });
+//     s.items = s.iterations * s.arg;                   // optional, reported as items_per_second
+//   });
+//   auto main(int argc, char** argv) -> int { return bench::run(argc, argv); }
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace bench {
+class state final {
+ private:
+  double elapsed = 0.0;  // seconds spent inside time()
+
+  friend auto run(int argc, char** argv) -> int;
+
+ public:
+  std::int64_t arg = 0;
+  std::int64_t iterations = 1;
+  std::int64_t items = 0;
+
+  template <typename Body>
+  auto time(Body&& body) -> void {
+    auto start = std::chrono::steady_clock::now();
+    body();
+    elapsed += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+};
+
+struct benchmark {
+  std::string name;
+  std::vector<std::int64_t> args;
+  std::function<void(state&)> body;
+};
+
+inline auto registry() -> std::vector<benchmark>& {
+  static auto benchmarks = std::vector<benchmark>{};
+  return benchmarks;
+}
+
+inline auto add(std::string name, std::vector<std::int64_t> args, std::function<void(state&)> body) -> void {
+  registry().push_back({std::move(name), std::move(args), std::move(body)});
+}
+
+// Keeps the optimizer from dropping a computed value
+template <typename T>
+inline auto do_not_optimize(const T& value) -> void {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+inline auto run(int argc, char** argv) -> int {
+  auto json_path = std::string{};
+  auto filter = std::string{};
+  auto min_time = 0.1;
+  auto repetitions = 3;
+  for (auto i = 1; i < argc; ++i) {
+    auto option = std::string{argv[i]};
+    if (option.rfind("--json=", 0) == 0) {
+      json_path = option.substr(7);
+    } else if (option.rfind("--filter=", 0) == 0) {
+      filter = option.substr(9);
+    } else if (option.rfind("--min-time=", 0) == 0) {
+      min_time = std::stod(option.substr(11));
+    } else if (option.rfind("--repetitions=", 0) == 0) {
+      repetitions = std::max(1, std::stoi(option.substr(14)));
+    } else {
+      std::fprintf(stderr, "usage: %s [--json=path] [--filter=substring] [--min-time=seconds] [--repetitions=n]\n",
+                   argv[0]);
+      return 2;
+    }
+  }
+
+  struct result {
+    std::string name;
+    std::int64_t iterations;
+    double ns_per_iteration;
+    double items_per_second;
+  };
+  auto results = std::vector<result>{};
+
+  std::printf("%-40s %14s %16s %18s\n", "benchmark", "iterations", "ns/iteration", "items/s");
+  for (const auto& b : registry()) {
+    for (auto arg : b.args) {
+      auto name = b.name + "/" + std::to_string(arg);
+      if (name.find(filter) == std::string::npos) continue;
+
+      auto best = result{name, 0, 0.0, 0.0};
+      for (auto repetition = 0; repetition < repetitions; ++repetition) {
+        auto s = state{};
+        s.arg = arg;
+        while (true) {
+          s.elapsed = 0.0;
+          s.items = 0;
+          b.body(s);
+          if (s.elapsed >= min_time || s.iterations >= (std::int64_t{1} << 40)) break;
+          // aim slightly past min_time, growing at most 10x per step
+          auto scale = s.elapsed > 0.0 ? std::min(10.0, 1.4 * min_time / s.elapsed) : 10.0;
+          s.iterations = std::max(s.iterations + 1, static_cast<std::int64_t>(s.iterations * scale));
+        }
+
+        auto ns = s.elapsed * 1e9 / static_cast<double>(s.iterations);
+        if (best.iterations == 0 || ns < best.ns_per_iteration) {
+          best = result{name, s.iterations, ns, s.items > 0 ? static_cast<double>(s.items) / s.elapsed : 0.0};
+        }
+      }
+
+      std::printf("%-40s %14lld %16.1f %18.0f\n", name.c_str(), static_cast<long long>(best.iterations),
+                  best.ns_per_iteration, best.items_per_second);
+      std::fflush(stdout);
+      results.push_back(best);
+    }
+  }
+
+  if (!json_path.empty()) {
+    auto out = std::ofstream(json_path);
+    out << "{\n  \"context\": {\"num_cpus\": " << std::thread::hardware_concurrency()
+        << ", \"repetitions\": " << repetitions << ", \"min_time\": " << min_time << "},\n  \"benchmarks\": [";
+    for (auto i = std::size_t{0}; i < results.size(); ++i) {
+      const auto& r = results[i];
+      out << (i ? "," : "") << "\n    {\"name\": \"" << r.name << "\", \"run_type\": \"iteration\", \"iterations\": "
+          << r.iterations << ", \"real_time\": " << r.ns_per_iteration << ", \"time_unit\": \"ns\"";
+      if (r.items_per_second > 0.0) out << ", \"items_per_second\": " << r.items_per_second;
+      out << "}";
+    }
+    out << "\n  ]\n}\n";
+    if (!out) {
+      std::fprintf(stderr, "cannot write %s\n", json_path.c_str());
+      return 1;
+    }
+  }
+  return 0;
+}
+}  // namespace bench
@@ -0,0 +1,130 @@
+// Read-mostly contention benchmark: N threads hammer the same 16 keys of one shared blackboard, as parallel_state
+// branches do. Compares the previous design (one recursive_mutex, map of shared_ptr entries, dynamic_pointer_cast)
+// with the current blackboard through both the string and the resolved-key API. The argument is the thread count,
+// items are blackboard operations.
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "blackboard.hpp"
+
+namespace {
+// Reference copy of the blackboard before shared locking, inline storage and keys were introduced.
+class legacy_blackboard {
+ private:
+  std::unordered_map<std::string, msm::blackboard_entry_interface::ptr> entries;
+  mutable std::recursive_mutex mtx;
+
+ public:
+  auto contains(const std::string& key) const -> bool {
+    auto lock = std::lock_guard(mtx);
+    return entries.find(key) != entries.end();
+  }
+
+  template <typename T>
+  auto get(const std::string& key) const -> std::optional<T> {
+    auto lock = std::lock_guard(mtx);
+    if (!this->contains(key)) return std::nullopt;
+    auto entry = std::dynamic_pointer_cast<msm::blackboard_entry<T>>(entries.at(key));
+    return entry ? std::make_optional(entry->get_value()) : std::nullopt;
+  }
+
+  template <typename T>
+  auto set(const std::string& key, const T& value) -> void {
+    auto lock = std::lock_guard(mtx);
+    if (!this->contains(key)) {
+      entries[key] = std::make_shared<msm::blackboard_entry<T>>(value);
+    } else {
+      std::dynamic_pointer_cast<msm::blackboard_entry<T>>(entries.at(key))->set_value(value);
+    }
+  }
+};
+
+constexpr auto key_count = 16;
+constexpr auto write_every = 32;  // ~3% writes
+
+auto key_names() -> const std::vector<std::string>& {
+  static const auto names = [] {
+    auto result = std::vector<std::string>{};
+    for (auto i = 0; i < key_count; ++i) result.push_back("key_" + std::to_string(i));
+    return result;
+  }();
+  return names;
+}
+
+// Runs worker(thread, operations) on s.arg threads, each doing s.iterations operations
+template <typename Worker>
+auto run_threads(bench::state& s, Worker worker) -> void {
+  s.time([&] {
+    auto pool = std::vector<std::thread>{};
+    for (auto t = 0; t < s.arg; ++t) pool.emplace_back(worker, t, s.iterations);
+    for (auto& thread : pool) thread.join();
+  });
+  s.items = s.iterations * s.arg;
+}
+
+const auto thread_counts = std::vector<std::int64_t>{1, 2, 4, 8, 16};
+
+const auto registered = [] {
+  bench::add("blackboard_contention/legacy", thread_counts, [](bench::state& s) {
+    auto legacy = legacy_blackboard{};
+    for (const auto& name : key_names()) legacy.set<double>(name, 0.0);
+
+    run_threads(s, [&](std::int64_t t, std::int64_t operations) {
+      auto sum = 0.0;
+      for (auto i = std::int64_t{0}; i < operations; ++i) {
+        const auto& name = key_names()[(i + t) % key_count];
+        if (i % write_every == 0) {
+          legacy.set<double>(name, static_cast<double>(i));
+        } else {
+          sum += legacy.get<double>(name).value_or(0.0);
+        }
+      }
+      bench::do_not_optimize(sum);
+    });
+  });
+
+  bench::add("blackboard_contention/string", thread_counts, [](bench::state& s) {
+    auto current = msm::blackboard{};
+    for (const auto& name : key_names()) current.set<double>(name, 0.0);
+
+    run_threads(s, [&](std::int64_t t, std::int64_t operations) {
+      auto sum = 0.0;
+      for (auto i = std::int64_t{0}; i < operations; ++i) {
+        const auto& name = key_names()[(i + t) % key_count];
+        if (i % write_every == 0) {
+          current.set<double>(name, static_cast<double>(i));
+        } else {
+          sum += current.get<double>(name).value_or(0.0);
+        }
+      }
+      bench::do_not_optimize(sum);
+    });
+  });
+
+  bench::add("blackboard_contention/key", thread_counts, [](bench::state& s) {
+    auto current = msm::blackboard{};
+    auto keys = std::vector<msm::blackboard::key<double>>{};
+    for (const auto& name : key_names()) {
+      current.set<double>(name, 0.0);
+      keys.push_back(current.resolve<double>(name));
+    }
+
+    run_threads(s, [&](std::int64_t t, std::int64_t operations) {
+      auto sum = 0.0;
+      for (auto i = std::int64_t{0}; i < operations; ++i) {
+        const auto& key = keys[(i + t) % key_count];
+        if (i % write_every == 0) {
+          current.set(key, static_cast<double>(i));
+        } else {
+          sum += current.get(key).value_or(0.0);
+        }
+      }
+      bench::do_not_optimize(sum);
+    });
+  });
+  return true;
+}();
+}  // namespace
+
+auto main(int argc, char** argv) -> int { return bench::run(argc, argv); }
@@ -0,0 +1,217 @@
+// Engine microbenchmarks: transition throughput of a chain of states, cost of transition callbacks, hooks and
+// recording, nested engine depth, validation and loading of large graphs and parallel_state fan-out. The argument
+// of each benchmark is given in its comment.
+#include "arena.hpp"
+#include "bench.hpp"
+#include "definition.hpp"
+#include "engine.hpp"
+#include "recorder.hpp"
+
+#include <thread>
+
+using msm::blackboard;
+using msm::callback_state;
+using msm::msm_engine;
+using msm::msm_state;
+using msm::parallel_state;
+
+namespace {
+auto next_state() -> msm_state::ptr {
+  return std::make_shared<callback_state>([](blackboard::ptr) -> std::string { return "next"; },
+                                          std::unordered_set<std::string>{"next"});
+}
+
+// s0 -> s1 -> ... -> s(length - 1) -> done
+auto make_chain(std::int64_t length) -> std::shared_ptr<msm_engine> {
+  auto engine = std::make_shared<msm_engine>(std::unordered_set<std::string>{"done"});
+  for (auto i = std::int64_t{0}; i < length; ++i) {
+    auto target = i + 1 < length ? "s" + std::to_string(i + 1) : std::string{"done"};
+    engine->add_state("s" + std::to_string(i), next_state(), {{"next", target}});
+  }
+  engine->set_initial_state("s0");
+  engine->validate(true);
+  return engine;
+}
+
+// an engine whose single state is an engine, depth levels deep, around a chain of length states
+auto make_nested(std::int64_t depth, std::int64_t length = 1) -> std::shared_ptr<msm_engine> {
+  auto engine = make_chain(length);
+  for (auto level = std::int64_t{1}; level < depth; ++level) {
+    auto outer = std::make_shared<msm_engine>(std::unordered_set<std::string>{"done"});
+    outer->add_state("inner", engine, {{"done", "done"}});
+    engine = outer;
+  }
+  engine->validate(true);
+  return engine;
+}
+
+const auto registered = [] {
+  // chain length, items are transitions
+  bench::add("engine/chain", {2, 8, 64, 512}, [](bench::state& s) {
+    auto engine = make_chain(s.arg);
+    auto bb = std::make_shared<blackboard>();
+    s.time([&] {
+      for (auto i = std::int64_t{0}; i < s.iterations; ++i) bench::do_not_optimize(engine->execute(bb));
+    });
+    s.items = s.iterations * s.arg;
+  });
+
+  // transition callbacks per transition on a 64-state chain, items are transitions
+  bench::add("engine/transition_callbacks", {0, 1, 4, 16}, [](bench::state& s) {
+    auto engine = make_chain(64);
+    auto calls = std::int64_t{0};
+    for (auto c = std::int64_t{0}; c < s.arg; ++c) {
+      engine->add_transition_callback([&calls](blackboard::ptr, const std::string&, const std::string&,
+                                               const std::string&, const std::vector<std::string>&) -> void {
+        ++calls;
+      });
+    }
+    auto bb = std::make_shared<blackboard>();
+    s.time([&] {
+      for (auto i = std::int64_t{0}; i < s.iterations; ++i) bench::do_not_optimize(engine->execute(bb));
+    });
+    bench::do_not_optimize(calls);
+    s.items = s.iterations * 64;
+  });
+
+  // transition hooks per transition on a 64-state chain, items are transitions
+  bench::add("engine/transition_hooks", {0, 1, 4, 16}, [](bench::state& s) {
+    auto engine = make_chain(64);
+    auto calls = std::int64_t{0};
+    for (auto c = std::int64_t{0}; c < s.arg; ++c) {
+      engine->add_transition_hook(
+          [&calls](const blackboard::ptr&, const msm_engine::hook_event&) -> void { ++calls; });
+    }
+    auto bb = std::make_shared<blackboard>();
+    s.time([&] {
+      for (auto i = std::int64_t{0}; i < s.iterations; ++i) bench::do_not_optimize(engine->execute(bb));
+    });
+    bench::do_not_optimize(calls);
+    s.items = s.iterations * 64;
+  });
+
+  // a 64-state chain recording to /dev/null: 0 does not record, 1 records outcomes, 2 blackboard writes too; items
+  // are transitions. The recorder's flusher makes the process multi-threaded, which turns every shared_ptr count
+  // into an atomic one, so 0 starts a thread as well and is the baseline to compare against, not engine/chain.
+  bench::add("engine/recorded_chain", {0, 1, 2}, [](bench::state& s) {
+    std::thread([] {}).join();
+    auto engine = make_chain(64);
+    if (s.arg != 0) {
+      auto options = msm::recorder_options{};
+      options.blackboard_writes = s.arg == 2;
+      engine->set_recorder(std::make_shared<msm::recorder>("/dev/null", options));
+    }
+    auto bb = std::make_shared<blackboard>();
+    s.time([&] {
+      for (auto i = std::int64_t{0}; i < s.iterations; ++i) bench::do_not_optimize(engine->execute(bb));
+    });
+    s.items = s.iterations * 64;
+  });
+
+  // nesting depth, one execution per iteration
+  bench::add("engine/nested_depth", {1, 2, 4, 8, 16}, [](bench::state& s) {
+    auto engine = make_nested(s.arg);
+    auto bb = std::make_shared<blackboard>();
+    s.time([&] {
+      for (auto i = std::int64_t{0}; i < s.iterations; ++i) bench::do_not_optimize(engine->execute(bb));
+    });
+    s.items = s.iterations;
+  });
+
+  // nesting depth around a 64-state chain, items are transitions inside the innermost engine
+  bench::add("engine/nested_chain", {1, 2, 4, 8}, [](bench::state& s) {
+    auto engine = make_nested(s.arg, 64);
+    auto bb = std::make_shared<blackboard>();
+    s.time([&] {
+      for (auto i = std::int64_t{0}; i < s.iterations; ++i) bench::do_not_optimize(engine->execute(bb));
+    });
+    s.items = s.iterations * 64;
+  });
+
+  // states of a chain with as many unreachable states, items are states
+  bench::add("engine/validate", {1000, 10000, 100000}, [](bench::state& s) {
+    auto engine = make_chain(s.arg);
+    for (auto i = std::int64_t{0}; i < s.arg; ++i) {
+      engine->add_state("dead" + std::to_string(i), next_state(), {{"next", "s" + std::to_string(i)}});
+    }
+    s.time([&] {
+      for (auto i = std::int64_t{0}; i < s.iterations; ++i) engine->validate(true);
+    });
+    s.items = s.iterations * 2 * s.arg;
+  });
+
+  // building a 5000-state chain: 0 through add_state() and validate(), 1 from a text definition, 2 from its binary
+  // form; items are states
+  bench::add("engine/load_definition", {0, 1, 2}, [](bench::state& s) {
+    constexpr auto length = 5000;
+    auto registry = msm::state_registry{};
+    registry.add("next", [](std::string_view) { return next_state(); });
+    auto text = std::string{"outcomes done\n"};
+    for (auto i = 0; i < length; ++i) {
+      auto target = i + 1 < length ? "s" + std::to_string(i + 1) : std::string{"done"};
+      text += "state s" + std::to_string(i) + " next next=" + target + "\n";
+    }
+    auto binary = msm::machine_definition::parse(text).compile(registry);
+    s.time([&] {
+      for (auto i = std::int64_t{0}; i < s.iterations; ++i) {
+        if (s.arg == 0) {
+          bench::do_not_optimize(make_chain(length));
+        } else if (s.arg == 1) {
+          bench::do_not_optimize(msm::machine_definition::parse(text).build(registry));
+        } else {
+          bench::do_not_optimize(msm::machine_definition::load(binary, registry));
+        }
+      }
+    });
+    s.items = s.iterations * length;
+  });
+
+  // a machine per request: build a 16-state chain and a blackboard, run it once and drop it all, 0 on the global
+  // heap, 1 in a machine_arena; items are machines
+  bench::add("engine/spawn", {0, 1}, [](bench::state& s) {
+    constexpr auto length = 16;
+    auto spawn = [](auto make) {
+      auto engine = make.template operator()<msm_engine>(std::unordered_set<std::string>{"done"});
+      for (auto i = 0; i < length; ++i) {
+        auto target = i + 1 < length ? "s" + std::to_string(i + 1) : std::string{"done"};
+        auto state = make.template operator()<callback_state>(
+            [](blackboard::ptr) -> std::string { return "next"; }, std::unordered_set<std::string>{"next"});
+        engine->add_state("s" + std::to_string(i), state, {{"next", target}});
+      }
+      bench::do_not_optimize(engine->execute(make.template operator()<blackboard>()));
+    };
+    s.time([&] {
+      for (auto i = std::int64_t{0}; i < s.iterations; ++i) {
+        if (s.arg == 0) {
+          spawn([]<typename T>(auto&&... args) { return std::make_shared<T>(std::forward<decltype(args)>(args)...); });
+        } else {
+          auto arena = msm::machine_arena{};
+          spawn([&arena]<typename T>(auto&&... args) { return arena.make<T>(std::forward<decltype(args)>(args)...); });
+        }
+      }
+    });
+    s.items = s.iterations;
+  });
+
+  // parallel_state branches, items are branch executions
+  bench::add("parallel_state/fan_out", {2, 4, 8, 16, 32, 64}, [](bench::state& s) {
+    auto branches = std::unordered_set<msm_state::ptr>{};
+    auto all_ok = std::unordered_map<msm_state::ptr, std::string>{};
+    for (auto b = std::int64_t{0}; b < s.arg; ++b) {
+      auto branch = std::make_shared<callback_state>(
+          [](blackboard::ptr) -> std::string { return "ok"; }, std::unordered_set<std::string>{"ok"});
+      branches.insert(branch);
+      all_ok[branch] = "ok";
+    }
+    auto fan_out = parallel_state{branches, "failed", {{"joined", all_ok}}};
+    auto bb = std::make_shared<blackboard>();
+    s.time([&] {
+      for (auto i = std::int64_t{0}; i < s.iterations; ++i) bench::do_not_optimize(fan_out(bb));
+    });
+    s.items = s.iterations * s.arg;
+  });
+  return true;
+}();
+}  // namespace
+
+auto main(int argc, char** argv) -> int { return bench::run(argc, argv); }
@@ -0,0 +1,72 @@
+// Scaling benchmark for sharded_runtime: 64 engines, each a 32-state chain whose states do a little arithmetic, run
+// over and over through a runtime with as many shards as the argument. Items are transitions; on a machine with at
+// least that many cores they should grow close to linearly with the shard count. The machine's core count is in
+// the JSON context (num_cpus), shard counts above it only measure oversubscription.
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+#include "bench.hpp"
+#include "runtime.hpp"
+
+using msm::blackboard;
+using msm::callback_state;
+using msm::msm_engine;
+
+namespace {
+constexpr auto engine_count = 64;
+constexpr auto chain_length = 32;
+
+auto make_worker_chain() -> std::shared_ptr<msm_engine> {
+  auto engine = std::make_shared<msm_engine>(std::unordered_set<std::string>{"done"});
+  for (auto i = 0; i < chain_length; ++i) {
+    auto target = i + 1 < chain_length ? "s" + std::to_string(i + 1) : std::string{"done"};
+    auto state = std::make_shared<callback_state>(
+        [](blackboard::ptr) -> std::string {
+          auto x = std::uint64_t{1};
+          for (auto k = 0; k < 200; ++k) x = x * 6364136223846793005 + 1442695040888963407;
+          bench::do_not_optimize(x);
+          return "next";
+        },
+        std::unordered_set<std::string>{"next"});
+    engine->add_state("s" + std::to_string(i), state, {{"next", target}});
+  }
+  engine->set_initial_state("s0");
+  engine->validate();
+  return engine;
+}
+
+const auto registered = [] {
+  // shard count, items are transitions; each iteration is one run of every engine
+  bench::add("runtime/scaling", {1, 2, 4, 8}, [](bench::state& s) {
+    auto runtime = msm::sharded_runtime{static_cast<std::size_t>(s.arg)};
+    auto engines = std::vector<std::shared_ptr<msm_engine>>{};
+    auto boards = std::vector<blackboard::ptr>{};
+    for (auto i = 0; i < engine_count; ++i) {
+      engines.push_back(make_worker_chain());
+      boards.push_back(std::make_shared<blackboard>());
+    }
+
+    auto mtx = std::mutex{};
+    auto finished = std::condition_variable{};
+    auto left = std::int64_t{0};
+    auto on_done = [&](std::optional<std::string>, std::exception_ptr) {
+      auto lock = std::lock_guard(mtx);
+      if (--left == 0) finished.notify_one();
+    };
+
+    s.time([&] {
+      left = s.iterations * engine_count;
+      for (auto i = std::int64_t{0}; i < s.iterations; ++i) {
+        for (auto e = 0; e < engine_count; ++e) runtime.submit(engines[e], boards[e], on_done);
+      }
+      auto lock = std::unique_lock(mtx);
+      finished.wait(lock, [&] { return left == 0; });
+    });
+    s.items = s.iterations * engine_count * chain_length;
+  });
+  return true;
+}();
+}  // namespace
+
+auto main(int argc, char** argv) -> int { return bench::run(argc, argv); }
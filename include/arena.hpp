@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace msm {
+// Hash and equality for string-keyed tables that are looked up with std::string, std::pmr::string or string views
+// alike (the two string types do not compare with each other directly)
+struct string_hash {
+  using is_transparent = void;
+  auto operator()(std::string_view value) const noexcept -> std::size_t { return std::hash<std::string_view>{}(value); }
+};
+struct string_equal {
+  using is_transparent = void;
+  auto operator()(std::string_view lhs, std::string_view rhs) const noexcept -> bool { return lhs == rhs; }
+};
+
+// Memory for one machine: msm_engine, callback_state, parallel_state and blackboard are allocator-aware, and states,
+// their outcomes and callbacks, engine tables and blackboard storage made through make() come out of a few large
+// blocks instead of one heap allocation each; building a machine this way does not touch the global heap.
+// Nothing is freed until the arena goes away, which releases the whole machine at once, so threads that spin up
+// and discard machines per request stop contending in malloc. Allocations take an uncontended mutex, as the
+// blackboard of a running machine may grow from several threads.
+//
+// Everything made from the arena must be destroyed before it. The graph validate() compiles and per-run data
+// (parallel_state joins, blackboard values that do not fit inline) still use the global heap.
+class machine_arena final : public std::pmr::memory_resource {
+ private:
+  std::mutex mtx;
+  std::pmr::monotonic_buffer_resource buffer;
+  std::size_t allocated = 0;
+
+ protected:
+  auto do_allocate(std::size_t bytes, std::size_t alignment) -> void* override;
+  auto do_deallocate(void*, std::size_t, std::size_t) -> void override {}  // released with the arena
+  auto do_is_equal(const std::pmr::memory_resource& other) const noexcept -> bool override { return this == &other; }
+
+ public:
+  explicit machine_arena(std::size_t initial_size = 16 * 1024,
+                         std::pmr::memory_resource* upstream = std::pmr::get_default_resource());
+  machine_arena(const machine_arena&) = delete;
+  ~machine_arena() override = default;
+
+  // The object and its shared_ptr control block in one arena allocation; allocator-aware types (msm_engine,
+  // parallel_state, blackboard) are given the arena for their own tables too
+  template <typename T, typename... Args>
+  auto make(Args&&... args) -> std::shared_ptr<T> {
+    return std::allocate_shared<T>(std::pmr::polymorphic_allocator<T>{this}, std::forward<Args>(args)...);
+  }
+
+  auto bytes_allocated() -> std::size_t;
+};
+}  // namespace msm
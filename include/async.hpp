@@ -0,0 +1,189 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "state.hpp"
+
+namespace msm {
+// Lazily-started coroutine producing a T. Awaiting a task starts it and resumes the awaiter when it finishes;
+// root tasks are started with event_loop::spawn().
+template <typename T>
+class task final {
+ public:
+  struct promise_type {
+    std::optional<T> value;
+    std::exception_ptr error;
+    std::coroutine_handle<> continuation;
+
+    struct final_awaiter {
+      auto await_ready() const noexcept -> bool { return false; }
+      auto await_suspend(std::coroutine_handle<promise_type> handle) noexcept -> std::coroutine_handle<> {
+        auto continuation = handle.promise().continuation;
+        return continuation ? continuation : std::noop_coroutine();
+      }
+      auto await_resume() const noexcept -> void {}
+    };
+
+    auto get_return_object() -> task { return task{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+    auto initial_suspend() const noexcept -> std::suspend_always { return {}; }
+    auto final_suspend() const noexcept -> final_awaiter { return {}; }
+    auto return_value(T result) -> void { value.emplace(std::move(result)); }
+    auto unhandled_exception() noexcept -> void { error = std::current_exception(); }
+  };
+
+ private:
+  std::coroutine_handle<promise_type> handle;
+
+  explicit task(std::coroutine_handle<promise_type> handle_) : handle{handle_} {}
+
+ public:
+  task(task&& other) noexcept : handle{std::exchange(other.handle, nullptr)} {}
+  task(const task&) = delete;
+  ~task() {
+    if (handle) handle.destroy();
+  }
+
+  auto operator=(task&& other) noexcept -> task& {
+    if (this != &other) {
+      if (handle) handle.destroy();
+      handle = std::exchange(other.handle, nullptr);
+    }
+    return *this;
+  }
+
+  auto await_ready() const noexcept -> bool { return !handle || handle.done(); }
+  auto await_suspend(std::coroutine_handle<> awaiter) noexcept -> std::coroutine_handle<> {
+    handle.promise().continuation = awaiter;
+    return handle;  // symmetric transfer into the task
+  }
+  auto await_resume() -> T {
+    if (handle.promise().error) std::rethrow_exception(handle.promise().error);
+    return std::move(*handle.promise().value);
+  }
+};
+
+// Run loop multiplexing coroutines on the threads that call run(). post() and the timer functions are
+// thread-safe; run() may be called from several threads at once to spread the work.
+class event_loop final {
+ public:
+  using clock = std::chrono::steady_clock;
+
+ private:
+  struct timer {
+    clock::time_point deadline;
+    std::uint64_t sequence;  // keeps timers with equal deadlines in FIFO order
+    std::coroutine_handle<> handle;
+
+    auto operator>(const timer& other) const noexcept -> bool {
+      return deadline != other.deadline ? deadline > other.deadline : sequence > other.sequence;
+    }
+  };
+
+  // Fire-and-forget coroutine that owns a spawned task and reports its result
+  struct detached {
+    struct promise_type {
+      auto get_return_object() const noexcept -> detached { return {}; }
+      auto initial_suspend() const noexcept -> std::suspend_never { return {}; }
+      auto final_suspend() const noexcept -> std::suspend_never { return {}; }
+      auto return_void() const noexcept -> void {}
+      auto unhandled_exception() const noexcept -> void { std::terminate(); }
+    };
+  };
+
+  std::mutex mtx;
+  std::condition_variable wake;
+  std::deque<std::coroutine_handle<>> ready;
+  std::priority_queue<timer, std::vector<timer>, std::greater<>> timers;
+  std::uint64_t timer_sequence = 0;
+  std::size_t outstanding = 0;  // spawned tasks that have not finished yet
+  bool stopped = false;
+
+  template <typename T, typename Callback>
+  static auto drive(event_loop* loop, task<T> work, Callback on_done) -> detached {
+    co_await loop->resume_on();  // start on a thread running the loop rather than inside spawn()
+    auto result = std::optional<T>{};
+    auto error = std::exception_ptr{};
+    try {
+      result.emplace(co_await std::move(work));
+    } catch (...) {
+      error = std::current_exception();
+    }
+    on_done(std::move(result), error);
+    loop->finish_one();
+  }
+
+  auto finish_one() -> void;
+
+ public:
+  struct schedule_awaiter {
+    event_loop* loop;
+    clock::time_point deadline;
+
+    auto await_ready() const noexcept -> bool { return false; }
+    auto await_suspend(std::coroutine_handle<> handle) -> void;
+    auto await_resume() const noexcept -> void {}
+  };
+
+  event_loop() = default;
+  event_loop(const event_loop&) = delete;
+  ~event_loop() = default;
+
+  auto post(std::coroutine_handle<> handle) -> void;
+  auto schedule_at(clock::time_point deadline, std::coroutine_handle<> handle) -> void;
+
+  auto resume_on() -> schedule_awaiter { return {this, clock::time_point::min()}; }  // reschedule onto this loop
+  auto sleep_until(clock::time_point deadline) -> schedule_awaiter { return {this, deadline}; }
+  template <typename Rep, typename Period>
+  auto sleep_for(std::chrono::duration<Rep, Period> duration) -> schedule_awaiter {
+    return {this, clock::now() + std::chrono::duration_cast<clock::duration>(duration)};
+  }
+
+  // Starts a root task on this loop; on_done(std::optional<T>, std::exception_ptr) runs on a loop thread.
+  template <typename T, typename Callback>
+  auto spawn(task<T> work, Callback on_done) -> void {
+    {
+      auto lock = std::lock_guard(mtx);
+      ++outstanding;
+    }
+    drive(this, std::move(work), std::move(on_done));
+  }
+
+  auto run() -> void;      // runs until every spawned task has finished or stop() is called
+  auto stop() -> void;     // makes run() return on all threads, including calls made after it, until restart()
+  auto restart() -> void;  // clears a stop() so run() can be called again
+
+  static auto current() noexcept -> event_loop*;  // the loop run() is executing on this thread, if any
+  static auto running() -> event_loop&;           // current(), throws std::logic_error off a loop thread
+};
+
+// Timer awaitables for code running on an event_loop, e.g. co_await msm::sleep_for(10ms) inside an async_state.
+// Both throw std::logic_error when called from a thread that is not running a loop.
+template <typename Rep, typename Period>
+auto sleep_for(std::chrono::duration<Rep, Period> duration) -> event_loop::schedule_awaiter {
+  return event_loop::running().sleep_for(duration);
+}
+auto yield() -> event_loop::schedule_awaiter;
+
+// State whose work is a coroutine, so waiting on I/O or timers suspends it instead of blocking a thread.
+// msm_engine::execute_async() awaits it directly; the synchronous execute() runs it on a private event_loop.
+class async_state : public msm_state {
+ public:
+  using msm_state::msm_state;
+  ~async_state() override = default;
+
+  virtual auto execute_async(blackboard::ptr bb) -> task<std::string> = 0;
+  auto execute(blackboard::ptr bb) -> std::string override;
+
+  auto invoke_async(blackboard::ptr bb) -> task<std::string>;  // invoke() counterpart for execute_async()
+};
+}  // namespace msm
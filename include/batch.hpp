@@ -0,0 +1,65 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+
+#include "engine.hpp"
+
+namespace msm {
+// Many instances of one machine definition. The msm_engine supplies the immutable part (compiled graph, states,
+// callbacks); each instance only owns a current state id, a final outcome id and a pooled blackboard, stored
+// struct-of-arrays so a step over all instances walks contiguous memory.
+//
+// States and callbacks are shared by every instance and may run concurrently on executor threads, so they must
+// not keep per-run data outside the blackboard. Nested engines flattened into the graph keep none. States that do
+// (parallel states, and engines run as opaque states: msm_engine subclasses and nested engines with a timeout)
+// are detected on construction, and instances in them are stepped one at a time on the calling thread.
+class msm_batch final {
+ public:
+  using instance_id = std::size_t;
+
+ private:
+  std::shared_ptr<msm_engine> definition;
+  compiled_graph::ptr graph;
+  executor::ptr batch_executor;
+
+  std::vector<compiled_graph::id_t> current;   // instance -> state id, npos when finished or released
+  std::vector<compiled_graph::id_t> outcomes;  // instance -> final outcome id, npos while running
+  std::vector<blackboard::ptr> boards;         // instance -> blackboard, kept (and reset) across reuse
+  std::vector<instance_id> released;           // slots free for spawn()
+  std::vector<bool> free_slots;                // instance -> in released
+  std::size_t running = 0;
+  bool tracked = false;  // msm_engine::tracks_writes(), decided once per step_all()
+
+  std::vector<bool> serial_states;       // state id -> keeps per-run data, empty if no state does
+  std::vector<unsigned char> deferred;   // instance -> left for the serial pass, empty if no state keeps data
+
+  // Executes the current state of an instance once, returns whether it finished
+  auto step_one(instance_id instance) -> bool;
+  // step_one() on every running instance in [begin, end), deferring those in serial states; returns how many finished
+  auto step_range(std::size_t begin, std::size_t end) -> std::size_t;
+
+ public:
+  // Validates the definition. Throws std::invalid_argument if it has a run budget or state timeouts: instances
+  // are stepped without timers, see msm_engine::set_timeout().
+  explicit msm_batch(std::shared_ptr<msm_engine> definition_, executor::ptr executor_ = nullptr);
+  msm_batch(const msm_batch&) = delete;
+  ~msm_batch() = default;
+
+  // Starts an instance at the initial state. Reuses a released slot and its blackboard (reset) if there is one.
+  auto spawn() -> instance_id;
+  auto release(instance_id instance) -> void;  // std::logic_error if the instance is already released
+
+  // Advances every running instance by one state, splitting the instances into chunks of `grain` across the
+  // executor. Returns the number of instances still running. The first exception thrown by a state or callback
+  // is rethrown once every chunk is done; the instance that threw stays in its state.
+  auto step_all(std::size_t grain = 1024) -> std::size_t;
+  auto execute_batch(std::size_t grain = 1024) -> void;  // step_all() until every instance has finished
+
+  auto size() const noexcept -> std::size_t { return current.size() - released.size(); }
+  auto running_count() const noexcept -> std::size_t { return running; }
+  auto get_blackboard(instance_id instance) const -> const blackboard::ptr& { return boards.at(instance); }
+  auto get_current_state(instance_id instance) const -> std::string;  // "" once finished
+  auto get_outcome(instance_id instance) const -> std::optional<std::string>;
+};
+}  // namespace msm
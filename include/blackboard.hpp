@@ -4,11 +4,31 @@
 #include <cxxabi.h> // For abi::__cxa_demangle
 #endif
 
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
 #include <memory>
+#include <memory_resource>
 #include <mutex>
+#include <new>
 #include <optional>
+#include <shared_mutex>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
+#include <typeinfo>
 #include <unordered_map>
+#include <vector>
+
+#include "arena.hpp"
+#include "snapshot.hpp"
 
 namespace msm {
 // Interface for a blackboard entry
@@ -17,12 +37,13 @@ class blackboard_entry_interface {
   using ptr = std::shared_ptr<blackboard_entry_interface>;
   virtual ~blackboard_entry_interface() = default;
   virtual auto to_string() const -> std::string = 0;
+  virtual auto clone() const -> ptr = 0;  // deep copy of the stored value
 };
 
 template <typename T>
 class blackboard_entry : public blackboard_entry_interface {
  private:
-  std::string value;
+  T value;
 
  public:
   blackboard_entry(const T& value_) : value(value_) {}
@@ -31,8 +52,8 @@ class blackboard_entry : public blackboard_entry_interface {
   auto get_ref() -> T& { return value; }
   auto set_value(const T& new_value) -> void { value = new_value; }
   
-  auto get_type() const -> std::string {
-    auto type = typeid(T).name();
+  static auto get_type() -> std::string {
+    auto type = std::string{typeid(T).name()};
 #ifdef __GNUG__  // If using GCC/G++
     int status;
     // Demangle the name using GCC's demangling function
@@ -45,67 +66,483 @@ class blackboard_entry : public blackboard_entry_interface {
     return type;
   }
   
-  auto to_string() const override -> std::string {
-    try {
+  static auto format(const T& value) -> std::string {
+    if constexpr (std::is_arithmetic_v<T>) {
       return std::to_string(value);
-    } catch (const std::exception& e) {
-      std::cerr << e.what() << '\n';
+    } else if constexpr (std::is_convertible_v<const T&, std::string>) {
+      return std::string{value};
+    } else {
       return "Object of Type [" + get_type() + "]";
     }
   }
+
+  auto to_string() const -> std::string override { return format(value); }
+  auto clone() const -> ptr override { return std::make_shared<blackboard_entry<T>>(value); }
 };
 
-// Blackboard class for storing key-value pairs
+// Blackboard class for storing key-value pairs. Readers share a std::shared_mutex, writers take it exclusively, and
+// reads of inline values through a key first try a lock-free seqlock path.
 class blackboard final {
+ public:
+  using ptr = std::shared_ptr<blackboard>;
+  using watch_id = std::uint64_t;
+  using watch_callback_t = std::function<void(const std::string& key)>;
+
+  // Handle to a blackboard entry resolved once via blackboard::resolve<T>(). Accessing through a key is a direct
+  // slot lookup: no string hashing and no dynamic_pointer_cast. Keys stay valid for the blackboard that resolved
+  // them and for copies of it, until clear() is called.
+  template <typename T>
+  class key final {
+   private:
+    std::size_t slot = npos;
+    std::uint64_t generation = 0;  // clear() count of the blackboard when resolved
+
+    key(std::size_t slot_, std::uint64_t generation_) : slot{slot_}, generation{generation_} {}
+    friend class blackboard;
+
+   public:
+    key() = default;
+    auto valid() const noexcept -> bool { return slot != npos; }
+  };
+
  private:
-  std::unordered_map<std::string, blackboard_entry_interface::ptr> entries;
-  mutable std::recursive_mutex mtx;
+  static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+  static constexpr std::size_t inline_capacity = 32;  // bytes of small-buffer storage per slot
+  static constexpr std::size_t page_size = 32;        // slots per page
+  static constexpr std::size_t first_chunk = 8;       // pages in the first chunk table, each next one holds twice that
+  static constexpr std::size_t max_chunks = 48;       // more pages than fit in memory
+
+  // Trivially-copyable values that fit the small buffer live inline in their slot, everything else is boxed in a
+  // heap-allocated blackboard_entry<T>.
+  template <typename T>
+  static constexpr bool stored_inline = std::is_trivially_copyable_v<T> && sizeof(T) <= inline_capacity &&
+                                        alignof(T) <= alignof(std::max_align_t);
+
+  struct entry_ops {
+    std::string (*to_string)(const void* value);  // only used for inline values
+  };
+
+  template <typename T>
+  static constexpr entry_ops ops_for{[](const void* value) -> std::string {
+    return blackboard_entry<T>::format(*static_cast<const T*>(value));
+  }};  // the address identifies T, compared instead of dynamic casting
+
+  struct cell {  // trivially copyable, so a page of cells is cloned with a single memcpy
+    const entry_ops* type = nullptr;
+    bool present = false;
+    alignas(std::max_align_t) unsigned char storage[inline_capacity];
+  };
+
+  // Slots are allocated a page at a time and never move, so references handed out by operator[] stay valid
+  // while the blackboard grows and lock-free readers can reach a cell without touching the index.
+  struct page {
+    std::array<cell, page_size> cells;
+    std::array<blackboard_entry_interface::ptr, page_size> boxed;
+    std::array<std::atomic<std::uint32_t>, page_size> sequence{};  // seqlock counters, odd while a write is running
+    std::array<std::uint64_t, page_size> versions{};                // blackboard version of the last write
+  };
+
+  // Pages come from the blackboard's memory resource
+  struct page_deleter {
+    std::pmr::memory_resource* resource = nullptr;
+    auto operator()(page* p) const noexcept -> void {
+      p->~page();
+      resource->deallocate(p, sizeof(page), alignof(page));
+    }
+  };
+  using page_ptr = std::unique_ptr<page, page_deleter>;
+
+  struct journal_entry {
+    std::uint64_t version;
+    std::size_t slot;
+  };
+  static constexpr std::size_t journal_capacity = 256;
+
+  // Seqlock writer side: bumps a cell's sequence to odd for the duration of a mutation (under the exclusive lock).
+  class sequence_guard final {
+   private:
+    std::atomic<std::uint32_t>& sequence;
+
+   public:
+    explicit sequence_guard(std::atomic<std::uint32_t>& sequence_) : sequence{sequence_} {
+      sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+    }
+    ~sequence_guard() { sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+  };
+
+  // Type-erased snapshot_codec<T>, looked up by the type tag when writing and by name when restoring
+  struct codec {
+    std::string name;
+    std::size_t (*size)(const blackboard& bb, std::size_t slot);
+    void (*encode)(const blackboard& bb, std::size_t slot, std::byte* out);
+    void (*decode)(blackboard& bb, std::size_t slot, std::span<const std::byte> payload);
+  };
+
+  struct codec_registry {
+    std::shared_mutex mtx;  // taken before a blackboard's mtx when both are held
+    std::unordered_map<const entry_ops*, codec> by_type;
+    std::unordered_map<std::string, const entry_ops*> by_name;
+  };
+
+  template <typename T>
+  static auto make_codec(const std::string& name) -> codec {
+    return codec{
+        name,
+        [](const blackboard& bb, std::size_t slot) -> std::size_t {
+          return snapshot_codec<T>::size(*bb.value_at<T>(slot));
+        },
+        [](const blackboard& bb, std::size_t slot, std::byte* out) -> void {
+          snapshot_codec<T>::encode(*bb.value_at<T>(slot), out);
+        },
+        [](blackboard& bb, std::size_t slot, std::span<const std::byte> payload) -> void {
+          bb.emplace_at(slot, snapshot_codec<T>::decode(payload));
+        }};
+  }
+
+  static auto codecs() -> codec_registry&;  // built-in codecs for arithmetic types and std::string
+  static auto add_codec(const entry_ops* type, codec entry) -> void;
+
+  struct snapshot_plan;  // what snapshot() is about to write, computed under both locks
+  // Plans every present value, or only the given slots with absent ones written as removals
+  auto plan_snapshot(const codec_registry& registry, const std::vector<std::size_t>* slots = nullptr) const
+      -> snapshot_plan;
+  auto write_snapshot(const snapshot_plan& plan, std::span<std::byte> buffer) const -> std::size_t;
+  auto read_snapshot(std::span<const std::byte> bytes, bool merge) -> void;  // restore(), or apply() if merge
+
+  std::pmr::unordered_map<std::pmr::string, std::size_t, string_hash, string_equal> index;  // key name -> slot
+  // Two-level page directory: chunk table k holds first_chunk << k page pointers. Tables and pages are published
+  // before the slot_count that covers them and are kept until the blackboard is destroyed (clear() empties the
+  // pages in place), so a lock-free reader that saw a slot below slot_count can always reach its cell.
+  std::array<std::atomic<page**>, max_chunks> directory{};
+  std::pmr::vector<page_ptr> pages;  // owns the pages, in directory order, only used under the lock
+  std::atomic<std::size_t> slot_count{0};
+  std::atomic<std::uint64_t> generation{0};  // bumped by clear(), keys resolved before it are stale
+  std::size_t live = 0;  // number of slots holding a value
+  mutable std::shared_mutex mtx;
+
+  // Change tracking: every write bumps version and stamps the slot with it. The journal is a ring of the most
+  // recent writes, so changes_since() only scans all slots for versions older than journal_floor.
+  std::atomic<std::uint64_t> version{0};  // only written under the exclusive lock, read without it
+  std::uint64_t journal_floor = 0;     // every write after this version is in the journal
+  std::pmr::vector<journal_entry> journal;  // reserved by the first acquire_slot(), never reallocated after that
+  std::size_t journal_next = 0;            // oldest entry, overwritten next once the journal is full
+  std::pmr::vector<std::pmr::string> names;  // slot -> key name
+
+  // Notifications for set(), remove(), reset() and restore(); writes through operator[] references are not seen.
+  // Writers only touch watch_mtx while someone is listening.
+  struct watcher {
+    watch_id id;
+    std::size_t slot;
+    watch_callback_t callback;
+  };
+
+  std::atomic<std::size_t> listeners{0};  // watchers plus blocked wait_for() calls
+  mutable std::mutex watch_mtx;
+  std::condition_variable watch_changed;
+  std::uint64_t watch_epoch = 0;        // bumped when a slot somebody waits on is written, or by wake_waiters()
+  std::vector<std::size_t> waiting;     // slots of blocked wait_for() calls, one entry per call
+  std::vector<watcher> watchers;
+  watch_id next_watch = 1;
+
+  auto notify(std::size_t slot) -> void {  // slot is npos for "every key"
+    if (listeners.load() != 0) notify_listeners(slot);
+  }
+  auto notify_listeners(std::size_t slot) -> void;
+  struct waiter {  // a blocked wait_for(), registered under the slot its key had in generation
+    std::size_t slot;
+    std::uint64_t generation;
+  };
+  auto add_waiter(const std::string& key) -> waiter;
+  auto refresh_waiter(const std::string& key, waiter& registered) -> void;  // moves it to the key's slot after clear()
+  auto remove_waiter(std::size_t slot) noexcept -> void;
+
+  auto page_at(std::size_t index) const noexcept -> page& {
+    auto chunk = static_cast<std::size_t>(std::bit_width(index / first_chunk + 1)) - 1;
+    auto offset = index - first_chunk * ((std::size_t{1} << chunk) - 1);
+    return *directory[chunk].load(std::memory_order_acquire)[offset];
+  }
+  auto cell_at(std::size_t slot) const noexcept -> cell& { return page_at(slot / page_size).cells[slot % page_size]; }
+  auto boxed_at(std::size_t slot) const noexcept -> blackboard_entry_interface::ptr& {
+    return page_at(slot / page_size).boxed[slot % page_size];
+  }
+  auto sequence_at(std::size_t slot) const noexcept -> std::atomic<std::uint32_t>& {
+    return page_at(slot / page_size).sequence[slot % page_size];
+  }
+  auto version_at(std::size_t slot) const noexcept -> std::uint64_t& {
+    return page_at(slot / page_size).versions[slot % page_size];
+  }
+
+  auto touch(std::size_t slot) noexcept -> void;  // records a write to slot (under the exclusive lock)
+  auto erase_at(std::size_t slot) noexcept -> void;  // empties a present slot (under the exclusive lock)
+  auto changed_slots(std::uint64_t since) const -> std::vector<std::size_t>;  // in slot order, under a lock
+
+  // Optimistic read of an inline value without taking the lock. Returns false if a writer kept interfering, in
+  // which case the caller falls back to the shared lock. A key resolved before a clear() reads nothing.
+  template <typename T>
+  auto try_read_inline(std::size_t slot, std::uint64_t resolved, std::optional<T>& out) const noexcept -> bool {
+    if (slot >= slot_count.load(std::memory_order_acquire)) return false;
+
+    const auto& sequence = sequence_at(slot);
+    const auto& s = cell_at(slot);
+    for (auto attempt = 0; attempt < 4; ++attempt) {
+      auto before = sequence.load(std::memory_order_acquire);
+      if (before & 1u) continue;
+
+      auto matches = s.present && s.type == &ops_for<T>;
+      alignas(T) unsigned char buffer[sizeof(T)];
+      std::memcpy(buffer, s.storage, sizeof(T));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (sequence.load(std::memory_order_relaxed) != before) continue;
+
+      // a value written after a clear() is only seen together with its generation, see the acquire load above
+      if (matches && generation.load(std::memory_order_relaxed) == resolved) {
+        out.emplace(*std::launder(reinterpret_cast<const T*>(buffer)));
+      } else {
+        out.reset();
+      }
+      return true;
+    }
+    return false;
+  }
+
+  template <typename T>
+  auto value_at(std::size_t slot) const noexcept -> T* {  // nullptr if the slot is empty or holds another type
+    if (slot >= slot_count.load(std::memory_order_relaxed)) return nullptr;
+    auto& s = cell_at(slot);
+    if (!s.present || s.type != &ops_for<T>) return nullptr;
+    if constexpr (stored_inline<T>) {
+      return std::launder(reinterpret_cast<T*>(s.storage));
+    } else {
+      return &static_cast<blackboard_entry<T>*>(boxed_at(slot).get())->get_ref();
+    }
+  }
+
+  template <typename T>
+  auto emplace_at(std::size_t slot, const T& value) -> T& {
+    auto guard = sequence_guard{sequence_at(slot)};
+    auto& s = cell_at(slot);
+    s.type = &ops_for<T>;
+    s.present = true;
+    ++live;
+    touch(slot);
+    if constexpr (stored_inline<T>) {
+      return *::new (static_cast<void*>(s.storage)) T(value);
+    } else {
+      auto entry = std::make_shared<blackboard_entry<T>>(value);
+      boxed_at(slot) = entry;
+      return entry->get_ref();
+    }
+  }
+
+  template <typename T>
+  auto assign_at(std::size_t slot, T& current, const T& value) -> void {
+    auto guard = sequence_guard{sequence_at(slot)};
+    current = value;
+    touch(slot);
+  }
+
+  template <typename T>
+  auto stale(const key<T>& key) const noexcept -> bool {  // resolved before a clear(), under a lock
+    return key.generation != generation.load(std::memory_order_relaxed);
+  }
+
+  template <typename T>
+  auto is_typed(std::size_t slot) const noexcept -> bool {
+    return slot < slot_count.load(std::memory_order_relaxed) && cell_at(slot).type == &ops_for<T>;
+  }
+
+  auto make_page() -> page_ptr;
+  auto add_page() -> page&;  // appends a page to the directory (under the exclusive lock)
+  auto find_slot(const std::string& key) const noexcept -> std::size_t;
+  auto acquire_slot(const std::string& key) -> std::size_t;  // finds or appends an empty slot for key
+  auto copy_from(const blackboard& other) -> void;
+  auto reset_values() noexcept -> void;  // reset() without taking the lock
 
  public:
-  using ptr = std::shared_ptr<blackboard>;
+  // Key index, names, pages and journal are allocated from the allocator's resource, see machine_arena; values
+  // that are not stored inline are not
+  using allocator_type = std::pmr::polymorphic_allocator<>;
 
-  blackboard(const blackboard&);
+  blackboard(const blackboard&);  // deep copy, see clone()
+  blackboard(const blackboard& other, const allocator_type& allocator);
   blackboard() = default;
-  ~blackboard() = default;
+  explicit blackboard(const allocator_type& allocator);
+  explicit blackboard(std::size_t capacity);  // pre-sizes storage for capacity keys
+  blackboard(std::size_t capacity, const allocator_type& allocator);
+  ~blackboard();
 
   auto contains(const std::string& key) const noexcept -> bool;
-  auto remove(const std::string& key) noexcept -> void;
+  auto remove(const std::string& key) -> void;  // throws what a watch callback throws, see watch()
   auto size() const noexcept -> size_t;
-  auto clear() noexcept -> void;
+  auto clear() noexcept -> void;  // drops all keys, invalidating resolved keys; storage is kept for new ones
+  auto reset() -> void;           // drops all values but keeps keys and storage for reuse, throws like remove()
+  auto clone() const -> ptr;      // inline values are copied page by page, boxed values are deep-copied
   auto serialize() const -> std::string;
 
+  // Every write (set, operator[], remove, reset, restore) advances the version. changes_since(v) lists the keys
+  // written after version v, including removed ones, in slot order. get_version() does not lock.
+  auto get_version() const noexcept -> std::uint64_t;
+  auto changes_since(std::uint64_t since) const -> std::vector<std::string>;
+
+  // Binary checkpoint of every value, each encoded by the codec registered for its type. Throws
+  // std::runtime_error if a value has no codec and std::length_error if the buffer is too small.
+  auto snapshot_size() const -> std::size_t;
+  auto snapshot(std::span<std::byte> buffer) const -> std::size_t;  // returns the number of bytes written
+  auto snapshot() const -> std::vector<std::byte>;
+  auto save(const std::string& path) const -> void;
+
+  // Replaces all values with the snapshot's. Keys not in the snapshot stay resolved but empty.
+  auto restore(std::span<const std::byte> bytes) -> void;
+  auto load(const std::string& path) -> void;  // restore() from a memory-mapped file
+
+  // Delta snapshot: the keys written after version since, in the snapshot format, with removed keys marked as
+  // such. apply() writes a delta (or a full snapshot) over the current values and leaves every other key alone.
+  auto snapshot_changes(std::uint64_t since) const -> std::vector<std::byte>;
+  auto apply(std::span<const std::byte> bytes) -> void;
+
+  // Calls callback(key) on the writing thread after each set()/remove() of key and after reset()/restore(). The
+  // callback runs without the blackboard lock held, so it may read the blackboard. The write is complete by then;
+  // an exception from a callback skips the remaining callbacks of that write and propagates to the writer. watch()
+  // creates the key if needed, clear() drops all watches.
+  auto watch(const std::string& key, watch_callback_t callback) -> watch_id;
+  auto unwatch(watch_id id) -> void;
+
+  // Blocks until the value of key is a T satisfying predicate and returns it, or returns std::nullopt once the
+  // timeout expires or cancelled() returns true. Nothing is polled: the waiter wakes on a write to key, at the
+  // timeout, and on wake_waiters(), which whoever makes cancelled() true must call (msm_state::cancel() does).
+  // A clear() during the wait does not end it; the key is waited on again under the slot it gets afterwards.
+  template <typename T, typename Predicate, typename Rep, typename Period, typename Cancelled = bool (*)()>
+  auto wait_for(const std::string& key, Predicate predicate, std::chrono::duration<Rep, Period> timeout,
+                Cancelled cancelled = [] { return false; }) -> std::optional<T> {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    struct waiter_guard {
+      blackboard& bb;
+      waiter registered;
+      ~waiter_guard() { bb.remove_waiter(registered.slot); }
+    } guard{*this, add_waiter(key)};
+
+    auto lock = std::unique_lock(watch_mtx);
+    while (true) {
+      if (guard.registered.generation != generation.load(std::memory_order_relaxed)) {
+        lock.unlock();
+        refresh_waiter(key, guard.registered);  // before reading the value, so a set() to the new slot wakes us
+        lock.lock();
+      }
+      auto seen = watch_epoch;
+      lock.unlock();
+      auto value = get<T>(key);
+      if (value && predicate(*value)) return value;
+      if (cancelled()) return std::nullopt;
+      lock.lock();
+
+      auto now = std::chrono::steady_clock::now();
+      if (now >= deadline) return std::nullopt;
+      watch_changed.wait_until(lock, deadline, [&] { return watch_epoch != seen; });
+    }
+  }
+  auto wake_waiters() -> void;  // makes every blocked wait_for() re-check its value and cancelled()
+
+  // Makes values of type T snapshottable under a name that is stable across runs
+  template <typename T>
+  static auto register_codec(const std::string& name) -> void {
+    add_codec(&ops_for<T>, make_codec<T>(name));
+  }
+
+  template <typename T>
+  auto resolve(const std::string& name) -> key<T> {
+    auto lock = std::unique_lock(mtx);
+    auto slot = acquire_slot(name);
+    auto& s = cell_at(slot);
+    if (s.present && s.type != &ops_for<T>) {
+      throw std::runtime_error("Type mismatch for key: " + name);
+    }
+    auto guard = sequence_guard{sequence_at(slot)};
+    s.type = &ops_for<T>;
+    return key<T>{slot, generation.load(std::memory_order_relaxed)};
+  }
+
   template <typename T>
   auto get(const std::string& key) const -> std::optional<T> {
-    auto lock = std::lock_guard(mtx);
-    if (!this->contains(key)) return std::nullopt;
+    auto lock = std::shared_lock(mtx);
+    auto* value = value_at<T>(find_slot(key));
+    return value ? std::make_optional(*value) : std::nullopt;
+  }
+
+  template <typename T>
+  auto get(const key<T>& key) const -> std::optional<T> {
+    if constexpr (stored_inline<T>) {
+      auto result = std::optional<T>{};
+      if (try_read_inline(key.slot, key.generation, result)) return result;
+    }
 
-    auto entry = std::dynamic_pointer_cast<blackboard_entry<T>>(entries.at(key));
-    return entry ? std::make_optional(entry->get_value()) : std::nullopt;
+    auto lock = std::shared_lock(mtx);
+    if (stale(key)) return std::nullopt;
+    auto* value = value_at<T>(key.slot);
+    return value ? std::make_optional(*value) : std::nullopt;
   }
 
   template <typename T>
   auto set(const std::string& key, const T& value) -> void {
-    auto lock = std::lock_guard(mtx);
-    if (!this->contains(key)) {
-      entries[key] = std::make_shared<blackboard_entry<T>>(value);
+    auto lock = std::unique_lock(mtx);
+    auto slot = acquire_slot(key);
+    if (!cell_at(slot).present) {
+      emplace_at(slot, value);
+    } else if (auto* current = value_at<T>(slot)) {
+      assign_at(slot, *current, value);
     } else {
-      auto entry = std::dynamic_pointer_cast<blackboard_entry<T>>(entries.at(key));
-      entry->set_value(value);
+      throw std::runtime_error("Type mismatch for key: " + key);
+    }
+    lock.unlock();
+    notify(slot);
+  }
+
+  template <typename T>
+  auto set(const key<T>& key, const T& value) -> void {
+    auto lock = std::unique_lock(mtx);
+    if (stale(key)) {
+      throw std::runtime_error("Stale key for blackboard entry.");
+    } else if (auto* current = value_at<T>(key.slot)) {
+      assign_at(key.slot, *current, value);
+    } else if (is_typed<T>(key.slot)) {
+      emplace_at(key.slot, value);
+    } else {
+      throw std::runtime_error("Stale key for blackboard entry.");
     }
+    lock.unlock();
+    notify(key.slot);
   }
 
   template <typename T>
   auto operator[](const std::string& key) -> T& {
-    auto lock = std::lock_guard(mtx);
-    if (!this->contains(key)) {
-      entries[key] = std::make_shared<blackboard_entry<T>>(T{});
+    auto lock = std::unique_lock(mtx);
+    auto slot = acquire_slot(key);
+    if (!cell_at(slot).present) {
+      return emplace_at(slot, T{});
     }
-    auto entry = std::dynamic_pointer_cast<blackboard_entry<T>>(entries.at(key));
-    if (!entry) {
+    auto* value = value_at<T>(slot);
+    if (!value) {
       throw std::runtime_error("Type mismatch for key: " + key);
     }
-    return entry->get_ref();
+    touch(slot);  // the caller may write through the reference
+    return *value;
+  }
+
+  template <typename T>
+  auto operator[](const key<T>& key) -> T& {
+    auto lock = std::unique_lock(mtx);
+    if (stale(key)) {
+      throw std::runtime_error("Stale key for blackboard entry.");
+    }
+    if (auto* value = value_at<T>(key.slot)) {
+      touch(key.slot);  // the caller may write through the reference
+      return *value;
+    }
+    if (!is_typed<T>(key.slot)) {
+      throw std::runtime_error("Stale key for blackboard entry.");
+    }
+    return emplace_at(key.slot, T{});
   }
 };
 
-}  // namespace msm
\ No newline at end of file
+}  // namespace msm
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "engine.hpp"
+
+namespace msm {
+// Factories for the state types a machine definition names. A factory is given the argument written after the
+// type ("type:argument", empty without one) and returns a new state on every call, so machines never share states.
+class state_registry final {
+ public:
+  using factory_t = std::function<msm_state::ptr(std::string_view argument)>;
+
+ private:
+  std::unordered_map<std::string, factory_t> factories;
+
+ public:
+  auto add(const std::string& type, factory_t factory) -> void;  // replaces an earlier factory for type
+  auto add_callback(const std::string& type, const std::function<std::string(blackboard::ptr)>& callback,
+                    const std::unordered_set<std::string>& outcomes) -> void;  // a callback_state per use
+  auto create(const std::string& type, std::string_view argument) const -> msm_state::ptr;
+};
+
+// Declarative description of an msm_engine, built in one pass instead of through add_state() calls.
+//
+// Text form, one declaration per line, tokens separated by blanks, '#' starts a comment:
+//
+//   outcomes <final outcome>...
+//   initial <state>                                         optional, the first state by default
+//   state <name> <type>[:<argument>] [<outcome>=<target>]...
+//   timeout <milliseconds> <outcome> [<state>]              without a state, the budget of the whole run
+//
+// The binary form (compile()) also holds the compiled graph, so loading it creates the states and installs the
+// graph without parsing or validating again. It is written in native byte order for the machine that built it,
+// like snapshots, and only for the registry it was compiled with: load() refuses it if a state's type no longer
+// declares the same outcomes. States unreachable from the initial state are left out of it.
+struct machine_definition {
+  struct state_entry {
+    std::string name;
+    std::string type;
+    std::string argument;
+    std::vector<std::pair<std::string, std::string>> transitions;  // outcome, target state or final outcome
+  };
+
+  struct timeout_entry {
+    std::string state;  // empty for the budget of the whole run
+    std::chrono::nanoseconds budget;
+    std::string outcome;
+  };
+
+  std::vector<std::string> outcomes;
+  std::string initial;
+  std::vector<state_entry> states;
+  std::vector<timeout_entry> timeouts;
+
+  static auto parse(std::string_view text) -> machine_definition;  // throws std::runtime_error with the line
+
+  // A validated engine; throws if a type is not registered or the machine is malformed
+  auto build(const state_registry& registry) const -> std::shared_ptr<msm_engine>;
+  auto compile(const state_registry& registry, std::uint64_t source_hash = 0) const -> std::vector<std::byte>;
+
+  static auto load(std::span<const std::byte> binary, const state_registry& registry) -> std::shared_ptr<msm_engine>;
+  // Memory-maps path, which holds either form
+  static auto load_file(const std::string& path, const state_registry& registry) -> std::shared_ptr<msm_engine>;
+  // Loads the text form at path through a binary cache at cache_path, rewritten whenever the text changed or the
+  // cache does not load with registry
+  static auto load_cached(const std::string& path, const std::string& cache_path, const state_registry& registry)
+      -> std::shared_ptr<msm_engine>;
+};
+}  // namespace msm
@@ -2,29 +2,66 @@
 
 #include <atomic>
 #include <memory>
+#include <memory_resource>
+#include <span>
 #include <unordered_map>
 
+#include "async.hpp"
+#include "event_queue.hpp"
+#include "graph.hpp"
+#include "inplace_function.hpp"
 #include "state.hpp"
+#include "timer_wheel.hpp"
 
 namespace msm {
-class msm_engine : public msm_state {
+class recorder;
+
+class msm_engine : public async_state {
  public:
   using start_callback_t = std::function<void(blackboard::ptr, const std::string&, const std::vector<std::string>&)>;
   using end_callback_t = std::function<void(blackboard::ptr, const std::string&, const std::vector<std::string>&)>;
   using transition_callback_t = std::function<void(blackboard::ptr, const std::string&, const std::string&,
                                                    const std::string&, const std::vector<std::string>&)>;
+  // transition callback that also receives the blackboard keys written while the state ran
+  using delta_transition_callback_t =
+      std::function<void(blackboard::ptr, const std::string&, const std::string&, const std::string&,
+                         const std::vector<std::string>&, const std::vector<std::string>&)>;
+
+  // What a hook is told about a start, transition or end. Names are views into the compiled graph, local to the
+  // engine the hook was added to; outcome_id indexes graph, which for a nested engine is its outermost parent's.
+  struct hook_event {
+    const compiled_graph& graph;
+    std::string_view from;            // source state, transitions only
+    std::string_view to;              // initial state of a start, target state of a transition
+    std::string_view outcome;         // empty for a start
+    compiled_graph::id_t outcome_id;  // npos for a start
+  };
+
+  // Allocation-free alternative to the callbacks above: stored inline rather than in a std::function, and what it
+  // captures is its pre-bound argument payload, typed, instead of a vector of strings
+  using hook_t = inplace_function<void(const blackboard::ptr&, const hook_event&)>;
+
+  struct event_stats {
+    std::uint64_t posted;      // events accepted by post()
+    std::uint64_t dropped;     // events refused by post() because the queue was full
+    std::uint64_t dispatched;  // events that caused a transition
+    std::uint64_t ignored;     // events with no transition from the state they reached
+    std::uint64_t batches;     // process_events() calls that found at least one event
+  };
 
  private:
   // State Map
-  std::unordered_map<std::string, msm_state::ptr> states;
+  compiled_graph::state_table states;
 
   // Transition Map
-  std::unordered_map<std::string, std::unordered_map<std::string, std::string>> transitions;
+  compiled_graph::transition_tables transitions;
 
   std::string initial_state;
-  std::string current_state;
 
-  std::unique_ptr<std::mutex> current_state_mtx;
+  compiled_graph::ptr graph;                         // frozen form of states/transitions, rebuilt by validate()
+  std::atomic<compiled_graph::id_t> current_state;  // id into graph, compiled_graph::npos when idle
+  std::atomic<compiled_graph::id_t> resume_state{compiled_graph::npos};  // set by restore(), used by the next run
+  compiled_graph::ptr resume_graph;  // graph resume_state is an id of, stored before it
   std::atomic<bool> is_valid;
 
   std::vector<std::pair<start_callback_t, std::vector<std::string>>>
@@ -33,9 +70,91 @@ class msm_engine : public msm_state {
       end_callbacks;  // executed after the state machine ends
   std::vector<std::pair<transition_callback_t, std::vector<std::string>>>
       transition_callbacks;  // executed on every state transition
+  std::vector<std::pair<delta_transition_callback_t, std::vector<std::string>>>
+      delta_transition_callbacks;  // executed on every state transition, with the keys the state wrote
+
+  std::vector<hook_t> start_hooks;
+  std::vector<hook_t> transition_hooks;
+  std::vector<hook_t> end_hooks;
+
+  // Event-driven mode, see start_events(). The queue is created once and never replaced, so a producer that loaded
+  // event_queue can keep using it; the consumer publishes it after the first start_events() is set up.
+  std::unique_ptr<mpsc_queue<compiled_graph::id_t>> event_storage;
+  std::atomic<mpsc_queue<compiled_graph::id_t>*> event_queue{nullptr};
+  std::atomic<std::uint64_t> events_posted_base{0};  // queue counters at the last start_events()
+  std::atomic<std::uint64_t> events_dropped_base{0};
+  blackboard::ptr event_bb;
+  std::atomic<std::uint64_t> events_dispatched{0};  // written by the consumer thread only
+  std::atomic<std::uint64_t> events_ignored{0};
+  std::atomic<std::uint64_t> event_batches{0};
+
+  std::shared_ptr<recorder> run_recorder;  // see set_recorder()
+
+  // Time budgets, see set_timeout()
+  compiled_graph::timeout_map state_timeouts;
+  std::chrono::nanoseconds run_budget{0};
+  std::string run_timeout_outcome;
+
+  // Cancels a state when deadline passes, on timer_wheel::shared(); does nothing for clock::time_point::max()
+  class deadline_timer final {
+   private:
+    msm_state* state;
+    clock::time_point deadline;
+    timer_wheel::timer_id id = 0;
+    std::atomic<bool> fired{false};
+
+   public:
+    deadline_timer(msm_state* state_, clock::time_point deadline_);
+    deadline_timer(const deadline_timer&) = delete;
+    ~deadline_timer() { disarm(); }
+
+    auto disarm() -> void;
+    auto expired() -> bool;  // disarms, true if the deadline passed before the state returned
+  };
+
+  auto run_deadline() const -> clock::time_point;  // this run's budget, or the deadline of a parent running it
+  static auto deadline_of(const compiled_graph& graph, compiled_graph::id_t state, clock::time_point run_deadline)
+      -> clock::time_point;
+  // Ends a run whose budget ran out in state current: returns the timeout outcome after the end callbacks, or
+  // throws if the engine has none (the deadline was inherited)
+  auto time_out(const compiled_graph& graph, const blackboard::ptr& bb, compiled_graph::id_t current)
+      -> std::string;
+
+  // Whether a run needs the blackboard version before each state: some engine of the graph has delta transition
+  // callbacks, or log records blackboard writes. Decided once per run, not per step.
+  static auto tracks_writes(const compiled_graph& graph, const recorder* log = nullptr) -> bool;
+  static auto written_since(bool tracked, const blackboard::ptr& bb) -> std::optional<std::uint64_t> {
+    return tracked ? std::make_optional(bb->get_version()) : std::nullopt;
+  }
+
+  // Runs the callbacks of steps [first, last) of the graph, each on the engine of its scope
+  static auto run_steps(const compiled_graph& graph, const blackboard::ptr& bb, std::size_t first, std::size_t last,
+                        std::optional<std::uint64_t> since) -> void;
+
+  static auto invoke_hooks(const std::vector<hook_t>& hooks, const blackboard::ptr& bb, const hook_event& event,
+                           const char* kind) -> void;
+
+  // Takes the state restore() left for the next run, as an id into graph (which validate() may have rebuilt since),
+  // or compiled_graph::npos if there is none
+  auto take_resume_state(const compiled_graph& graph) -> compiled_graph::id_t;
+
+  auto subgraphs_changed() -> bool;  // validates nested engines, true if one was recompiled since graph was built
+
+  // Resolves the outcome a state returned, records it to log if there is one and runs the callbacks for the step.
+  // Returns the next state id, or compiled_graph::terminal() of the final outcome.
+  auto advance(const blackboard::ptr& bb, compiled_graph::id_t current, const std::string& result,
+               std::optional<std::uint64_t> since, recorder* log) -> compiled_graph::id_t;
+
+  friend class msm_batch;  // steps instances through the same graph and callbacks
+  friend class replayer;   // steps through a recorded run without executing the states
+  friend struct machine_definition;  // fills the maps in bulk, or installs a precompiled graph
 
  public:
+  // The state and transition maps are allocated from the allocator's resource, see machine_arena
+  using allocator_type = std::pmr::polymorphic_allocator<>;
+
   msm_engine(const std::unordered_set<std::string>& outcomes);
+  msm_engine(const std::unordered_set<std::string>& outcomes, const allocator_type& allocator);
   msm_engine() = delete;
   ~msm_engine() override = default;
 
@@ -43,26 +162,79 @@ class msm_engine : public msm_state {
                  const std::unordered_map<std::string, std::string>& transitions = {}) -> void;
   auto set_initial_state(const std::string& name) -> void;
   auto get_initial_state() const -> std::string;
-  auto get_current_state() const -> std::string;
-  auto get_states() const -> const std::unordered_map<std::string, msm_state::ptr>&;
+  auto get_current_state() const -> std::string;  // full path, "outer/inner" inside a nested engine
+  auto get_states() const -> std::unordered_map<std::string, msm_state::ptr>;  // copies, see get_state_table()
   auto get_transitions(const std::string& state) const
-      -> const std::unordered_map<std::string, std::unordered_map<std::string, std::string>>&;
+      -> std::unordered_map<std::string, std::unordered_map<std::string, std::string>>;
+  auto get_state_table() const noexcept -> const compiled_graph::state_table&;  // the engine's own tables
+  auto get_transition_tables() const noexcept -> const compiled_graph::transition_tables&;
+  auto get_graph() const noexcept -> compiled_graph::ptr;  // nullptr until validate() succeeds
+
+  // Records every run that execute() or execute_async() starts from the initial state, see recorder; nullptr
+  // stops recording. Set it between runs, not during one.
+  auto set_recorder(std::shared_ptr<recorder> log) -> void;
+  auto get_recorder() const noexcept -> const std::shared_ptr<recorder>&;
+
+  // Time budgets for execute() and execute_async(), enforced by timer_wheel::shared() rather than a thread per
+  // run. A state that overruns its budget is cancelled, and once it returns (or throws) the run continues with
+  // outcome, one of the state's outcomes, as if the state had returned it. A run that overruns the engine's
+  // budget cancels the current state and ends with outcome, a final outcome of the engine. States see their
+  // deadline through get_deadline(); nested engines and parallel_state branches inherit it, and a nested engine
+  // with a budget is run as a single state instead of being flattened. A zero budget removes the timeout.
+  auto set_state_timeout(const std::string& state, std::chrono::nanoseconds budget, const std::string& outcome)
+      -> void;
+  auto set_timeout(std::chrono::nanoseconds budget, const std::string& outcome) -> void;
+  auto get_timeout() const noexcept -> std::chrono::nanoseconds;
 
   auto add_start_callback(start_callback_t callback, const std::vector<std::string>& args = {}) -> void;
   auto add_end_callback(end_callback_t callback, const std::vector<std::string>& args = {}) -> void;
   auto add_transition_callback(transition_callback_t callback, const std::vector<std::string>& args = {}) -> void;
+  auto add_transition_callback(delta_transition_callback_t callback, const std::vector<std::string>& args = {})
+      -> void;
+
+  auto add_start_hook(hook_t hook) -> void;
+  auto add_transition_hook(hook_t hook) -> void;
+  auto add_end_hook(hook_t hook) -> void;
 
   auto invoke_start_callbacks(blackboard::ptr bb, const std::string& initial_state) -> void;
   auto invoke_end_callbacks(blackboard::ptr bb, const std::string& outcome) -> void;  // outcome is the final outcome
+  // outcome is what triggered the transition. since is the blackboard version from before the state ran, which
+  // delta transition callbacks need to be told the keys it wrote (they get none without it).
   auto invoke_transition_callbacks(blackboard::ptr bb, const std::string& from_state, const std::string& to_state,
-                                   const std::string& outcome) -> void;  // outcome is what triggered the transition
+                                   const std::string& outcome, std::optional<std::uint64_t> since = std::nullopt)
+      -> void;
+  auto has_delta_transition_callbacks() const noexcept -> bool;
 
+  // Compiles the transition table. Nested engines are validated first and flattened into this engine's graph, so
+  // running them costs the same as running their states directly (see compiled_graph).
   auto validate(bool forced = false) -> void;
 
   using msm_state::execute;       // brings the base class execute method into scope to avoid hiding it
   auto execute() -> std::string;  // overloaded execute method in derived class, execute with default blackboard
   auto execute(blackboard::ptr bb) -> std::string override;  // execute method with blackboard parameter
 
+  // Same run as execute(bb) as a coroutine: async states (and nested engines) are awaited instead of blocking, so
+  // many engines can share the threads of an event_loop.
+  auto execute_async(blackboard::ptr bb) -> task<std::string> override;
+
+  // Checkpoint of the running position: the current state, and if that is a nested engine its current state, and
+  // so on. restore() makes the next execute() continue from that position without running the start callbacks;
+  // the data lives in the blackboard, which has its own snapshot()/restore().
+  auto snapshot() const -> std::vector<std::byte>;
+  auto restore(std::span<const std::byte> bytes) -> void;
+
+  // Event-driven mode: states are not executed. Each posted event is an outcome id that is applied to the current
+  // state through the transition table, running the same callbacks as execute(). Producers call post() from any
+  // thread (wait-free); one consumer thread calls process_events() and start_events(). Calling start_events() again
+  // restarts from the initial state on the same queue, dropping events still queued; it throws std::logic_error if
+  // asked for more capacity than the queue has. Do not mix with execute() on the same engine.
+  auto start_events(blackboard::ptr bb, std::size_t capacity = 1024) -> void;
+  auto event_id(const std::string& outcome) const -> compiled_graph::id_t;  // npos if the graph has no such outcome
+  auto post(compiled_graph::id_t event) noexcept -> bool;                    // false if the queue is full
+  auto post(const std::string& outcome) -> bool;
+  auto process_events(std::size_t max_batch = 64) -> std::size_t;  // returns the number of events consumed
+  auto get_event_stats() const noexcept -> event_stats;
+
   using msm_state::operator();       // brings the base class operator() into scope to avoid hiding it
   auto operator()() -> std::string;  // overloaded operator() in derived class
 
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+
+namespace msm {
+// Bounded multi-producer / single-consumer queue. try_push() is wait-free: a producer claims capacity with one
+// fetch_add, takes a ticket with another and publishes its cell, without ever retrying. When the queue is full
+// the push fails instead of waiting.
+template <typename T>
+class mpsc_queue final {
+  static_assert(std::is_trivially_copyable_v<T>, "mpsc_queue stores values by plain copy");
+
+ private:
+  struct cell {
+    std::atomic<bool> full{false};
+    T value;
+  };
+
+  std::unique_ptr<cell[]> cells;
+  std::size_t capacity;
+  std::size_t mask;
+
+  alignas(64) std::atomic<std::size_t> reserved{0};  // claimed capacity, released by the consumer
+  alignas(64) std::atomic<std::size_t> tail{0};      // next ticket, also the number of accepted pushes
+  alignas(64) std::atomic<std::size_t> rejected{0};  // pushes that found the queue full
+  alignas(64) std::size_t head = 0;                  // consumer only
+
+  static auto round_up(std::size_t n) noexcept -> std::size_t {
+    auto power = std::size_t{1};
+    while (power < n) power <<= 1;
+    return power;
+  }
+
+ public:
+  explicit mpsc_queue(std::size_t capacity_)
+      : cells{std::make_unique<cell[]>(round_up(capacity_))}, capacity{round_up(capacity_)}, mask{capacity - 1} {}
+  mpsc_queue(const mpsc_queue&) = delete;
+
+  auto try_push(const T& value) noexcept -> bool {
+    if (reserved.fetch_add(1, std::memory_order_acquire) >= capacity) {
+      reserved.fetch_sub(1, std::memory_order_relaxed);
+      rejected.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    // at most `capacity` tickets are outstanding, so the cell was already released by the consumer
+    auto& target = cells[tail.fetch_add(1, std::memory_order_relaxed) & mask];
+    target.value = value;
+    target.full.store(true, std::memory_order_release);
+    return true;
+  }
+
+  // Hands up to max_count values to sink(value) in FIFO order, returns how many were consumed
+  template <typename Sink>
+  auto consume(std::size_t max_count, Sink&& sink) -> std::size_t {
+    auto count = std::size_t{0};
+    while (count < max_count) {
+      auto& source = cells[head & mask];
+      if (!source.full.load(std::memory_order_acquire)) break;  // empty, or the producer has not published yet
+
+      sink(source.value);
+      source.full.store(false, std::memory_order_relaxed);
+      ++head;
+      ++count;
+      reserved.fetch_sub(1, std::memory_order_release);
+    }
+    return count;
+  }
+
+  auto pushed() const noexcept -> std::size_t { return tail.load(std::memory_order_relaxed); }
+  auto dropped() const noexcept -> std::size_t { return rejected.load(std::memory_order_relaxed); }
+  auto get_capacity() const noexcept -> std::size_t { return capacity; }
+};
+}  // namespace msm
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace msm {
+// Interface for running tasks submitted by states (e.g. parallel_state branches)
+class executor {
+ public:
+  using ptr = std::shared_ptr<executor>;
+  using task = std::function<void()>;
+
+  virtual ~executor() = default;
+
+  virtual auto submit(task work) -> void = 0;
+  virtual auto concurrency() const noexcept -> std::size_t = 0;
+
+  // Runs one pending task on the calling thread, if any. Threads that block on work they submitted call this
+  // while waiting, so nested parallel states cannot starve the pool.
+  virtual auto try_run_one() -> bool { return false; }
+};
+
+// Fixed-size pool with one task deque per worker. Workers pop their own deque LIFO and steal FIFO from the
+// others when it runs dry; tasks submitted from a worker go to that worker's deque.
+class thread_pool_executor final : public executor {
+ private:
+  struct worker_queue {
+    std::mutex mtx;
+    std::deque<task> tasks;
+  };
+
+  std::vector<std::unique_ptr<worker_queue>> queues;
+  std::vector<std::thread> workers;
+
+  std::mutex sleep_mtx;
+  std::condition_variable wake;
+  std::atomic<std::size_t> pending{0};  // tasks queued but not yet taken
+  std::atomic<std::size_t> next_queue{0};
+  std::atomic<bool> stopping{false};
+
+  auto worker_index() const noexcept -> std::size_t;  // index of the calling worker, or queues.size()
+  auto pop_own(std::size_t index) -> task;
+  auto steal(std::size_t thief) -> task;
+  auto take(std::size_t index) -> task;
+  auto run(std::size_t index) -> void;
+
+ public:
+  explicit thread_pool_executor(std::size_t threads = std::thread::hardware_concurrency());
+  thread_pool_executor(const thread_pool_executor&) = delete;
+  ~thread_pool_executor() override;  // runs the tasks still queued, then joins the workers
+
+  auto submit(task work) -> void override;
+  auto concurrency() const noexcept -> std::size_t override;
+  auto try_run_one() -> bool override;
+
+  static auto shared() -> executor::ptr;  // process-wide pool used when no executor is given
+};
+}  // namespace msm
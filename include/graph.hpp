@@ -0,0 +1,192 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "arena.hpp"
+#include "snapshot.hpp"
+#include "state.hpp"
+
+namespace msm {
+class msm_engine;
+
+// Frozen, integer-indexed form of an msm_engine transition table. Built once by msm_engine::validate() so that
+// the execution loop only deals with small integer ids; names are kept around for callbacks and to_string().
+//
+// Each state owns a contiguous run of edges (one per outcome it can return), laid out as a flat array indexed by
+// [edge_begin(state) + local outcome index]. An edge target is either a state id (>= 0), a terminal outcome of
+// the engine (encoded by terminal()) or unmapped.
+//
+// Nested engines (states that are exactly an msm_engine, not a subclass) are flattened: their compiled graph is
+// copied in with states named "outer/inner", so the execution loop never recurses into them. Each nested engine
+// becomes a scope, and the callbacks a transition runs (end callbacks of the scopes it leaves, transition callbacks,
+// start callbacks of the scopes it enters) are precomputed as a list of steps per edge.
+class compiled_graph final {
+ public:
+  using ptr = std::shared_ptr<const compiled_graph>;
+  using id_t = std::int32_t;
+
+  static constexpr id_t npos = -1;
+  static constexpr id_t unmapped = -1;
+
+  static constexpr auto terminal(id_t outcome) noexcept -> id_t { return -2 - outcome; }
+  static constexpr auto is_terminal(id_t target) noexcept -> bool { return target <= -2; }
+  static constexpr auto terminal_outcome(id_t target) noexcept -> id_t { return -2 - target; }
+
+  // A callback invocation on the engine of a scope. Names are label ids (state names local to their engine).
+  struct step {
+    enum class kind : std::uint8_t {
+      start,       // start callbacks, `to` is the initial state
+      transition,  // transition callbacks from `from` to `to` on `outcome`
+      end          // end callbacks with the final `outcome`
+    };
+
+    kind type;
+    id_t scope;
+    id_t from;
+    id_t to;
+    id_t outcome;
+  };
+
+  // Scope 0 is the engine that owns the graph, the others are nested engines
+  struct scope {
+    msm_engine* engine;
+    id_t parent;    // npos for scope 0
+    id_t label;     // name of the nested engine in its parent, npos for scope 0
+    ptr source;     // graph of the nested engine this scope was copied from
+  };
+
+  // Time budget of a state: once it is used up the state is cancelled and the engine continues with outcome
+  struct timeout {
+    std::chrono::nanoseconds budget{0};  // zero for none
+    id_t outcome = npos;
+  };
+  using timeout_map =
+      std::unordered_map<std::string, std::pair<std::chrono::nanoseconds, std::string>, string_hash, string_equal>;
+
+  // An engine's states and transitions, allocated from the engine's memory resource
+  using state_table = std::pmr::unordered_map<std::pmr::string, msm_state::ptr, string_hash, string_equal>;
+  using transition_table = std::pmr::unordered_map<std::pmr::string, std::pmr::string, string_hash, string_equal>;
+  using transition_tables = std::pmr::unordered_map<std::pmr::string, transition_table, string_hash, string_equal>;
+
+ private:
+  std::vector<std::string> state_names;  // qualified, "outer/inner" for states of nested engines
+  std::vector<id_t> state_labels;        // name local to the engine the state was added to
+  std::vector<id_t> state_scopes;
+  std::vector<msm_state::ptr> state_ptrs;
+  std::vector<bool> async_states;          // state is an async_state, nested engines included
+  std::vector<timeout> state_timeouts;
+  std::vector<std::string> outcome_names;  // every outcome name seen in the graph, engine outcomes included
+
+  std::vector<std::size_t> edge_offsets;  // state -> first edge, size is state_count() + 1
+  std::vector<id_t> edge_outcomes;        // edge -> outcome id
+  std::vector<id_t> edge_targets;         // edge -> state id, terminal(outcome) or unmapped
+  std::vector<std::size_t> step_offsets;  // edge -> first step, size is the edge count + 1
+
+  std::vector<std::string> labels;
+  std::vector<scope> scopes;
+  std::vector<step> steps;
+  std::size_t entry_first = 0;  // steps run when the engine starts, from its start callbacks inwards
+  std::size_t entry_last = 0;
+
+  // Analysis of the graph, see compile()
+  std::vector<std::string> pruned;       // names of the states unreachable from the initial state
+  std::vector<id_t> traps;               // states that cannot reach any final outcome
+  std::size_t outcome_words = 0;         // words per state in reachable
+  std::vector<std::uint64_t> reachable;  // state -> bitset of the final outcomes it can end in
+
+  std::vector<std::uint32_t> state_trace_ids;    // tracer::intern() of the names, empty unless tracing is enabled
+  std::vector<std::uint32_t> outcome_trace_ids;
+
+  id_t initial = npos;
+  std::uint64_t hash = 0;  // see fingerprint()
+
+  compiled_graph() = default;
+
+  auto reorder() -> void;  // drops unreachable states, numbers the rest breadth-first
+  auto analyze(std::size_t final_count, bool strict) -> void;  // fills traps and reachable
+
+ public:
+  // Throws std::runtime_error if the graph is malformed. Unmapped outcomes are tolerated unless strict is set.
+  // Nested engines must have been validated; owner is the engine whose callbacks scope 0 runs. timeouts maps
+  // state names to their budget and timeout outcome; a nested engine with a timeout is kept as a single state.
+  //
+  // States unreachable from the initial state are pruned (see unreachable_states()), and the rest are numbered in
+  // breadth-first order so that a state's successors sit next to it. Every state gets the set of final outcomes
+  // it can end in; states with none (cycles without a way out) are reported by trap_states(), and are an error
+  // when strict is set. All of it is linear in the size of the graph.
+  static auto compile(const state_table& states, const transition_tables& transitions,
+                      const std::string& initial_state, const msm_state::outcome_set& final_outcomes,
+                      bool strict, msm_engine* owner, const timeout_map& timeouts = {}) -> ptr;
+
+  // Binary form of the graph, in native byte order, for precompiled machine definitions. The states are not part of
+  // it: load() takes them in state id order and checks that each still declares the outcomes its edges were
+  // compiled from. A graph with nested engines flattened into it cannot be saved, its scopes are engine pointers.
+  auto save(std::vector<std::byte>& out) const -> void;
+  auto savable() const noexcept -> bool { return scopes.size() == 1; }  // save() would not throw
+  static auto load(snapshot_reader& in, std::vector<msm_state::ptr> states, msm_engine* owner) -> ptr;
+
+  auto state_count() const noexcept -> std::size_t { return state_names.size(); }
+  auto outcome_count() const noexcept -> std::size_t { return outcome_names.size(); }
+  auto initial_state() const noexcept -> id_t { return initial; }
+
+  auto state_name(id_t state) const noexcept -> const std::string& { return state_names[state]; }
+  auto outcome_name(id_t outcome) const noexcept -> const std::string& { return outcome_names[outcome]; }
+  auto state(id_t state) const noexcept -> msm_state* { return state_ptrs[state].get(); }
+  auto is_async(id_t state) const noexcept -> bool { return async_states[state]; }
+  auto state_timeout(id_t state) const noexcept -> const timeout& { return state_timeouts[state]; }
+  auto state_label(id_t state) const noexcept -> const std::string& { return labels[state_labels[state]]; }
+  auto state_scope(id_t state) const noexcept -> id_t { return state_scopes[state]; }
+  auto state_trace_id(id_t state) const noexcept -> std::uint32_t { return state_trace_ids[state]; }
+  auto outcome_trace_id(id_t outcome) const noexcept -> std::uint32_t { return outcome_trace_ids[outcome]; }
+
+  auto edge_begin(id_t state) const noexcept -> std::size_t { return edge_offsets[state]; }
+  auto edge_end(id_t state) const noexcept -> std::size_t { return edge_offsets[state + 1]; }
+  auto edge_outcome(std::size_t edge) const noexcept -> id_t { return edge_outcomes[edge]; }
+  auto edge_target(std::size_t edge) const noexcept -> id_t { return edge_targets[edge]; }
+
+  auto scope_count() const noexcept -> std::size_t { return scopes.size(); }
+  auto get_scope(id_t scope) const noexcept -> const compiled_graph::scope& { return scopes[scope]; }
+  auto label(id_t label) const noexcept -> const std::string& { return labels[label]; }
+
+  // Steps of a transition along an edge, and of starting the engine
+  auto step_begin(std::size_t edge) const noexcept -> std::size_t { return step_offsets[edge]; }
+  auto step_end(std::size_t edge) const noexcept -> std::size_t { return step_offsets[edge + 1]; }
+  auto entry_begin() const noexcept -> std::size_t { return entry_first; }
+  auto entry_end() const noexcept -> std::size_t { return entry_last; }
+  auto get_step(std::size_t index) const noexcept -> const step& { return steps[index]; }
+
+  // Linear scan over the handful of outcomes a state declares: no hashing, no allocation.
+  auto find_edge(id_t state, const std::string& outcome) const noexcept -> id_t {
+    for (auto e = edge_offsets[state]; e < edge_offsets[state + 1]; ++e) {
+      if (outcome_names[edge_outcomes[e]] == outcome) return static_cast<id_t>(e);
+    }
+    return npos;
+  }
+
+  // Slow-path lookups by name, meant for setup code rather than the execution loop.
+  auto find_state(const std::string& name) const noexcept -> id_t;
+  auto find_outcome(const std::string& name) const noexcept -> id_t;
+  auto state_path(id_t state) const -> std::vector<std::string>;  // labels from the outermost engine inwards
+
+  // Hash of the state and outcome names and the edges between them: equal for graphs compiled from the same
+  // transition tables, so a recording can tell whether it is being replayed on the machine it came from
+  auto fingerprint() const noexcept -> std::uint64_t { return hash; }
+
+  auto unreachable_states() const noexcept -> const std::vector<std::string>& { return pruned; }
+  auto trap_states() const noexcept -> const std::vector<id_t>& { return traps; }
+
+  // Whether a run from state can end in the final outcome (a terminal_outcome() id); false for other outcomes
+  auto can_reach(id_t state, id_t outcome) const noexcept -> bool {
+    auto word = static_cast<std::size_t>(outcome) / 64;
+    return outcome >= 0 && word < outcome_words &&
+           (reachable[state * outcome_words + word] >> (static_cast<std::size_t>(outcome) % 64) & 1) != 0;
+  }
+};
+}  // namespace msm
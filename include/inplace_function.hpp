@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace msm {
+// std::function without the heap: the callable is stored in a fixed buffer inside the object, and one that does
+// not fit is a compile error rather than an allocation. Copying and moving copy or move the callable in place.
+template <typename Signature, std::size_t Capacity = 48>
+class inplace_function;
+
+template <typename R, typename... Args, std::size_t Capacity>
+class inplace_function<R(Args...), Capacity> final {
+ private:
+  struct operations {
+    R (*invoke)(void* storage, Args&&... args);
+    void (*copy)(void* to, const void* from);
+    void (*move)(void* to, void* from) noexcept;  // move-constructs into to, then destroys from
+    void (*destroy)(void* storage) noexcept;
+  };
+
+  template <typename F>
+  static constexpr auto operations_of = operations{
+      [](void* storage, Args&&... args) -> R { return (*static_cast<F*>(storage))(std::forward<Args>(args)...); },
+      [](void* to, const void* from) -> void { ::new (to) F(*static_cast<const F*>(from)); },
+      [](void* to, void* from) noexcept -> void {
+        ::new (to) F(std::move(*static_cast<F*>(from)));
+        static_cast<F*>(from)->~F();
+      },
+      [](void* storage) noexcept -> void { static_cast<F*>(storage)->~F(); }};
+
+  alignas(std::max_align_t) mutable std::byte storage[Capacity];
+  const operations* ops = nullptr;
+
+ public:
+  inplace_function() noexcept = default;
+  inplace_function(std::nullptr_t) noexcept {}
+
+  template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, inplace_function> &&
+                                                    std::is_invocable_r_v<R, std::decay_t<F>&, Args...>>>
+  inplace_function(F&& callable) {
+    using stored = std::decay_t<F>;
+    static_assert(sizeof(stored) <= Capacity, "callable does not fit in the inplace_function, raise its capacity");
+    static_assert(alignof(stored) <= alignof(std::max_align_t), "callable is over-aligned");
+    static_assert(std::is_copy_constructible_v<stored> && std::is_nothrow_move_constructible_v<stored>);
+
+    ::new (static_cast<void*>(storage)) stored(std::forward<F>(callable));
+    ops = &operations_of<stored>;
+  }
+
+  inplace_function(const inplace_function& other) : ops{other.ops} {
+    if (ops) ops->copy(storage, other.storage);
+  }
+
+  inplace_function(inplace_function&& other) noexcept : ops{other.ops} {
+    if (ops) ops->move(storage, other.storage);
+    other.ops = nullptr;
+  }
+
+  ~inplace_function() {
+    if (ops) ops->destroy(storage);
+  }
+
+  auto operator=(const inplace_function& other) -> inplace_function& {
+    if (this != &other) {
+      auto copy = other;
+      *this = std::move(copy);
+    }
+    return *this;
+  }
+
+  auto operator=(inplace_function&& other) noexcept -> inplace_function& {
+    if (this != &other) {
+      if (ops) ops->destroy(storage);
+      ops = other.ops;
+      if (ops) ops->move(storage, other.storage);
+      other.ops = nullptr;
+    }
+    return *this;
+  }
+
+  explicit operator bool() const noexcept { return ops != nullptr; }
+
+  auto operator()(Args... args) const -> R { return ops->invoke(storage, std::forward<Args>(args)...); }
+};
+}  // namespace msm
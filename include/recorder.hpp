@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "engine.hpp"
+
+namespace msm {
+struct recorder_options {
+  std::size_t buffer_size = std::size_t{1} << 20;  // bytes of ring buffer, rounded up to a power of two
+  bool blackboard_writes = true;  // record the values each state wrote, which needs a codec for every type
+  std::chrono::milliseconds flush_interval{50};  // longest a record waits for the file while the ring is quiet
+};
+
+// Appends what an msm_engine run does to a compact binary log: the outcome of every state, and the blackboard
+// writes it made as a delta snapshot. The engine thread copies each record into a ring buffer (a transition costs
+// 9 bytes and no lock); a background thread writes the ring to the file, and the engine only waits if the ring is
+// full. Attach with msm_engine::set_recorder(); one engine thread writes to a recorder at a time.
+//
+// A recorded step costs a few nanoseconds on the engine thread: one store into the ring, plus a blackboard version
+// read when writes are recorded and a delta snapshot after states that wrote something. On a chain of states that
+// do nothing (engine/recorded_chain against engine/chain) that is within a few percent. The flusher wakes once per
+// half ring, or after flush_interval; a process with a flusher also pays for atomic shared_ptr counts, which a
+// single-threaded one does not, so compare against a baseline that has started a thread too.
+//
+// Log layout: magic and version, then records of a one-byte kind: run begin (graph fingerprint, blackboard
+// snapshot), step (state id, outcome id), writes (delta snapshot) and run end (final outcome id, npos if the run
+// threw). A log cut short by a crash ends in the middle of a run; replayer reads it up to there.
+class recorder final {
+ private:
+  std::ofstream out;
+  std::vector<std::byte> ring;
+  std::size_t mask;
+  recorder_options options;
+
+  alignas(64) std::atomic<std::size_t> tail{0};  // bytes appended, engine thread only
+  std::size_t limit = 0;                          // engine thread: tail may grow to here without reading head
+  alignas(64) std::atomic<std::size_t> head{0};  // bytes written to the file, flusher thread only
+  alignas(64) std::atomic<std::uint64_t> waits{0};
+  std::atomic<std::uint64_t> unrecorded{0};  // blackboard snapshots that failed for a value without a codec
+
+  std::mutex mtx;
+  std::condition_variable wake;
+  std::condition_variable flushed;
+  std::size_t written = 0;  // head as of the last file flush
+  bool flush_requested = false;
+  bool stopping = false;
+  std::thread flusher;
+
+  auto append(const void* data, std::size_t size) noexcept -> void {
+    auto t = this->tail.load(std::memory_order_relaxed);
+    if (t + size <= this->limit && (t & this->mask) + size <= this->ring.size()) {
+      std::memcpy(this->ring.data() + (t & this->mask), data, size);
+      this->tail.store(t + size, std::memory_order_release);
+      return;
+    }
+    this->append_slow(data, size);
+  }
+  auto append_slow(const void* data, std::size_t size) noexcept -> void;  // refreshes limit, waits while full
+  auto drain() -> std::size_t;  // writes the ring to the file, returns the new head
+  auto run() -> void;
+
+ public:
+  enum class kind : std::uint8_t { run_begin = 1, step, writes, run_end };
+
+  explicit recorder(const std::string& path, recorder_options options_ = {});
+  recorder(const recorder&) = delete;
+  ~recorder();  // flushes what is left and closes the file
+
+  // Called by the engine
+  auto begin_run(const compiled_graph& graph, const blackboard& bb) -> void;
+  auto record_step(compiled_graph::id_t state, compiled_graph::id_t outcome) noexcept -> void {
+    constexpr auto size = 1 + 2 * sizeof(compiled_graph::id_t);
+    auto t = this->tail.load(std::memory_order_relaxed);
+    if (t + size <= this->limit && (t & this->mask) + size <= this->ring.size()) {
+      // written straight into the ring: a record assembled on the stack would be read back across three stores
+      auto* out = this->ring.data() + (t & this->mask);
+      out[0] = static_cast<std::byte>(kind::step);
+      std::memcpy(out + 1, &state, sizeof(state));
+      std::memcpy(out + 1 + sizeof(state), &outcome, sizeof(outcome));
+      this->tail.store(t + size, std::memory_order_release);
+      return;
+    }
+
+    std::byte record[size];
+    record[0] = static_cast<std::byte>(kind::step);
+    std::memcpy(record + 1, &state, sizeof(state));
+    std::memcpy(record + 1 + sizeof(state), &outcome, sizeof(outcome));
+    append_slow(record, size);
+  }
+  auto record_writes(const blackboard& bb, std::uint64_t since) -> void;  // nothing if bb is still at since
+  auto end_run(compiled_graph::id_t outcome) noexcept -> void;
+  auto records_blackboard() const noexcept -> bool { return options.blackboard_writes; }
+
+  auto flush() -> void;  // returns once everything recorded so far is in the file
+  auto full_waits() const noexcept -> std::uint64_t { return waits.load(); }  // times the engine found the ring full
+  auto missing_snapshots() const noexcept -> std::uint64_t { return unrecorded.load(); }
+};
+
+// Re-runs recorded runs on an engine built like the recorded one. States are not executed: each step substitutes
+// the outcome the state returned and applies the blackboard writes it made, so the transition, start and end
+// callbacks and hooks see the same sequence and the same data as during the recording, nondeterministic states
+// (parallel_state joins, timers, I/O) included.
+class replayer final {
+ private:
+  std::unique_ptr<mapped_file> file;
+  std::size_t length = 0;         // up to the end of the last complete record
+  std::vector<std::size_t> runs;  // offset of each run begin record
+
+ public:
+  explicit replayer(const std::string& path);
+
+  auto run_count() const noexcept -> std::size_t { return runs.size(); }
+
+  // Replays run index on engine with bb, restored to the blackboard the run started with if it was recorded.
+  // Returns the final outcome, or std::nullopt if the recording stops before the run ended (it threw, or the
+  // process died). Throws std::runtime_error if engine's graph is not the recorded one or the run diverges.
+  auto replay(msm_engine& engine, const blackboard::ptr& bb, std::size_t index = 0) const
+      -> std::optional<std::string>;
+};
+}  // namespace msm
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "engine.hpp"
+
+namespace msm {
+struct runtime_stats {
+  std::uint64_t runs;    // execute() calls completed
+  std::uint64_t steals;  // instances a worker took from another shard's run queue
+};
+
+// Runs msm_engine instances on a fixed set of worker threads, one per shard, each pinned to a core when possible.
+// An engine is homed on a shard by its address, and its runs are queued on the engine itself: the engine is put
+// on its shard's run queue once, and the worker that takes it runs its queued runs back to back, so one engine is
+// only ever executed by one worker at a time and never needs a lock of its own. Idle workers steal engines from
+// the other shards' queues, which moves load off a busy core without splitting an engine's runs across threads.
+//
+// Distinct engines run in parallel; submit a copy of a machine per concurrent instance (machine_definition builds
+// them cheaply). The states of one engine must not be shared with another engine running on the same runtime.
+class sharded_runtime final {
+ public:
+  using completion_t = std::function<void(std::optional<std::string>, std::exception_ptr)>;
+
+ private:
+  struct run {
+    blackboard::ptr bb;
+    completion_t on_done;
+  };
+
+  // An engine with queued runs; runs and scheduled are guarded by its home shard's mutex
+  struct instance {
+    std::shared_ptr<msm_engine> engine;
+    std::deque<run> runs;
+    bool scheduled = false;  // on a run queue or being run by a worker
+  };
+
+  struct alignas(64) shard {
+    std::mutex mtx;
+    std::unordered_map<const msm_engine*, std::shared_ptr<instance>> instances;  // homed here with runs pending
+    std::deque<std::shared_ptr<instance>> queue;                                 // instances ready to run
+    std::atomic<std::uint64_t> runs{0};
+    std::atomic<std::uint64_t> steals{0};
+  };
+
+  std::vector<std::unique_ptr<shard>> shards;
+  std::vector<std::thread> workers;
+  std::size_t batch;  // runs of one engine a worker executes before it requeues the engine
+
+  std::mutex sleep_mtx;
+  std::condition_variable wake;
+  std::atomic<std::size_t> pending{0};  // instances queued but not yet taken
+  std::atomic<std::size_t> sleepers{0};
+  std::atomic<bool> stopping{false};
+
+  auto home(const msm_engine* engine) const noexcept -> std::size_t;
+  auto enqueue(std::size_t index, std::shared_ptr<instance> ready) -> void;
+  auto take(std::size_t index) -> std::shared_ptr<instance>;  // own queue first, then steals
+  auto execute(std::size_t index, const std::shared_ptr<instance>& ready) -> void;
+  auto work(std::size_t index, bool pin) -> void;
+
+ public:
+  explicit sharded_runtime(std::size_t shard_count = std::thread::hardware_concurrency(), bool pin = true,
+                           std::size_t batch_ = 16);
+  sharded_runtime(const sharded_runtime&) = delete;
+  ~sharded_runtime();  // finishes every submitted run, then joins the workers
+
+  // Queues engine->execute(bb). on_done(outcome, error) runs on the worker thread right after the run; exactly one
+  // of its arguments is set. Runs of the same engine execute in submission order.
+  auto submit(std::shared_ptr<msm_engine> engine, blackboard::ptr bb, completion_t on_done) -> void;
+  auto submit(std::shared_ptr<msm_engine> engine, blackboard::ptr bb) -> std::future<std::string>;
+
+  auto shard_count() const noexcept -> std::size_t { return shards.size(); }
+  auto get_stats() const noexcept -> runtime_stats;
+};
+}  // namespace msm
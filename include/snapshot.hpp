@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace msm {
+// Binary snapshots (blackboard::snapshot(), msm_engine::snapshot()) are written in native byte order and are meant
+// for checkpoint/restore on the same platform, not as an interchange format.
+
+// Per-type encoding of blackboard values. Trivially copyable types are stored as raw bytes; other types need a
+// specialization with the same three functions, then blackboard::register_codec<T>(name).
+template <typename T>
+struct snapshot_codec {
+  static_assert(std::is_trivially_copyable_v<T>, "specialize msm::snapshot_codec<T> for this type");
+
+  static auto size(const T&) noexcept -> std::size_t { return sizeof(T); }
+  static auto encode(const T& value, std::byte* out) noexcept -> void { std::memcpy(out, &value, sizeof(T)); }
+  static auto decode(std::span<const std::byte> in) -> T {
+    if (in.size() != sizeof(T)) throw std::runtime_error("Snapshot payload does not match the value size.");
+    auto value = T{};
+    std::memcpy(&value, in.data(), sizeof(T));
+    return value;
+  }
+};
+
+template <>
+struct snapshot_codec<std::string> {
+  static auto size(const std::string& value) noexcept -> std::size_t { return value.size(); }
+  static auto encode(const std::string& value, std::byte* out) noexcept -> void {
+    std::memcpy(out, value.data(), value.size());
+  }
+  static auto decode(std::span<const std::byte> in) -> std::string {
+    return std::string{reinterpret_cast<const char*>(in.data()), in.size()};
+  }
+};
+
+// Appends to a caller-provided buffer, throwing std::length_error instead of overrunning it
+class snapshot_writer final {
+ private:
+  std::span<std::byte> buffer;
+  std::size_t offset = 0;
+
+ public:
+  explicit snapshot_writer(std::span<std::byte> buffer_) : buffer{buffer_} {}
+
+  auto reserve(std::size_t count) -> std::byte* {  // hands out the next count bytes to be filled in place
+    if (buffer.size() - offset < count) throw std::length_error("Snapshot buffer is too small.");
+    auto* out = buffer.data() + offset;
+    offset += count;
+    return out;
+  }
+
+  template <typename T>
+  auto put(const T& value) -> void {
+    static_assert(std::is_trivially_copyable_v<T>);
+    std::memcpy(reserve(sizeof(T)), &value, sizeof(T));
+  }
+
+  auto put_string(std::string_view value) -> void {
+    put(static_cast<std::uint32_t>(value.size()));
+    std::memcpy(reserve(value.size()), value.data(), value.size());
+  }
+
+  auto size() const noexcept -> std::size_t { return offset; }
+};
+
+// Appends to a vector that grows as needed, for data whose size is not worth computing up front
+class snapshot_builder final {
+ private:
+  std::vector<std::byte>& buffer;
+
+ public:
+  explicit snapshot_builder(std::vector<std::byte>& buffer_) : buffer{buffer_} {}
+
+  auto put_bytes(const void* data, std::size_t count) -> void {
+    const auto* bytes = static_cast<const std::byte*>(data);
+    buffer.insert(buffer.end(), bytes, bytes + count);
+  }
+
+  template <typename T>
+  auto put(const T& value) -> void {
+    static_assert(std::is_trivially_copyable_v<T>);
+    put_bytes(&value, sizeof(T));
+  }
+
+  auto put_string(std::string_view value) -> void {
+    put(static_cast<std::uint32_t>(value.size()));
+    put_bytes(value.data(), value.size());
+  }
+};
+
+// Reads a snapshot in place, throwing std::runtime_error on truncated input
+class snapshot_reader final {
+ private:
+  std::span<const std::byte> buffer;
+  std::size_t offset = 0;
+
+ public:
+  explicit snapshot_reader(std::span<const std::byte> buffer_) : buffer{buffer_} {}
+
+  auto bytes(std::size_t count) -> std::span<const std::byte> {
+    if (buffer.size() - offset < count) throw std::runtime_error("Snapshot is truncated.");
+    auto in = buffer.subspan(offset, count);
+    offset += count;
+    return in;
+  }
+
+  template <typename T>
+  auto get() -> T {
+    static_assert(std::is_trivially_copyable_v<T>);
+    auto value = T{};
+    std::memcpy(&value, bytes(sizeof(T)).data(), sizeof(T));
+    return value;
+  }
+
+  auto get_string() -> std::string_view {
+    auto in = bytes(get<std::uint32_t>());
+    return std::string_view{reinterpret_cast<const char*>(in.data()), in.size()};
+  }
+
+  // A count read from the input, checked against the bytes left before anything is sized by it: count elements of
+  // at least min_size bytes each must still fit. Throws the truncation error instead of letting a damaged count
+  // reach reserve() or resize().
+  auto check_count(std::uint64_t count, std::size_t min_size) const -> std::size_t {
+    if (min_size > 0 && count > (buffer.size() - offset) / min_size) throw std::runtime_error("Snapshot is truncated.");
+    return static_cast<std::size_t>(count);
+  }
+
+  auto done() const noexcept -> bool { return offset == buffer.size(); }
+  auto position() const noexcept -> std::size_t { return offset; }
+};
+
+// Read-only memory mapping of a snapshot file, so restores read the page cache directly
+class mapped_file final {
+ private:
+  const std::byte* data = nullptr;
+  std::size_t length = 0;
+
+ public:
+  explicit mapped_file(const std::string& path);
+  mapped_file(const mapped_file&) = delete;
+  ~mapped_file();
+
+  auto bytes() const noexcept -> std::span<const std::byte> { return {data, length}; }
+};
+
+// Writes a uniquely named temporary next to path, fsyncs it, renames it over path and fsyncs the directory, so a
+// crash leaves either the old or the new snapshot behind, and concurrent writers of one path do not collide (the
+// last rename wins)
+auto write_snapshot_file(const std::string& path, std::span<const std::byte> bytes) -> void;
+}  // namespace msm
@@ -1,29 +1,87 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <functional>
+#include <memory>
+#include <memory_resource>
 #include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
 #include <unordered_set>
+#include <utility>
 
+#include "arena.hpp"
 #include "blackboard.hpp"
+#include "executor.hpp"
 
 namespace msm {
 
 class msm_state {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  // A state's outcomes, allocated like the state. Also takes std::string and converts to the
+  // std::unordered_set<std::string> it used to be, so subclasses written against that keep working.
+  class outcome_set : public std::pmr::unordered_set<std::pmr::string, string_hash, string_equal> {
+   public:
+    using base = std::pmr::unordered_set<std::pmr::string, string_hash, string_equal>;
+    using base::base;
+    using base::insert;
+
+    template <typename S, typename = std::enable_if_t<std::is_convertible_v<const S&, std::string_view> &&
+                                                      !std::is_same_v<S, std::pmr::string>>>
+    auto insert(const S& outcome) -> std::pair<iterator, bool> {
+      return this->emplace(std::string_view{outcome});
+    }
+
+    operator std::unordered_set<std::string>() const {
+      auto result = std::unordered_set<std::string>{};
+      result.reserve(this->size());
+      for (const auto& outcome : *this) result.emplace(outcome);
+      return result;
+    }
+  };
+
  private:
   std::atomic<bool> active;
   std::atomic<bool> cancelled;
+  std::atomic<clock::rep> deadline{clock::time_point::max().time_since_epoch().count()};
+
+  mutable std::mutex wait_mtx;               // guards waiting_on
+  mutable blackboard* waiting_on = nullptr;  // blackboard a wait_for() is blocked on, woken by cancel()
+  auto begin_wait(blackboard* bb) const -> void;
+  auto end_wait() const noexcept -> void;
 
  protected:
-  std::unordered_set<std::string> outcomes;
+  outcome_set outcomes;
+
+  // Resets the cancel flag and marks the state active. A deadline that has already passed leaves the state
+  // cancelled, so a timer that fired before the execution began is not lost; so does a set cancel_token.
+  auto begin_execution(const std::atomic<bool>* cancel_token = nullptr) noexcept -> void;
+  auto end_execution() noexcept -> void;
+  auto deadline_passed() const noexcept -> bool;
+
+  msm_state(std::in_place_t, outcome_set outcomes_);  // takes the set as it is, allocator included
 
  public:
   using ptr = std::shared_ptr<msm_state>;
   msm_state(const std::unordered_set<std::string>& outcomes_);
+  // The outcome set is allocated from the allocator's resource, see machine_arena. Not named allocator_type, so
+  // that states without an allocator-extended constructor can still be made in an arena.
+  msm_state(const std::unordered_set<std::string>& outcomes_, const std::pmr::polymorphic_allocator<>& allocator);
   msm_state() = delete;
   virtual ~msm_state() = default;
 
   auto operator()(blackboard::ptr bb) -> std::string;
+  auto invoke(const blackboard::ptr& bb) -> std::string;  // operator() without the outcome check, for callers that
+                                                          // resolve outcomes themselves (e.g. msm_engine)
+  // invoke() on behalf of a run that may be cancelled before this state begins (e.g. a parallel_state branch still
+  // queued): the state starts cancelled if cancel_token is already set, instead of clearing that cancel
+  auto invoke(const blackboard::ptr& bb, const std::atomic<bool>& cancel_token) -> std::string;
 
   virtual auto execute(blackboard::ptr bb) -> std::string = 0;
   virtual auto to_string() const -> std::string = 0;
@@ -31,55 +89,134 @@ class msm_state {
 
   auto is_active() const noexcept -> bool;
   auto is_cancelled() const noexcept -> bool;
-  auto get_outcomes() const noexcept -> const std::unordered_set<std::string>&;
+  auto get_outcomes() const -> std::unordered_set<std::string>;  // a copy, see get_outcome_set()
+  auto get_outcome_set() const noexcept -> const outcome_set&;    // the state's own set, without copying
+
+  // When the current execution has to be done by, clock::time_point::max() if there is no limit. Set by the
+  // engine for states running under a timeout, which cancels the state when it passes; a state that blocks
+  // should not wait beyond it. There is one deadline per state object: a state shared by engines running at the
+  // same time sees whichever deadline was set last, so give each of them its own instance of a timed state.
+  auto get_deadline() const noexcept -> clock::time_point;
+  auto set_deadline(clock::time_point deadline_) noexcept -> void;
+
+  // blackboard::wait_for() that also gives up when this state is cancelled or its deadline passes
+  template <typename T, typename Predicate, typename Rep, typename Period>
+  auto wait_for(const blackboard::ptr& bb, const std::string& key, Predicate predicate,
+                std::chrono::duration<Rep, Period> timeout) const -> std::optional<T> {
+    auto limit = std::chrono::duration_cast<clock::duration>(timeout);
+    if (auto until = get_deadline(); until != clock::time_point::max()) limit = std::min(limit, until - clock::now());
+    begin_wait(bb.get());
+    struct wait_guard {
+      const msm_state& state;
+      ~wait_guard() { state.end_wait(); }
+    } guard{*this};
+    return bb->wait_for<T>(key, std::move(predicate), limit, [this] { return is_cancelled(); });
+  }
 };
 
 class callback_state : public msm_state {
  private:
-  std::function<std::string(blackboard::ptr)> callback_func;
+  // The callable, type-erased by hand rather than with std::function so that it and its captures come from the
+  // state's resource like the outcome set (inplace_function would cap the size of the captures)
+  std::pmr::polymorphic_allocator<> allocator;
+  void* callback_func = nullptr;
+  std::string (*invoke_func)(void* func, blackboard::ptr bb) = nullptr;
+  void (*destroy_func)(std::pmr::polymorphic_allocator<>& allocator, void* func) noexcept = nullptr;
 
  public:
-  callback_state(const std::function<std::string(blackboard::ptr)>& func,
-                 const std::unordered_set<std::string>& outcomes_)
-      : msm_state(outcomes_), callback_func{func} {}
+  using allocator_type = std::pmr::polymorphic_allocator<>;
+
+  // An empty std::function is accepted, execute() reports it
+  template <typename F,
+            typename = std::enable_if_t<std::is_invocable_r_v<std::string, std::decay_t<F>&, blackboard::ptr>>>
+  callback_state(F&& func, const std::unordered_set<std::string>& outcomes_, const allocator_type& allocator_ = {})
+      : msm_state{outcomes_, allocator_}, allocator{allocator_} {
+    using callable = std::decay_t<F>;
+    if constexpr (std::is_constructible_v<bool, const callable&>) {
+      if (!static_cast<bool>(func)) return;
+    }
+    callback_func = allocator.new_object<callable>(std::forward<F>(func));
+    invoke_func = [](void* func_, blackboard::ptr bb) -> std::string {
+      return (*static_cast<callable*>(func_))(std::move(bb));
+    };
+    destroy_func = [](allocator_type& allocator_, void* func_) noexcept -> void {
+      allocator_.delete_object(static_cast<callable*>(func_));
+    };
+  }
   callback_state() = delete;
-  ~callback_state() override = default;
+  callback_state(const callback_state&) = delete;
+  auto operator=(const callback_state&) -> callback_state& = delete;
+  ~callback_state() override;
 
   auto execute(blackboard::ptr bb) -> std::string override;
+  auto to_string() const -> std::string override;
+};
+
+// When parallel_state stops waiting for its branches
+enum class join_policy {
+  wait_all,        // wait for every branch, then match the outcome map (default)
+  first_decisive,  // return as soon as an outcome is satisfied or no outcome can be satisfied anymore
+  first_completed  // return as soon as any branch finishes, unfinished branches count as unmet
 };
 
 class parallel_state : public msm_state {
  private:
-  std::atomic<bool> active;     // this hides the variable from the base class
-  std::atomic<bool> cancelled;  // this hides the variable from the base class
+  struct join_context;       // per-execution results and cancellation shared with the branch tasks, which may
+                             // outlive execute()
+  struct compiled_outcomes;  // outcome_map as bitmasks, see the constructor
+
+  std::atomic<bool> active;  // this hides the variable from the base class
 
-  std::mutex intermediate_mutex;  // mutex for intermediate outcomes
+  std::mutex intermediate_mutex;  // mutex for intermediate outcomes, current_join and abandoned
+
+  std::pmr::vector<msm_state::ptr> branches;  // states in a fixed order, branches[0] runs on the calling thread
+  executor::ptr branch_executor;
+  std::atomic<join_policy> policy;
+  std::shared_ptr<join_context> current_join;
+  std::shared_ptr<join_context> abandoned;  // last execution, if it returned before all of its branches did
+
+  std::shared_ptr<const compiled_outcomes> compiled;
 
  protected:
   using state_map = std::unordered_map<msm_state::ptr, std::string>;
+  using branch_outcomes = std::pmr::unordered_map<msm_state::ptr, std::pmr::string>;
 
-  const std::unordered_set<msm_state::ptr> states;
-  const std::string default_outcome;
+  // copies of the constructor arguments, allocated like the branch list
+  const std::pmr::unordered_set<msm_state::ptr> states;
+  const std::pmr::string default_outcome;
 
-  state_map state_outcomes;  // map from state to its outcome
-  std::unordered_map<std::string, state_map>
+  branch_outcomes state_outcomes;  // map from state to its outcome
+  std::pmr::unordered_map<std::pmr::string, branch_outcomes, string_hash, string_equal>
       outcome_map;  // map from outcome to (map from state to its expected outcome)
 
-  std::unordered_map<msm_state::ptr, std::string>
-      intermediate_outcomes;                 // map from state to its actual outcome after calling state->execute()
-  std::unordered_set<std::string> outcomes;  // set of all outcomes
+  branch_outcomes intermediate_outcomes;  // map from state to its actual outcome after calling state->execute()
 
   static auto generate_outcomes(const std::unordered_map<std::string, state_map>& outcome_map,
-                                const std::string& default_outcome) -> std::unordered_set<std::string>;
+                                const std::string& default_outcome, const std::pmr::polymorphic_allocator<>& allocator)
+      -> outcome_set;
 
  public:
   parallel_state(const std::unordered_set<msm_state::ptr>& states_, const std::string& default_outcome_,
-                 const std::unordered_map<std::string, state_map>& outcome_map_);
+                 const std::unordered_map<std::string, state_map>& outcome_map_,
+                 executor::ptr executor_ = nullptr);  // nullptr selects thread_pool_executor::shared()
+
+  // The outcomes, the branch list and the compiled outcome table are allocated from the allocator's resource, see
+  // machine_arena; what one execute() shares with its branch tasks is not, as the tasks may outlive the state
+  using allocator_type = std::pmr::polymorphic_allocator<>;
+  parallel_state(std::allocator_arg_t, const allocator_type& allocator,
+                 const std::unordered_set<msm_state::ptr>& states_, const std::string& default_outcome_,
+                 const std::unordered_map<std::string, state_map>& outcome_map_, executor::ptr executor_ = nullptr);
   parallel_state() = delete;
   ~parallel_state() override = default;
 
+  auto set_join_policy(join_policy policy_) noexcept -> void;
+  auto get_join_policy() const noexcept -> join_policy;
+
+  // Branches abandoned by an early return are cancelled and finish in the background; the next execute() waits for
+  // them before running the same branch states again. Under first_decisive, first_completed or a deadline the
+  // calling thread only waits, so a slow branch cannot hold up the return; with wait_all it runs branches itself.
   auto execute(blackboard::ptr bb) -> std::string override;
-  auto cancel() -> void override;
+  auto cancel() -> void override;  // cancels the running execution, if any
   auto to_string() const -> std::string override;
 };
 
@@ -0,0 +1,298 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "state.hpp"
+
+namespace msm {
+// Compile-time front end for machines whose structure is fixed at build time. States are plain types with
+//
+//   static constexpr std::array outcomes{outcome::a, outcome::b};  // every outcome the state may return
+//   auto execute(Context& context) -> outcome;                      // non-virtual
+//
+// where `outcome` is an enum shared by the whole machine. Transitions are types as well:
+//
+//   using machine = static_machine<outcome, context, idle,
+//                                  transition<idle, outcome::go, busy>,
+//                                  transition<busy, outcome::stop, exit_with<outcome::stopped>>>;
+//
+// The checks msm_engine::validate(true) does at runtime (every target exists, every declared outcome is mapped,
+// no outcome is mapped twice) are static_asserts here. Dispatch is a fold over the state tuple plus a constexpr
+// [state][outcome] table: no virtual calls, std::function, strings or allocation. A static_machine is itself a
+// valid state type, and static_machine_state wraps one as an msm_state for use inside msm_engine.
+
+// Transition target that ends the machine with Outcome
+template <auto Outcome>
+struct exit_with {
+  static constexpr auto outcome = Outcome;
+};
+
+template <typename From, auto Outcome, typename To>
+struct transition {
+  using from = From;
+  using to = To;
+  static constexpr auto outcome = Outcome;
+};
+
+namespace detail {
+template <typename... Ts>
+struct type_list {};
+
+template <typename List, typename... Ts>
+struct unique_types;
+template <typename... Us>
+struct unique_types<type_list<Us...>> {
+  using type = type_list<Us...>;
+};
+template <typename... Us, typename T, typename... Ts>
+struct unique_types<type_list<Us...>, T, Ts...> {
+  using type = typename std::conditional_t<(std::is_same_v<T, Us> || ...), unique_types<type_list<Us...>, Ts...>,
+                                           unique_types<type_list<Us..., T>, Ts...>>::type;
+};
+
+template <typename T>
+struct is_exit : std::false_type {};
+template <auto Outcome>
+struct is_exit<exit_with<Outcome>> : std::true_type {};
+
+// states are the initial state, every transition source and every non-exit target, in that order
+template <typename Initial, typename... Transitions>
+using state_types = typename unique_types<
+    type_list<>, Initial, typename Transitions::from...,
+    std::conditional_t<is_exit<typename Transitions::to>::value, Initial, typename Transitions::to>...>::type;
+
+// outcome an exit_with target finishes with, or `fallback` for state targets
+template <typename To, typename Outcome>
+constexpr auto exit_outcome(Outcome fallback) noexcept -> Outcome {
+  if constexpr (is_exit<To>::value) {
+    return static_cast<Outcome>(To::outcome);
+  } else {
+    return fallback;
+  }
+}
+
+template <typename T, typename... Ts>
+constexpr auto index_of() noexcept -> std::int32_t {
+  auto index = std::int32_t{0};
+  ((std::is_same_v<T, Ts> ? false : (++index, true)) && ...);
+  return index;
+}
+}  // namespace detail
+
+template <typename Outcome, typename Context, typename Initial, typename... Transitions>
+class static_machine final {
+  static_assert(std::is_enum_v<Outcome>, "static_machine outcomes must be an enum");
+  static_assert(sizeof...(Transitions) > 0, "static_machine needs at least one transition");
+
+  template <typename List>
+  struct layout;
+  template <typename... States>
+  struct layout<detail::type_list<States...>> {
+    using storage = std::tuple<States...>;
+    static constexpr std::size_t count = sizeof...(States);
+
+    template <typename T>
+    static constexpr auto index() noexcept -> std::int32_t {
+      return detail::index_of<T, States...>();
+    }
+
+    static constexpr auto width() noexcept -> std::size_t {
+      auto widest = std::size_t{0};
+      auto widen = [&widest](Outcome outcome) {
+        widest = std::max(widest, static_cast<std::size_t>(outcome) + 1);
+      };
+      (widen(Transitions::outcome), ...);
+      (widen(detail::exit_outcome<typename Transitions::to>(Transitions::outcome)), ...);
+      ((std::for_each(States::outcomes.begin(), States::outcomes.end(), widen)), ...);
+      return widest;
+    }
+
+    // every outcome each state declares is mapped
+    static constexpr auto complete() noexcept -> bool {
+      auto mapped = [](std::int32_t state, Outcome outcome) {
+        return ((index<typename Transitions::from>() == state && Transitions::outcome == outcome) || ...);
+      };
+      auto covered = [&mapped](std::int32_t state, const auto& outcomes) {
+        return std::all_of(outcomes.begin(), outcomes.end(), [&](Outcome o) { return mapped(state, o); });
+      };
+      return (covered(index<States>(), States::outcomes) && ...);
+    }
+
+    template <std::size_t... I>
+    static auto dispatch(storage& states, std::int32_t current, Context& context, std::index_sequence<I...>)
+        -> Outcome {
+      auto outcome = Outcome{};
+      ((current == static_cast<std::int32_t>(I) ? (outcome = std::get<I>(states).execute(context), true) : false) ||
+       ...);
+      return outcome;
+    }
+  };
+
+  using states_t = layout<detail::state_types<Initial, Transitions...>>;
+
+  static constexpr std::int32_t unmapped = -1;
+  static constexpr auto terminal(Outcome outcome) noexcept -> std::int32_t {
+    return -2 - static_cast<std::int32_t>(outcome);
+  }
+
+  template <typename To>
+  static constexpr auto target_of() noexcept -> std::int32_t {
+    if constexpr (detail::is_exit<To>::value) {
+      return terminal(To::outcome);
+    } else {
+      return states_t::template index<To>();
+    }
+  }
+
+  static constexpr std::size_t width = states_t::width();
+
+  static constexpr auto unique_edges() noexcept -> bool {
+    auto counts = std::array<int, states_t::count * width>{};
+    ((++counts[states_t::template index<typename Transitions::from>() * width +
+               static_cast<std::size_t>(Transitions::outcome)]),
+     ...);
+    return std::all_of(counts.begin(), counts.end(), [](int count) { return count <= 1; });
+  }
+
+  static constexpr auto exit_count() noexcept -> std::size_t {
+    auto seen = std::array<bool, width>{};
+    auto count = std::size_t{0};
+    auto visit = [&](bool is_exit, Outcome outcome) {
+      if (is_exit && !seen[static_cast<std::size_t>(outcome)]) {
+        seen[static_cast<std::size_t>(outcome)] = true;
+        ++count;
+      }
+    };
+    (visit(detail::is_exit<typename Transitions::to>::value,
+           detail::exit_outcome<typename Transitions::to>(Transitions::outcome)),
+     ...);
+    return count;
+  }
+
+  static_assert(((static_cast<std::int64_t>(Transitions::outcome) >= 0) && ...),
+                "static_machine outcomes must not be negative");
+  static_assert(unique_edges(), "static_machine maps the same outcome of a state twice");
+  static_assert(states_t::complete(), "static_machine state declares an outcome that has no transition");
+  static_assert(exit_count() > 0, "static_machine has no exit_with transition");
+
+  // [state * width + outcome] -> state index, terminal(outcome) or unmapped
+  static constexpr auto table = [] {
+    auto targets = std::array<std::int32_t, states_t::count * width>{};
+    targets.fill(unmapped);
+    ((targets[states_t::template index<typename Transitions::from>() * width +
+              static_cast<std::size_t>(Transitions::outcome)] = target_of<typename Transitions::to>()),
+     ...);
+    return targets;
+  }();
+
+  typename states_t::storage states;
+
+ public:
+  using outcome_type = Outcome;
+  using context_type = Context;
+
+  // the outcomes the machine can finish with, so a static_machine can itself be used as a state
+  static constexpr auto outcomes = [] {
+    auto exits = std::array<Outcome, exit_count()>{};
+    auto seen = std::array<bool, width>{};
+    auto count = std::size_t{0};
+    auto visit = [&](bool is_exit, Outcome outcome) {
+      if (is_exit && !seen[static_cast<std::size_t>(outcome)]) {
+        seen[static_cast<std::size_t>(outcome)] = true;
+        exits[count++] = outcome;
+      }
+    };
+    (visit(detail::is_exit<typename Transitions::to>::value,
+           detail::exit_outcome<typename Transitions::to>(Transitions::outcome)),
+     ...);
+    return exits;
+  }();
+
+  static constexpr auto state_count() noexcept -> std::size_t { return states_t::count; }
+
+  template <typename State>
+  auto state() noexcept -> State& {
+    return std::get<State>(states);
+  }
+
+  // Runs from the initial state until an exit_with transition is taken
+  auto execute(Context& context) -> Outcome {
+    auto current = std::int32_t{0};  // the initial state is always index 0
+    while (true) {
+      auto outcome =
+          states_t::dispatch(states, current, context, std::make_index_sequence<states_t::count>{});
+
+      // only reachable if a state returns an outcome it did not declare
+      auto column = static_cast<std::size_t>(outcome);
+      auto target = column < width ? table[current * width + column] : unmapped;
+      if (target == unmapped) throw std::logic_error("Invalid outcome returned by static_machine state.");
+      if (target < unmapped) return static_cast<Outcome>(-2 - target);
+      current = target;
+    }
+  }
+};
+
+// Runs a static_machine as a regular msm_state so it can be nested inside msm_engine. Machine outcomes are
+// reported under the given names. If the machine's context is not the blackboard itself, it lives on the
+// blackboard under context_key.
+template <typename Machine>
+class static_machine_state final : public msm_state {
+ public:
+  using outcome_type = typename Machine::outcome_type;
+  using context_type = typename Machine::context_type;
+
+ private:
+  Machine machine;
+  std::vector<std::pair<outcome_type, std::string>> names;
+  std::string context_key;
+
+  static auto name_set(const std::vector<std::pair<outcome_type, std::string>>& names_)
+      -> std::unordered_set<std::string> {
+    auto result = std::unordered_set<std::string>{};
+    for (const auto& outcome : Machine::outcomes) {
+      auto it = std::find_if(names_.begin(), names_.end(),
+                             [outcome](const auto& entry) { return entry.first == outcome; });
+      if (it == names_.end()) throw std::invalid_argument("static_machine_state: machine outcome has no name.");
+      result.insert(it->second);
+    }
+    return result;
+  }
+
+ public:
+  static_machine_state(std::vector<std::pair<outcome_type, std::string>> names_, std::string context_key_ = {},
+                       Machine machine_ = {})
+      : msm_state(name_set(names_)),
+        machine{std::move(machine_)},
+        names{std::move(names_)},
+        context_key{std::move(context_key_)} {}
+  ~static_machine_state() override = default;
+
+  auto get_machine() noexcept -> Machine& { return machine; }
+
+  auto execute(blackboard::ptr bb) -> std::string override {
+    auto outcome = outcome_type{};
+    if constexpr (std::is_same_v<context_type, blackboard>) {
+      outcome = machine.execute(*bb);
+    } else {
+      outcome = machine.execute(bb->operator[]<context_type>(context_key));
+    }
+
+    for (const auto& [value, name] : names) {
+      if (value == outcome) return name;
+    }
+    throw std::logic_error("static_machine_state: machine outcome has no name.");
+  }
+
+  auto to_string() const -> std::string override {
+    return "Static State Machine with " + std::to_string(Machine::state_count()) + " states";
+  }
+};
+}  // namespace msm
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace msm {
+// Hashed timing wheel: one thread serves every timer scheduled on it, so arming and disarming a deadline is a
+// bucket insert and a short scan under a mutex instead of a thread or a heap operation per timer. Timers fire on
+// the first tick at or after their deadline; a timer further away than one turn of the wheel waits out the extra
+// turns in its bucket.
+class timer_wheel final {
+ public:
+  using clock = std::chrono::steady_clock;
+  using timer_id = std::uint64_t;  // 0 is never a timer
+  using callback_t = std::function<void()>;
+
+ private:
+  struct timer {
+    timer_id id;
+    std::uint64_t rounds;  // turns of the wheel left before it is due
+    callback_t callback;
+  };
+
+  clock::duration tick;
+  clock::time_point start;              // time of tick 0
+  std::vector<std::vector<timer>> slots;  // a timer's slot is encoded in its id, so cancel() needs no index
+  std::uint64_t current = 0;              // last tick processed
+  std::uint64_t next_sequence = 1;
+  std::size_t pending = 0;
+
+  std::vector<timer> due;  // taken out of their slot by the wheel thread, not run yet
+  timer_id running = 0;
+  std::mutex mtx;
+  std::condition_variable wake;
+  std::condition_variable finished;  // a callback returned
+  bool stopping = false;
+  std::thread worker;
+
+  auto tick_of(clock::time_point time) const noexcept -> std::uint64_t;  // first tick at or after time
+  auto run() -> void;
+
+ public:
+  explicit timer_wheel(clock::duration tick_ = std::chrono::milliseconds(1), std::size_t slot_count = 512);
+  timer_wheel(const timer_wheel&) = delete;
+  ~timer_wheel();  // drops the timers that have not fired
+
+  // callback runs on the wheel thread and must be short and not throw
+  auto schedule(clock::time_point deadline, callback_t callback) -> timer_id;
+  template <typename Rep, typename Period>
+  auto schedule(std::chrono::duration<Rep, Period> delay, callback_t callback) -> timer_id {
+    return schedule(clock::now() + std::chrono::duration_cast<clock::duration>(delay), std::move(callback));
+  }
+
+  // True if the timer had not fired: its callback will not run. Otherwise waits until its callback has returned
+  // (unless called from that callback) and returns false.
+  auto cancel(timer_id id) -> bool;
+
+  auto get_tick() const noexcept -> clock::duration { return tick; }
+
+  static auto shared() -> const std::shared_ptr<timer_wheel>&;  // process-wide wheel used by msm_engine
+};
+}  // namespace msm
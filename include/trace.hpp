@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace msm {
+// Execution tracing, compiled in with -DMSM_ENABLE_TRACING. Without it the MSM_TRACE_* macros expand to nothing
+// (their arguments are not evaluated) and the engine carries no instrumentation at all; the export functions
+// still work and report an empty trace.
+//
+// Each thread appends fixed-size records to its own chunked buffer, so recording never takes a lock. Names are
+// interned once (state names when a graph is compiled) and records only carry their ids. Histograms, counters and
+// the exports are computed from the records when asked for.
+class tracer final {
+ public:
+  enum class kind : std::uint8_t {
+    state,       // one execution of a state, name is the state
+    transition,  // instant, name is the source state and detail the target
+    callback,    // start/transition/end callbacks of an engine
+    join         // a parallel_state waiting for its branches
+  };
+
+  static constexpr std::uint32_t no_detail = static_cast<std::uint32_t>(-1);
+
+  // Log2 latency histogram: bucket i counts durations in [2^i, 2^(i+1)) nanoseconds
+  struct histogram {
+    std::uint64_t count = 0;
+    std::uint64_t total_ns = 0;
+    std::uint64_t max_ns = 0;
+    std::array<std::uint64_t, 64> buckets{};
+
+    auto add(std::uint64_t duration_ns) noexcept -> void;
+    auto percentile(double fraction) const noexcept -> std::uint64_t;  // upper bound of the bucket, in ns
+  };
+
+  // RAII duration record, see MSM_TRACE_SCOPE
+  class scope final {
+   private:
+    kind type;
+    std::uint32_t name;
+    std::uint32_t detail;
+    std::uint64_t start;
+
+   public:
+    scope(kind type_, std::uint32_t name_, std::uint32_t detail_ = no_detail) noexcept
+        : type{type_}, name{name_}, detail{detail_}, start{now()} {}
+    scope(const scope&) = delete;
+    ~scope() { record(type, name, detail, start, now()); }
+  };
+
+  static auto now() noexcept -> std::uint64_t {  // steady clock in nanoseconds
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+  }
+
+  static auto intern(std::string_view name) -> std::uint32_t;  // takes a lock, keep it off hot paths
+  static auto record(kind type, std::uint32_t name, std::uint32_t detail, std::uint64_t start,
+                     std::uint64_t end) noexcept -> void;
+
+  static auto state_histograms() -> std::map<std::string, histogram>;
+  static auto transition_counts() -> std::map<std::string, std::uint64_t>;  // keyed "from -> to"
+  static auto dropped() noexcept -> std::uint64_t;  // records lost because a thread's buffer was full
+
+  static auto write_chrome_trace(std::ostream& out) -> void;  // Chrome trace event JSON, also read by Perfetto
+  static auto summary() -> std::string;                      // per-state latencies, transitions, callbacks, joins
+
+  static auto clear() -> void;  // drops all records; only call while nothing is being traced
+};
+}  // namespace msm
+
+#ifdef MSM_ENABLE_TRACING
+#define MSM_TRACE_CONCAT_(a, b) a##b
+#define MSM_TRACE_CONCAT(a, b) MSM_TRACE_CONCAT_(a, b)
+#define MSM_TRACE_SCOPE(type, ...) \
+  ::msm::tracer::scope MSM_TRACE_CONCAT(msm_trace_scope_, __LINE__) { ::msm::tracer::kind::type, __VA_ARGS__ }
+#define MSM_TRACE_INSTANT(type, name, detail)                                                          \
+  do {                                                                                                 \
+    auto msm_trace_now = ::msm::tracer::now();                                                         \
+    ::msm::tracer::record(::msm::tracer::kind::type, (name), (detail), msm_trace_now, msm_trace_now); \
+  } while (false)
+#define MSM_TRACE_NAME(literal)                                      \
+  [] {                                                               \
+    static const auto msm_trace_id = ::msm::tracer::intern(literal); \
+    return msm_trace_id;                                             \
+  }()
+#else
+#define MSM_TRACE_SCOPE(type, ...)
+#define MSM_TRACE_INSTANT(type, name, detail) \
+  do {                                        \
+  } while (false)
+#endif
@@ -0,0 +1,18 @@
+#include "arena.hpp"
+
+namespace msm {
+machine_arena::machine_arena(std::size_t initial_size, std::pmr::memory_resource* upstream)
+    : buffer{initial_size, upstream} {}
+
+auto machine_arena::do_allocate(std::size_t bytes, std::size_t alignment) -> void* {
+  auto lock = std::lock_guard(mtx);
+  auto* block = buffer.allocate(bytes, alignment);
+  allocated += bytes;
+  return block;
+}
+
+auto machine_arena::bytes_allocated() -> std::size_t {
+  auto lock = std::lock_guard(mtx);
+  return allocated;
+}
+}  // namespace msm
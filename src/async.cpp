@@ -0,0 +1,126 @@
+#include "async.hpp"
+
+#include <stdexcept>
+
+namespace msm {
+namespace {
+thread_local event_loop* running_loop = nullptr;
+}  // namespace
+
+auto event_loop::schedule_awaiter::await_suspend(std::coroutine_handle<> handle) -> void {
+  if (deadline <= clock::now()) {
+    loop->post(handle);
+  } else {
+    loop->schedule_at(deadline, handle);
+  }
+}
+
+auto event_loop::post(std::coroutine_handle<> handle) -> void {
+  {
+    auto lock = std::lock_guard(mtx);
+    ready.push_back(handle);
+  }
+  wake.notify_one();
+}
+
+auto event_loop::schedule_at(clock::time_point deadline, std::coroutine_handle<> handle) -> void {
+  {
+    auto lock = std::lock_guard(mtx);
+    timers.push(timer{deadline, timer_sequence++, handle});
+  }
+  wake.notify_one();
+}
+
+auto event_loop::finish_one() -> void {
+  auto lock = std::lock_guard(mtx);
+  if (--outstanding == 0) wake.notify_all();
+}
+
+auto event_loop::run() -> void {
+  auto* previous = std::exchange(running_loop, this);
+  auto batch = std::vector<std::coroutine_handle<>>{};
+
+  auto lock = std::unique_lock(mtx);
+  while (!stopped) {
+    auto now = clock::now();
+    while (!timers.empty() && timers.top().deadline <= now) {
+      ready.push_back(timers.top().handle);
+      timers.pop();
+    }
+
+    if (ready.empty()) {
+      if (outstanding == 0) break;
+      if (timers.empty()) {
+        wake.wait(lock);
+      } else {
+        wake.wait_until(lock, timers.top().deadline);
+      }
+      continue;
+    }
+
+    // resume a bounded batch outside the lock, leaving the rest for other threads running this loop
+    auto count = std::min<std::size_t>(ready.size(), 64);
+    batch.assign(ready.begin(), ready.begin() + static_cast<std::ptrdiff_t>(count));
+    ready.erase(ready.begin(), ready.begin() + static_cast<std::ptrdiff_t>(count));
+    if (!ready.empty()) wake.notify_one();
+
+    lock.unlock();
+    for (auto handle : batch) handle.resume();
+    lock.lock();
+  }
+  lock.unlock();
+
+  running_loop = previous;
+}
+
+auto event_loop::stop() -> void {
+  {
+    auto lock = std::lock_guard(mtx);
+    stopped = true;
+  }
+  wake.notify_all();
+}
+
+auto event_loop::restart() -> void {
+  auto lock = std::lock_guard(mtx);
+  stopped = false;
+}
+
+auto event_loop::current() noexcept -> event_loop* { return running_loop; }
+
+auto event_loop::running() -> event_loop& {
+  if (!running_loop) throw std::logic_error("No event_loop is running on this thread.");
+  return *running_loop;
+}
+
+auto yield() -> event_loop::schedule_awaiter { return event_loop::running().resume_on(); }
+
+auto async_state::execute(blackboard::ptr bb) -> std::string {
+  auto loop = event_loop{};
+  auto outcome = std::optional<std::string>{};
+  auto error = std::exception_ptr{};
+
+  loop.spawn(execute_async(std::move(bb)),
+             [&outcome, &error](std::optional<std::string> result, std::exception_ptr failure) -> void {
+               outcome = std::move(result);
+               error = failure;
+             });
+  loop.run();
+
+  if (error) std::rethrow_exception(error);
+  return std::move(*outcome);
+}
+
+auto async_state::invoke_async(blackboard::ptr bb) -> task<std::string> {
+  begin_execution();
+  try {
+    auto outcome = co_await execute_async(std::move(bb));
+    end_execution();
+    co_return outcome;
+  } catch (...) {
+    end_execution();
+    throw;
+  }
+}
+
+}  // namespace msm
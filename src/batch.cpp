@@ -0,0 +1,193 @@
+#include "batch.hpp"
+
+#include <condition_variable>
+
+#include "trace.hpp"
+
+namespace msm {
+msm_batch::msm_batch(std::shared_ptr<msm_engine> definition_, executor::ptr executor_)
+    : definition{std::move(definition_)},
+      batch_executor{executor_ ? std::move(executor_) : thread_pool_executor::shared()} {
+  this->definition->validate();
+  this->graph = this->definition->get_graph();
+
+  // instances are stepped without timers, a budget would silently not be enforced
+  const auto& graph = *this->graph;
+  auto has_timeout = this->definition->get_timeout().count() > 0;
+  for (auto state = compiled_graph::id_t{0}; static_cast<std::size_t>(state) < graph.state_count(); ++state) {
+    has_timeout = has_timeout || graph.state_timeout(state).budget.count() > 0;
+  }
+  if (has_timeout) throw std::invalid_argument("A batch cannot run a machine with time budgets.");
+
+  // per-run data lives in the state object, so one instance at a time
+  for (auto state = compiled_graph::id_t{0}; static_cast<std::size_t>(state) < graph.state_count(); ++state) {
+    if (!dynamic_cast<parallel_state*>(graph.state(state)) && !dynamic_cast<msm_engine*>(graph.state(state))) continue;
+    if (this->serial_states.empty()) this->serial_states.resize(graph.state_count());
+    this->serial_states[state] = true;
+  }
+}
+
+auto msm_batch::spawn() -> instance_id {
+  auto instance = instance_id{};
+  if (this->released.empty()) {
+    instance = this->current.size();
+    this->current.push_back(compiled_graph::npos);
+    this->outcomes.push_back(compiled_graph::npos);
+    this->boards.push_back(std::make_shared<blackboard>());
+    this->free_slots.push_back(false);
+    if (!this->serial_states.empty()) this->deferred.push_back(0);
+  } else {
+    instance = this->released.back();
+    this->released.pop_back();
+    this->free_slots[instance] = false;
+  }
+
+  const auto& graph = *this->graph;
+  msm_engine::run_steps(graph, this->boards[instance], graph.entry_begin(), graph.entry_end(), std::nullopt);
+  this->current[instance] = graph.initial_state();
+  this->outcomes[instance] = compiled_graph::npos;
+  ++this->running;
+  return instance;
+}
+
+auto msm_batch::release(instance_id instance) -> void {
+  if (instance >= this->current.size()) throw std::out_of_range("Unknown batch instance.");
+  if (this->free_slots[instance]) throw std::logic_error("Batch instance released twice.");
+
+  if (this->current[instance] != compiled_graph::npos) --this->running;
+  this->current[instance] = compiled_graph::npos;
+  this->outcomes[instance] = compiled_graph::npos;
+  this->boards[instance]->reset();  // keeps its keys and pages for the next instance
+  this->released.push_back(instance);
+  this->free_slots[instance] = true;
+}
+
+auto msm_batch::step_one(instance_id instance) -> bool {
+  const auto& graph = *this->graph;
+  auto state = this->current[instance];
+  const auto& bb = this->boards[instance];
+  auto since = msm_engine::written_since(this->tracked, bb);
+  auto result = std::string{};
+  {
+    MSM_TRACE_SCOPE(state, graph.state_trace_id(state));
+    result = graph.state(state)->execute(bb);
+  }
+
+  auto edge = graph.find_edge(state, result);
+  if (edge == compiled_graph::npos) {
+    throw std::logic_error("Invalid outcome: " + result + " from state: " + graph.state(state)->to_string());
+  }
+
+  auto target = graph.edge_target(edge);
+  if (target == compiled_graph::unmapped) {
+    throw std::runtime_error("State machine execution failed: outcome '" + result + "' of state '" +
+                             graph.state_name(state) + "' has no transition.");
+  }
+
+  if (compiled_graph::is_terminal(target)) {
+    auto outcome = compiled_graph::terminal_outcome(target);
+    MSM_TRACE_INSTANT(transition, graph.state_trace_id(state), graph.outcome_trace_id(outcome));
+    msm_engine::run_steps(graph, bb, graph.step_begin(edge), graph.step_end(edge), since);
+    this->outcomes[instance] = outcome;
+    this->current[instance] = compiled_graph::npos;
+    return true;
+  }
+  MSM_TRACE_INSTANT(transition, graph.state_trace_id(state), graph.state_trace_id(target));
+  msm_engine::run_steps(graph, bb, graph.step_begin(edge), graph.step_end(edge), since);
+  this->current[instance] = target;
+  return false;
+}
+
+auto msm_batch::step_range(std::size_t begin, std::size_t end) -> std::size_t {
+  auto finished = std::size_t{0};
+  for (auto instance = begin; instance < end; ++instance) {
+    auto state = this->current[instance];
+    if (state == compiled_graph::npos) continue;
+    if (!this->serial_states.empty() && this->serial_states[state]) {
+      this->deferred[instance] = 1;  // distinct bytes per instance, chunks never share one
+      continue;
+    }
+    if (this->step_one(instance)) ++finished;
+  }
+  return finished;
+}
+
+auto msm_batch::step_all(std::size_t grain) -> std::size_t {
+  if (this->running == 0) return 0;
+  grain = std::max<std::size_t>(grain, 1);
+  this->tracked = msm_engine::tracks_writes(*this->graph);
+
+  struct join {
+    std::mutex mtx;
+    std::condition_variable done;
+    std::size_t remaining = 0;
+    std::size_t finished = 0;
+    std::exception_ptr error;
+  } chunks;
+
+  auto run = [this, &chunks](std::size_t begin, std::size_t end) -> void {
+    auto finished = std::size_t{0};
+    auto error = std::exception_ptr{};
+    try {
+      finished = this->step_range(begin, end);
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    auto lock = std::lock_guard(chunks.mtx);
+    chunks.finished += finished;
+    if (error && !chunks.error) chunks.error = error;
+    if (--chunks.remaining == 0) chunks.done.notify_all();
+  };
+
+  // the first chunk runs on the calling thread, the rest go to the executor
+  auto total = this->current.size();
+  chunks.remaining = (total + grain - 1) / grain;
+  for (auto begin = grain; begin < total; begin += grain) {
+    auto end = std::min(begin + grain, total);
+    this->batch_executor->submit([&run, begin, end]() -> void { run(begin, end); });
+  }
+  run(0, std::min(grain, total));
+
+  // help the executor while waiting, the chunk tasks reference this frame
+  auto lock = std::unique_lock(chunks.mtx);
+  while (chunks.remaining > 0) {
+    lock.unlock();
+    auto ran = this->batch_executor->try_run_one();
+    lock.lock();
+    if (!ran) chunks.done.wait_for(lock, std::chrono::microseconds(200));
+  }
+
+  // instances in states that keep per-run data, one at a time on this thread
+  for (auto instance = std::size_t{0}; instance < this->deferred.size(); ++instance) {
+    if (!this->deferred[instance]) continue;
+    this->deferred[instance] = 0;
+    if (chunks.error) continue;  // stays in its state like the instances of a failed chunk
+    try {
+      if (this->step_one(instance)) ++chunks.finished;
+    } catch (...) {
+      chunks.error = std::current_exception();
+    }
+  }
+
+  this->running -= chunks.finished;
+  if (chunks.error) std::rethrow_exception(chunks.error);
+  return this->running;
+}
+
+auto msm_batch::execute_batch(std::size_t grain) -> void {
+  while (this->step_all(grain) > 0) {
+  }
+}
+
+auto msm_batch::get_current_state(instance_id instance) const -> std::string {
+  auto state = this->current.at(instance);
+  return state == compiled_graph::npos ? std::string{} : this->graph->state_name(state);
+}
+
+auto msm_batch::get_outcome(instance_id instance) const -> std::optional<std::string> {
+  auto outcome = this->outcomes.at(instance);
+  if (outcome == compiled_graph::npos) return std::nullopt;
+  return this->graph->outcome_name(outcome);
+}
+}  // namespace msm
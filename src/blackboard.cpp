@@ -1,36 +1,244 @@
 #include "blackboard.hpp"
 
+#include <algorithm>
+#include <cstring>
+
 namespace msm {
 blackboard::blackboard(const blackboard& other) {
-  std::lock_guard lock(other.mtx);
-  entries = other.entries;  // Shallow copy of shared_ptrs
+  std::shared_lock lock(other.mtx);
+  copy_from(other);
+}
+
+blackboard::blackboard(const blackboard& other, const allocator_type& allocator)
+    : index{allocator}, pages{allocator}, journal{allocator}, names{allocator} {
+  std::shared_lock lock(other.mtx);
+  copy_from(other);
+}
+
+blackboard::blackboard(const allocator_type& allocator)
+    : index{allocator}, pages{allocator}, journal{allocator}, names{allocator} {}
+
+blackboard::blackboard(std::size_t capacity) : blackboard{capacity, allocator_type{std::pmr::get_default_resource()}} {}
+
+blackboard::blackboard(std::size_t capacity, const allocator_type& allocator) : blackboard{allocator} {
+  index.reserve(capacity);
+  while (pages.size() * page_size < capacity) add_page();
 }
 
-auto blackboard::contains(const std::string& key) const -> bool {
-  std::lock_guard lock(mtx);
-  return entries.find(key) != entries.end();
+blackboard::~blackboard() {
+  auto* resource = pages.get_allocator().resource();
+  for (auto chunk = std::size_t{0}; chunk < max_chunks; ++chunk) {
+    if (auto* table = directory[chunk].load(std::memory_order_relaxed)) {
+      resource->deallocate(table, (first_chunk << chunk) * sizeof(page*), alignof(page*));
+    }
+  }
 }
 
-auto blackboard::remove(const std::string& key) noexcept -> void {
-  std::lock_guard lock(mtx);
-  entries.erase(key);
+auto blackboard::make_page() -> page_ptr {
+  auto* resource = pages.get_allocator().resource();
+  auto* memory = resource->allocate(sizeof(page), alignof(page));
+  return page_ptr{new (memory) page{}, page_deleter{resource}};  // page{} cannot throw once allocated
+}
+
+auto blackboard::add_page() -> page& {
+  auto index = pages.size();
+  auto chunk = static_cast<std::size_t>(std::bit_width(index / first_chunk + 1)) - 1;
+  auto offset = index - first_chunk * ((std::size_t{1} << chunk) - 1);
+  if (chunk == max_chunks) throw std::length_error("Blackboard is full.");
+
+  auto* table = directory[chunk].load(std::memory_order_relaxed);
+  if (!table) {
+    auto entries = first_chunk << chunk;
+    table = static_cast<page**>(pages.get_allocator().resource()->allocate(entries * sizeof(page*), alignof(page*)));
+    std::fill_n(table, entries, nullptr);
+    directory[chunk].store(table, std::memory_order_release);  // owned from here on, even if the page is not
+  }
+  pages.push_back(make_page());
+  table[offset] = pages.back().get();  // readers only get here through a slot_count published after this
+  return *pages.back();
+}
+
+auto blackboard::copy_from(const blackboard& other) -> void {
+  index = other.index;
+  slot_count.store(other.slot_count.load());
+  generation.store(other.generation.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  live = other.live;
+  version.store(other.version.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  journal_floor = other.journal_floor;
+  journal = other.journal;
+  journal.reserve(journal_capacity);
+  journal_next = other.journal_next;
+  names = other.names;
+
+  for (const auto& source : other.pages) {
+    auto& target = add_page();
+    std::memcpy(target.cells.data(), source->cells.data(), sizeof(source->cells));  // inline values and types
+    target.versions = source->versions;
+    for (auto i = std::size_t{0}; i < page_size; ++i) {
+      if (source->boxed[i]) target.boxed[i] = source->boxed[i]->clone();
+    }
+  }
+}
+
+auto blackboard::find_slot(const std::string& key) const noexcept -> std::size_t {
+  auto it = index.find(key);
+  return it != index.end() ? it->second : npos;
+}
+
+auto blackboard::acquire_slot(const std::string& key) -> std::size_t {
+  if (auto it = index.find(key); it != index.end()) return it->second;
+
+  auto count = slot_count.load(std::memory_order_relaxed);
+  if (count == pages.size() * page_size) add_page();  // pages emptied by clear() are reused first
+  if (journal.capacity() < journal_capacity) journal.reserve(journal_capacity);
+  names.emplace_back(key);
+  index.emplace(key, count);
+  slot_count.store(count + 1, std::memory_order_release);  // publishes the page to lock-free readers
+  return count;
+}
+
+auto blackboard::contains(const std::string& key) const noexcept -> bool {
+  std::shared_lock lock(mtx);
+  auto slot = find_slot(key);
+  return slot != npos && cell_at(slot).present;
+}
+
+auto blackboard::remove(const std::string& key) -> void {
+  std::unique_lock lock(mtx);
+  auto slot = find_slot(key);
+  if (slot == npos || !cell_at(slot).present) return;
+
+  erase_at(slot);
+  lock.unlock();
+  notify(slot);
+}
+
+auto blackboard::erase_at(std::size_t slot) noexcept -> void {
+  auto guard = sequence_guard{sequence_at(slot)};
+  cell_at(slot).present = false;  // the slot stays reserved so resolved keys remain valid
+  boxed_at(slot).reset();
+  --live;
+  touch(slot);
 }
 
 auto blackboard::size() const noexcept -> size_t {
-  std::lock_guard lock(mtx);
-  return entries.size();
+  std::shared_lock lock(mtx);
+  return live;
 }
 
 auto blackboard::clear() noexcept -> void {
-  std::lock_guard lock(mtx);
-  entries.clear();
+  std::unique_lock lock(mtx);
+  // lock-free readers may still be in a page, so the slots are emptied in place rather than freed
+  generation.store(generation.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  for (auto slot = std::size_t{0}; slot < slot_count.load(std::memory_order_relaxed); ++slot) {
+    auto guard = sequence_guard{sequence_at(slot)};
+    auto& s = cell_at(slot);
+    s.type = nullptr;
+    s.present = false;
+    boxed_at(slot).reset();
+    version_at(slot) = 0;
+  }
+  index.clear();
+  slot_count.store(0, std::memory_order_release);
+  live = 0;
+  names.clear();
+  journal.clear();
+  journal_next = 0;
+  // versions keep counting up so older version numbers are never reused
+  journal_floor = version.load(std::memory_order_relaxed);
+  lock.unlock();
+
+  auto watch_lock = std::lock_guard(watch_mtx);
+  listeners.fetch_sub(watchers.size());
+  watchers.clear();
+  ++watch_epoch;
+  watch_changed.notify_all();
+}
+
+auto blackboard::reset() -> void {
+  std::unique_lock lock(mtx);
+  reset_values();
+  lock.unlock();
+  notify(npos);
+}
+
+auto blackboard::reset_values() noexcept -> void {
+  for (auto slot = std::size_t{0}; slot < slot_count.load(std::memory_order_relaxed); ++slot) {
+    auto& s = cell_at(slot);
+    if (!s.present) continue;
+
+    auto guard = sequence_guard{sequence_at(slot)};
+    s.present = false;
+    boxed_at(slot).reset();
+    touch(slot);
+  }
+  live = 0;
+}
+
+auto blackboard::touch(std::size_t slot) noexcept -> void {
+  auto next = version.load(std::memory_order_relaxed) + 1;  // writers are serialized, no read-modify-write needed
+  version.store(next, std::memory_order_release);
+  version_at(slot) = next;
+  if (journal.capacity() < journal_capacity) {  // nothing reserved yet (e.g. after a failed allocation)
+    journal_floor = next;
+  } else if (journal.size() < journal_capacity) {
+    journal.push_back({next, slot});
+  } else {
+    journal_floor = journal[journal_next].version;
+    journal[journal_next] = {next, slot};
+    journal_next = (journal_next + 1) % journal_capacity;
+  }
+}
+
+auto blackboard::get_version() const noexcept -> std::uint64_t { return version.load(std::memory_order_acquire); }
+
+auto blackboard::changes_since(std::uint64_t since) const -> std::vector<std::string> {
+  std::shared_lock lock(mtx);
+  auto slots = changed_slots(since);
+
+  auto result = std::vector<std::string>{};
+  result.reserve(slots.size());
+  for (auto slot : slots) result.emplace_back(names[slot]);
+  return result;
+}
+
+auto blackboard::changed_slots(std::uint64_t since) const -> std::vector<std::size_t> {
+  auto slots = std::vector<std::size_t>{};
+
+  if (since >= journal_floor) {
+    // newest first, stopping at the first entry that is not newer than since
+    for (auto i = std::size_t{0}; i < journal.size(); ++i) {
+      const auto& entry = journal[(journal_next + journal.size() - 1 - i) % journal.size()];
+      if (entry.version <= since) break;
+      slots.push_back(entry.slot);
+    }
+    std::sort(slots.begin(), slots.end());
+    slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
+  } else {
+    for (auto slot = std::size_t{0}; slot < slot_count.load(std::memory_order_relaxed); ++slot) {
+      if (version_at(slot) > since) slots.push_back(slot);
+    }
+  }
+  return slots;
+}
+
+auto blackboard::clone() const -> ptr {
+  std::shared_lock lock(mtx);
+  auto copy = std::make_shared<blackboard>();
+  copy->copy_from(*this);
+  return copy;
 }
 
 auto blackboard::serialize() const -> std::string {
-  std::lock_guard lock(mtx);
+  std::shared_lock lock(mtx);
   std::string result = "{";
-  for (const auto& [key, entry] : entries) {
-    result += "\"" + key + "\": \"" + entry->to_string() + "\", ";
+  for (const auto& [key, slot] : index) {
+    const auto& s = cell_at(slot);
+    if (!s.present) continue;
+
+    const auto& entry = boxed_at(slot);
+    auto value = entry ? entry->to_string() : s.type->to_string(s.storage);
+    result += "\"" + std::string{key} + "\": \"" + value + "\", ";
   }
   if (result.size() > 1) {
     result.pop_back();  // Remove last space
@@ -40,4 +248,282 @@ auto blackboard::serialize() const -> std::string {
   return result;
 }
 
-}  // namespace msm
\ No newline at end of file
+namespace {
+constexpr auto snapshot_magic = std::uint32_t{0x42534d4d};  // "MMSB"
+constexpr auto snapshot_version = std::uint32_t{1};
+constexpr auto removed_entry = std::uint32_t{0xffffffff};  // codec index of a key a delta snapshot removes
+}  // namespace
+
+auto blackboard::codecs() -> codec_registry& {
+  static auto registry = codec_registry{};
+  static const auto builtins = [] {
+    auto add = [](const entry_ops* type, codec entry) {
+      registry.by_name.emplace(entry.name, type);
+      registry.by_type.emplace(type, std::move(entry));
+    };
+    add(&ops_for<bool>, make_codec<bool>("bool"));
+    add(&ops_for<char>, make_codec<char>("char"));
+    add(&ops_for<int>, make_codec<int>("int"));
+    add(&ops_for<unsigned int>, make_codec<unsigned int>("unsigned int"));
+    add(&ops_for<long>, make_codec<long>("long"));
+    add(&ops_for<unsigned long>, make_codec<unsigned long>("unsigned long"));
+    add(&ops_for<long long>, make_codec<long long>("long long"));
+    add(&ops_for<unsigned long long>, make_codec<unsigned long long>("unsigned long long"));
+    add(&ops_for<float>, make_codec<float>("float"));
+    add(&ops_for<double>, make_codec<double>("double"));
+    add(&ops_for<std::string>, make_codec<std::string>("string"));
+    return true;
+  }();
+  static_cast<void>(builtins);
+  return registry;
+}
+
+auto blackboard::add_codec(const entry_ops* type, codec entry) -> void {
+  auto& registry = codecs();
+  auto lock = std::unique_lock(registry.mtx);
+  if (auto it = registry.by_name.find(entry.name); it != registry.by_name.end() && it->second != type) {
+    throw std::invalid_argument("Snapshot codec name already registered for another type: " + entry.name);
+  }
+  registry.by_name[entry.name] = type;
+  registry.by_type[type] = std::move(entry);
+}
+
+auto blackboard::watch(const std::string& key, watch_callback_t callback) -> watch_id {
+  auto slot = std::size_t{};
+  {
+    std::unique_lock lock(mtx);
+    slot = acquire_slot(key);
+  }
+
+  auto watch_lock = std::lock_guard(watch_mtx);
+  auto id = next_watch++;
+  watchers.push_back({id, slot, std::move(callback)});
+  listeners.fetch_add(1);
+  return id;
+}
+
+auto blackboard::unwatch(watch_id id) -> void {
+  auto watch_lock = std::lock_guard(watch_mtx);
+  auto it = std::find_if(watchers.begin(), watchers.end(), [id](const watcher& w) { return w.id == id; });
+  if (it == watchers.end()) return;
+  watchers.erase(it);
+  listeners.fetch_sub(1);
+}
+
+auto blackboard::add_waiter(const std::string& key) -> waiter {
+  auto registered = waiter{};
+  {
+    std::unique_lock lock(mtx);
+    registered = {acquire_slot(key), generation.load(std::memory_order_relaxed)};
+  }
+
+  auto watch_lock = std::lock_guard(watch_mtx);
+  waiting.push_back(registered.slot);
+  listeners.fetch_add(1);  // before the waiter first reads the value, so a racing set() notifies it
+  return registered;
+}
+
+auto blackboard::refresh_waiter(const std::string& key, waiter& registered) -> void {
+  auto fresh = waiter{};
+  {
+    std::unique_lock lock(mtx);
+    fresh = {acquire_slot(key), generation.load(std::memory_order_relaxed)};
+  }
+
+  auto watch_lock = std::lock_guard(watch_mtx);
+  if (auto it = std::find(waiting.begin(), waiting.end(), registered.slot); it != waiting.end()) *it = fresh.slot;
+  registered = fresh;
+}
+
+auto blackboard::remove_waiter(std::size_t slot) noexcept -> void {
+  auto watch_lock = std::lock_guard(watch_mtx);
+  if (auto it = std::find(waiting.begin(), waiting.end(), slot); it != waiting.end()) waiting.erase(it);
+  listeners.fetch_sub(1);
+}
+
+auto blackboard::wake_waiters() -> void {
+  auto watch_lock = std::lock_guard(watch_mtx);
+  ++watch_epoch;
+  watch_changed.notify_all();
+}
+
+auto blackboard::notify_listeners(std::size_t slot) -> void {
+  auto callbacks = std::vector<std::pair<watch_callback_t, std::size_t>>{};
+  {
+    auto watch_lock = std::lock_guard(watch_mtx);
+    if (slot == npos || std::find(waiting.begin(), waiting.end(), slot) != waiting.end()) {
+      ++watch_epoch;
+      watch_changed.notify_all();
+    }
+    for (const auto& w : watchers) {
+      if (slot == npos || w.slot == slot) callbacks.emplace_back(w.callback, w.slot);
+    }
+  }
+  if (callbacks.empty()) return;
+
+  for (const auto& [callback, watched] : callbacks) {
+    auto name = std::string{};
+    {
+      std::shared_lock lock(mtx);
+      if (watched < names.size()) name = names[watched];
+    }
+    callback(name);
+  }
+}
+
+struct blackboard::snapshot_plan {
+  struct entry {
+    std::string_view key;
+    std::size_t slot;
+    std::uint32_t codec_index;  // into used
+    std::size_t size;
+  };
+
+  std::vector<const codec*> used;
+  std::vector<entry> entries;
+  std::size_t bytes = 0;
+};
+
+// Layout: magic, version, codec count, codec names, entry count, then per entry its codec index, key name and
+// payload. Strings and payloads are prefixed with a 32-bit length. Delta snapshots mark removed keys with the
+// removed_entry codec index and an empty payload.
+auto blackboard::plan_snapshot(const codec_registry& registry, const std::vector<std::size_t>* slots) const
+    -> snapshot_plan {
+  auto plan = snapshot_plan{};
+  plan.entries.reserve(slots ? slots->size() : live);
+  plan.bytes = 4 * sizeof(std::uint32_t);
+
+  auto add = [&](std::string_view key, std::size_t slot) {
+    const auto& s = cell_at(slot);
+    if (!s.present) {
+      if (slots) {
+        plan.entries.push_back({key, slot, removed_entry, 0});
+        plan.bytes += 3 * sizeof(std::uint32_t) + key.size();
+      }
+      return;
+    }
+
+    auto it = registry.by_type.find(s.type);
+    if (it == registry.by_type.end()) {
+      throw std::runtime_error("No snapshot codec for blackboard entry: " + std::string{key});
+    }
+    auto position = std::find(plan.used.begin(), plan.used.end(), &it->second);
+    if (position == plan.used.end()) {
+      position = plan.used.insert(plan.used.end(), &it->second);
+      plan.bytes += sizeof(std::uint32_t) + it->second.name.size();
+    }
+
+    auto size = it->second.size(*this, slot);
+    plan.entries.push_back({key, slot, static_cast<std::uint32_t>(position - plan.used.begin()), size});
+    plan.bytes += 3 * sizeof(std::uint32_t) + key.size() + size;
+  };
+
+  if (slots) {
+    for (auto slot : *slots) add(names[slot], slot);
+  } else {
+    for (const auto& [key, slot] : index) add(key, slot);
+  }
+  return plan;
+}
+
+auto blackboard::write_snapshot(const snapshot_plan& plan, std::span<std::byte> buffer) const -> std::size_t {
+  auto writer = snapshot_writer{buffer};
+  writer.put(snapshot_magic);
+  writer.put(snapshot_version);
+  writer.put(static_cast<std::uint32_t>(plan.used.size()));
+  for (const auto* entry : plan.used) writer.put_string(entry->name);
+
+  writer.put(static_cast<std::uint32_t>(plan.entries.size()));
+  for (const auto& entry : plan.entries) {
+    writer.put(entry.codec_index);
+    writer.put_string(entry.key);
+    writer.put(static_cast<std::uint32_t>(entry.size));
+    if (entry.codec_index == removed_entry) continue;
+    plan.used[entry.codec_index]->encode(*this, entry.slot, writer.reserve(entry.size));
+  }
+  return writer.size();
+}
+
+auto blackboard::snapshot_size() const -> std::size_t {
+  auto& registry = codecs();
+  auto registry_lock = std::shared_lock(registry.mtx);  // registry before blackboard, as in read_snapshot()
+  std::shared_lock lock(mtx);
+  return plan_snapshot(registry).bytes;
+}
+
+auto blackboard::snapshot(std::span<std::byte> buffer) const -> std::size_t {
+  auto& registry = codecs();
+  auto registry_lock = std::shared_lock(registry.mtx);  // registry before blackboard, as in read_snapshot()
+  std::shared_lock lock(mtx);
+  return write_snapshot(plan_snapshot(registry), buffer);
+}
+
+auto blackboard::snapshot() const -> std::vector<std::byte> {
+  auto& registry = codecs();
+  auto registry_lock = std::shared_lock(registry.mtx);  // registry before blackboard, as in read_snapshot()
+  std::shared_lock lock(mtx);
+
+  auto plan = plan_snapshot(registry);
+  auto bytes = std::vector<std::byte>(plan.bytes);
+  write_snapshot(plan, bytes);
+  return bytes;
+}
+
+auto blackboard::snapshot_changes(std::uint64_t since) const -> std::vector<std::byte> {
+  auto& registry = codecs();
+  auto registry_lock = std::shared_lock(registry.mtx);  // registry before blackboard, as in read_snapshot()
+  std::shared_lock lock(mtx);
+
+  auto slots = changed_slots(since);
+  auto plan = plan_snapshot(registry, &slots);
+  auto bytes = std::vector<std::byte>(plan.bytes);
+  write_snapshot(plan, bytes);
+  return bytes;
+}
+
+auto blackboard::save(const std::string& path) const -> void { write_snapshot_file(path, snapshot()); }
+
+auto blackboard::restore(std::span<const std::byte> bytes) -> void { read_snapshot(bytes, false); }
+
+auto blackboard::apply(std::span<const std::byte> bytes) -> void { read_snapshot(bytes, true); }
+
+auto blackboard::read_snapshot(std::span<const std::byte> bytes, bool merge) -> void {
+  auto reader = snapshot_reader{bytes};
+  if (reader.get<std::uint32_t>() != snapshot_magic || reader.get<std::uint32_t>() != snapshot_version) {
+    throw std::runtime_error("Not a blackboard snapshot.");
+  }
+
+  auto& registry = codecs();
+  auto registry_lock = std::shared_lock(registry.mtx);
+
+  auto used = std::vector<const codec*>(reader.check_count(reader.get<std::uint32_t>(), sizeof(std::uint32_t)));
+  for (auto& entry : used) {
+    auto name = std::string{reader.get_string()};
+    auto it = registry.by_name.find(name);
+    if (it == registry.by_name.end()) throw std::runtime_error("No snapshot codec registered as: " + name);
+    entry = &registry.by_type.at(it->second);
+  }
+
+  std::unique_lock lock(mtx);
+  if (!merge) reset_values();
+  for (auto count = reader.get<std::uint32_t>(); count > 0; --count) {
+    auto codec_index = reader.get<std::uint32_t>();
+    auto key = std::string{reader.get_string()};
+    auto payload = reader.bytes(reader.get<std::uint32_t>());
+    if (codec_index >= used.size() && codec_index != removed_entry) {
+      throw std::runtime_error("Corrupt blackboard snapshot.");
+    }
+
+    auto slot = codec_index == removed_entry ? find_slot(key) : acquire_slot(key);
+    if (slot != npos && cell_at(slot).present) erase_at(slot);
+    if (codec_index != removed_entry) used[codec_index]->decode(*this, slot, payload);
+  }
+  lock.unlock();
+  notify(npos);
+}
+
+auto blackboard::load(const std::string& path) -> void {
+  auto file = mapped_file{path};
+  restore(file.bytes());
+}
+}  // namespace msm
@@ -0,0 +1,272 @@
+#include "definition.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+#include "snapshot.hpp"
+
+namespace msm {
+namespace {
+constexpr auto definition_magic = std::uint32_t{0x444d534d};  // "MSMD"
+constexpr auto definition_version = std::uint32_t{1};
+
+auto hash_text(std::string_view text) noexcept -> std::uint64_t {
+  auto hash = std::uint64_t{0xcbf29ce484222325};
+  for (auto c : text) hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3;
+  return hash;
+}
+
+auto as_text(std::span<const std::byte> bytes) noexcept -> std::string_view {
+  return {reinterpret_cast<const char*>(bytes.data()), bytes.size()};
+}
+
+// Header and state entries in graph order, then the graph
+auto write_binary(const machine_definition& definition, const msm_engine& engine, std::uint64_t source_hash)
+    -> std::vector<std::byte> {
+  const auto& graph = *engine.get_graph();
+  auto entries = std::unordered_map<std::string_view, const machine_definition::state_entry*>{};
+  entries.reserve(definition.states.size());
+  for (const auto& entry : definition.states) entries.try_emplace(entry.name, &entry);
+
+  auto run_timeout = std::find_if(definition.timeouts.rbegin(), definition.timeouts.rend(),
+                                  [](const auto& timeout) { return timeout.state.empty(); });
+
+  auto bytes = std::vector<std::byte>{};
+  auto writer = snapshot_builder{bytes};
+  writer.put(definition_magic);
+  writer.put(definition_version);
+  writer.put(source_hash);
+  writer.put(static_cast<std::uint32_t>(definition.outcomes.size()));
+  for (const auto& outcome : definition.outcomes) writer.put_string(outcome);
+  writer.put(static_cast<std::int64_t>(run_timeout == definition.timeouts.rend() ? 0 : run_timeout->budget.count()));
+  writer.put_string(run_timeout == definition.timeouts.rend() ? std::string_view{} : run_timeout->outcome);
+
+  writer.put(static_cast<std::uint32_t>(graph.state_count()));
+  for (auto id = compiled_graph::id_t{0}; id < static_cast<compiled_graph::id_t>(graph.state_count()); ++id) {
+    const auto& entry = *entries.at(graph.state_name(id));
+    writer.put_string(entry.type);
+    writer.put_string(entry.argument);
+    writer.put(static_cast<std::uint32_t>(entry.transitions.size()));
+    for (const auto& [outcome, target] : entry.transitions) {
+      writer.put_string(outcome);
+      writer.put_string(target);
+    }
+  }
+  graph.save(bytes);
+  return bytes;
+}
+}  // namespace
+
+auto state_registry::add(const std::string& type, factory_t factory) -> void {
+  this->factories.insert_or_assign(type, std::move(factory));
+}
+
+auto state_registry::add_callback(const std::string& type, const std::function<std::string(blackboard::ptr)>& callback,
+                                  const std::unordered_set<std::string>& outcomes) -> void {
+  this->add(type, [callback, outcomes](std::string_view) -> msm_state::ptr {
+    return std::make_shared<callback_state>(callback, outcomes);
+  });
+}
+
+auto state_registry::create(const std::string& type, std::string_view argument) const -> msm_state::ptr {
+  auto it = this->factories.find(type);
+  if (it == this->factories.end()) throw std::runtime_error("No state factory registered for type '" + type + "'.");
+
+  auto state = it->second(argument);
+  if (!state) throw std::runtime_error("State factory for type '" + type + "' returned no state.");
+  return state;
+}
+
+auto machine_definition::parse(std::string_view text) -> machine_definition {
+  auto definition = machine_definition{};
+  auto line_number = std::size_t{0};
+  auto fail = [&line_number](const std::string& message) {
+    return std::runtime_error("Machine definition, line " + std::to_string(line_number) + ": " + message);
+  };
+  auto milliseconds = [&fail](std::string_view token) -> std::chrono::nanoseconds {
+    auto value = std::int64_t{0};
+    auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+    if (error != std::errc{} || end != token.data() + token.size() || value <= 0) {
+      throw fail("invalid duration '" + std::string{token} + "'");
+    }
+    return std::chrono::milliseconds{value};
+  };
+
+  auto tokens = std::vector<std::string_view>{};
+  while (!text.empty()) {
+    ++line_number;
+    auto line = text.substr(0, text.find('\n'));
+    text.remove_prefix(std::min(text.size(), line.size() + 1));
+    line = line.substr(0, line.find('#'));
+
+    tokens.clear();
+    for (auto begin = line.find_first_not_of(" \t\r"); begin != std::string_view::npos;
+         begin = line.find_first_not_of(" \t\r", begin)) {
+      auto end = std::min(line.find_first_of(" \t\r", begin), line.size());
+      tokens.push_back(line.substr(begin, end - begin));
+      begin = end;
+    }
+    if (tokens.empty()) continue;
+
+    const auto keyword = tokens.front();
+    if (keyword == "outcomes" && tokens.size() >= 2) {
+      definition.outcomes.insert(definition.outcomes.end(), tokens.begin() + 1, tokens.end());
+    } else if (keyword == "initial" && tokens.size() == 2) {
+      definition.initial = tokens[1];
+    } else if (keyword == "timeout" && (tokens.size() == 3 || tokens.size() == 4)) {
+      definition.timeouts.push_back(timeout_entry{tokens.size() == 4 ? std::string{tokens[3]} : std::string{},
+                                                  milliseconds(tokens[1]), std::string{tokens[2]}});
+    } else if (keyword == "state" && tokens.size() >= 3) {
+      auto& entry = definition.states.emplace_back();
+      entry.name = tokens[1];
+      auto colon = tokens[2].find(':');
+      entry.type = tokens[2].substr(0, colon);
+      if (colon != std::string_view::npos) entry.argument = tokens[2].substr(colon + 1);
+      if (entry.type.empty()) throw fail("state '" + entry.name + "' has no type");
+
+      entry.transitions.reserve(tokens.size() - 3);
+      for (auto i = std::size_t{3}; i < tokens.size(); ++i) {
+        auto equals = tokens[i].find('=');
+        if (equals == 0 || equals == std::string_view::npos || equals + 1 == tokens[i].size()) {
+          throw fail("expected <outcome>=<target> instead of '" + std::string{tokens[i]} + "'");
+        }
+        entry.transitions.emplace_back(tokens[i].substr(0, equals), tokens[i].substr(equals + 1));
+      }
+    } else {
+      throw fail("cannot read '" + std::string{keyword} + "' declaration");
+    }
+  }
+  return definition;
+}
+
+auto machine_definition::build(const state_registry& registry) const -> std::shared_ptr<msm_engine> {
+  if (this->outcomes.empty() || this->states.empty()) {
+    throw std::runtime_error("Machine definition needs outcomes and at least one state.");
+  }
+
+  // fills the engine's maps directly: one allocation per state instead of add_state()'s copies and checks per call
+  auto engine = std::make_shared<msm_engine>(std::unordered_set<std::string>{outcomes.begin(), outcomes.end()});
+  engine->states.reserve(this->states.size());
+  engine->transitions.reserve(this->states.size());
+  for (const auto& entry : this->states) {
+    if (engine->get_outcome_set().find(entry.name) != engine->get_outcome_set().end()) {
+      throw std::runtime_error("Machine definition: state '" + entry.name + "' is named like an outcome.");
+    }
+
+    auto state = registry.create(entry.type, entry.argument);
+    auto transitions = compiled_graph::transition_table{engine->transitions.get_allocator()};
+    transitions.reserve(entry.transitions.size());
+    for (const auto& [outcome, target] : entry.transitions) {
+      if (state->get_outcome_set().find(outcome) == state->get_outcome_set().end()) {
+        throw std::runtime_error("Machine definition: state '" + entry.name + "' has no outcome '" + outcome + "'.");
+      }
+      transitions.insert_or_assign(std::pmr::string{outcome, transitions.get_allocator()}, target);
+    }
+
+    if (!engine->states.emplace(entry.name, std::move(state)).second) {
+      throw std::runtime_error("Machine definition: state '" + entry.name + "' is declared twice.");
+    }
+    engine->transitions.emplace(entry.name, std::move(transitions));
+  }
+  engine->initial_state = this->initial.empty() ? this->states.front().name : this->initial;
+
+  for (const auto& timeout : this->timeouts) {
+    if (timeout.state.empty()) {
+      engine->set_timeout(timeout.budget, timeout.outcome);
+    } else {
+      engine->set_state_timeout(timeout.state, timeout.budget, timeout.outcome);
+    }
+  }
+  engine->validate();
+  return engine;
+}
+
+auto machine_definition::compile(const state_registry& registry, std::uint64_t source_hash) const
+    -> std::vector<std::byte> {
+  return write_binary(*this, *this->build(registry), source_hash);
+}
+
+auto machine_definition::load(std::span<const std::byte> binary, const state_registry& registry)
+    -> std::shared_ptr<msm_engine> {
+  auto in = snapshot_reader{binary};
+  if (binary.size() < 2 * sizeof(std::uint32_t) || in.get<std::uint32_t>() != definition_magic ||
+      in.get<std::uint32_t>() != definition_version) {
+    throw std::runtime_error("Not a compiled machine definition.");
+  }
+  in.get<std::uint64_t>();  // source hash, see load_cached()
+
+  auto final_outcomes = std::unordered_set<std::string>{};
+  for (auto count = in.get<std::uint32_t>(); count > 0; --count) final_outcomes.emplace(in.get_string());
+  if (final_outcomes.empty()) throw std::runtime_error("Compiled machine definition has no outcomes.");
+  auto engine = std::make_shared<msm_engine>(final_outcomes);
+  auto run_budget = std::chrono::nanoseconds{in.get<std::int64_t>()};
+  auto run_outcome = std::string{in.get_string()};
+
+  // every state entry has at least its type, argument and transition count
+  auto count = in.check_count(in.get<std::uint32_t>(), 3 * sizeof(std::uint32_t));
+  auto states = std::vector<msm_state::ptr>{};
+  auto transitions = std::vector<compiled_graph::transition_table>(count);
+  states.reserve(count);
+  for (auto id = std::size_t{0}; id < count; ++id) {
+    auto type = std::string{in.get_string()};
+    states.push_back(registry.create(type, in.get_string()));
+    for (auto left = in.get<std::uint32_t>(); left > 0; --left) {
+      auto outcome = std::pmr::string{in.get_string()};
+      transitions[id].insert_or_assign(std::move(outcome), in.get_string());
+    }
+  }
+  auto graph = compiled_graph::load(in, states, engine.get());
+
+  // the engine gets the same maps build() would have made, so later add_state() calls revalidate as usual
+  engine->states.reserve(count);
+  engine->transitions.reserve(count);
+  for (auto id = compiled_graph::id_t{0}; id < static_cast<compiled_graph::id_t>(count); ++id) {
+    const auto& name = graph->state_name(id);
+    engine->states.emplace(name, std::move(states[id]));
+    engine->transitions.emplace(name, std::move(transitions[id]));
+    if (const auto& limit = graph->state_timeout(id); limit.budget.count() > 0) {
+      engine->state_timeouts.try_emplace(name, limit.budget, graph->outcome_name(limit.outcome));
+    }
+  }
+  engine->initial_state = graph->state_name(graph->initial_state());
+  if (run_budget.count() > 0) engine->set_timeout(run_budget, run_outcome);
+  engine->graph = std::move(graph);
+  engine->is_valid.store(true);
+  return engine;
+}
+
+auto machine_definition::load_file(const std::string& path, const state_registry& registry)
+    -> std::shared_ptr<msm_engine> {
+  auto file = mapped_file{path};
+  auto bytes = file.bytes();
+  auto magic = std::uint32_t{0};
+  if (bytes.size() >= sizeof(magic)) std::memcpy(&magic, bytes.data(), sizeof(magic));
+  if (magic == definition_magic) return load(bytes, registry);
+  return parse(as_text(bytes)).build(registry);
+}
+
+auto machine_definition::load_cached(const std::string& path, const std::string& cache_path,
+                                     const state_registry& registry) -> std::shared_ptr<msm_engine> {
+  auto source = mapped_file{path};
+  auto text = as_text(source.bytes());
+  auto source_hash = hash_text(text);
+  try {
+    auto cache = mapped_file{cache_path};
+    auto in = snapshot_reader{cache.bytes()};
+    if (in.get<std::uint32_t>() == definition_magic && in.get<std::uint32_t>() == definition_version &&
+        in.get<std::uint64_t>() == source_hash) {
+      return load(cache.bytes(), registry);
+    }
+  } catch (const std::runtime_error&) {
+    // no cache yet, or one the registry no longer matches: rebuild it below
+  }
+
+  auto definition = parse(text);
+  auto engine = definition.build(registry);
+  // a registry state that is itself an engine gets flattened in, and such a graph has no binary form to cache
+  if (engine->get_graph()->savable()) write_snapshot_file(cache_path, write_binary(definition, *engine, source_hash));
+  return engine;
+}
+}  // namespace msm
@@ -3,12 +3,19 @@
 #include <sstream>
 #include <stdexcept>
 
+#include "recorder.hpp"
+#include "trace.hpp"
+
 namespace msm {
-msm_engine::msm_engine(const std::unordered_set<std::string>& outcomes) : msm_state{outcomes}, is_valid{false} {
-  current_state_mtx = std::make_unique<std::mutex>();
-}
+msm_engine::msm_engine(const std::unordered_set<std::string>& outcomes)
+    : msm_engine{outcomes, allocator_type{std::pmr::get_default_resource()}} {}
 
-msm_engine::msm_engine() : msm_engine(std::unordered_set<std::string>{}) {}
+msm_engine::msm_engine(const std::unordered_set<std::string>& outcomes, const allocator_type& allocator)
+    : async_state{outcomes, allocator},
+      states{allocator},
+      transitions{allocator},
+      current_state{compiled_graph::npos},
+      is_valid{false} {}
 
 auto msm_engine::add_state(const std::string& name, msm_state::ptr state,
                            const std::unordered_map<std::string, std::string>& transitions_) -> void {
@@ -18,12 +25,13 @@ auto msm_engine::add_state(const std::string& name, msm_state::ptr state,
   for (const auto& [source, target] : transitions_) {
     if (source.empty() || target.empty())
       throw std::invalid_argument("Transition source and target names cannot be empty strings.");
-    if (state->get_outcomes().find(source) == state->get_outcomes().end())
+    if (state->get_outcome_set().find(source) == state->get_outcome_set().end())
       throw std::invalid_argument("State " + name + " references invalid outcome");
   }
 
-  this->states.try_emplace(name, state);
-  this->transitions.try_emplace(name, transitions_);
+  this->states.emplace(name, state);
+  auto& table = this->transitions.emplace(name, compiled_graph::transition_table{}).first->second;
+  for (const auto& [outcome, target] : transitions_) table.emplace(outcome, target);
 
   if (this->initial_state.empty()) this->initial_state = name;  // Set the first added state as initial state by default
 
@@ -41,17 +49,125 @@ auto msm_engine::set_initial_state(const std::string& name) -> void {
 auto msm_engine::get_initial_state() const -> std::string { return this->initial_state; }
 
 auto msm_engine::get_current_state() const -> std::string {
-  std::lock_guard<std::mutex> lock{*this->current_state_mtx};
-  return this->current_state;
+  auto current = this->current_state.load();
+  if (current == compiled_graph::npos || !this->graph) return {};
+  return this->graph->state_name(current);
 }
 
-auto msm_engine::get_states() const -> const std::unordered_map<std::string, msm_state::ptr>& { return this->states; }
+auto msm_engine::get_states() const -> std::unordered_map<std::string, msm_state::ptr> {
+  auto result = std::unordered_map<std::string, msm_state::ptr>{};
+  result.reserve(this->states.size());
+  for (const auto& [name, state] : this->states) result.emplace(name, state);
+  return result;
+}
 
 auto msm_engine::get_transitions(const std::string& state) const
-    -> const std::unordered_map<std::string, std::unordered_map<std::string, std::string>>& {
+    -> std::unordered_map<std::string, std::unordered_map<std::string, std::string>> {
+  auto result = std::unordered_map<std::string, std::unordered_map<std::string, std::string>>{};
+  result.reserve(this->transitions.size());
+  for (const auto& [name, table] : this->transitions) {
+    auto& copy = result[std::string{name}];
+    for (const auto& [outcome, target] : table) copy.emplace(outcome, target);
+  }
+  return result;
+}
+
+auto msm_engine::get_state_table() const noexcept -> const compiled_graph::state_table& { return this->states; }
+
+auto msm_engine::get_transition_tables() const noexcept -> const compiled_graph::transition_tables& {
   return this->transitions;
 }
 
+auto msm_engine::get_graph() const noexcept -> compiled_graph::ptr { return this->graph; }
+
+auto msm_engine::set_recorder(std::shared_ptr<recorder> log) -> void { this->run_recorder = std::move(log); }
+
+auto msm_engine::get_recorder() const noexcept -> const std::shared_ptr<recorder>& { return this->run_recorder; }
+
+auto msm_engine::set_state_timeout(const std::string& name, std::chrono::nanoseconds budget,
+                                   const std::string& outcome) -> void {
+  auto it = this->states.find(name);
+  if (it == this->states.end()) {
+    throw std::invalid_argument("Cannot set a timeout for '" + name + "': state not found in state machine.");
+  }
+
+  if (budget.count() <= 0) {
+    this->state_timeouts.erase(name);
+  } else if (it->second->get_outcome_set().find(outcome) == it->second->get_outcome_set().end()) {
+    throw std::invalid_argument("Timeout outcome '" + outcome + "' is not an outcome of state '" + name + "'.");
+  } else {
+    this->state_timeouts[name] = {budget, outcome};
+  }
+  this->is_valid.store(false);
+}
+
+auto msm_engine::set_timeout(std::chrono::nanoseconds budget, const std::string& outcome) -> void {
+  if (budget.count() > 0 && this->outcomes.find(outcome) == this->outcomes.end()) {
+    throw std::invalid_argument("Timeout outcome '" + outcome + "' is not an outcome of the state machine.");
+  }
+
+  this->run_budget = std::max(budget, std::chrono::nanoseconds{0});
+  this->run_timeout_outcome = budget.count() > 0 ? outcome : std::string{};
+  this->is_valid.store(false);  // engines around this one flatten it only without a budget
+}
+
+auto msm_engine::get_timeout() const noexcept -> std::chrono::nanoseconds { return this->run_budget; }
+
+msm_engine::deadline_timer::deadline_timer(msm_state* state_, clock::time_point deadline_)
+    : state{state_}, deadline{deadline_} {
+  if (this->deadline == clock::time_point::max()) return;
+
+  this->state->set_deadline(this->deadline);
+  this->id = timer_wheel::shared()->schedule(this->deadline, [this] {
+    this->fired.store(true);
+    this->state->cancel();
+  });
+}
+
+auto msm_engine::deadline_timer::disarm() -> void {
+  if (this->id == 0) return;
+  timer_wheel::shared()->cancel(this->id);  // waits for a callback that is running
+  this->id = 0;
+  this->state->set_deadline(clock::time_point::max());
+}
+
+auto msm_engine::deadline_timer::expired() -> bool {
+  if (this->deadline == clock::time_point::max()) return false;
+  this->disarm();
+  return this->fired.load() || clock::now() >= this->deadline;
+}
+
+auto msm_engine::run_deadline() const -> clock::time_point {
+  auto deadline = this->get_deadline();
+  if (this->run_budget.count() > 0) {
+    deadline = std::min(deadline, clock::now() + std::chrono::duration_cast<clock::duration>(this->run_budget));
+  }
+  return deadline;
+}
+
+auto msm_engine::deadline_of(const compiled_graph& graph, compiled_graph::id_t state, clock::time_point run_deadline)
+    -> clock::time_point {
+  auto budget = graph.state_timeout(state).budget;
+  if (budget.count() == 0) return run_deadline;
+  return std::min(run_deadline, clock::now() + std::chrono::duration_cast<clock::duration>(budget));
+}
+
+auto msm_engine::time_out(const compiled_graph& graph, const blackboard::ptr& bb, compiled_graph::id_t current)
+    -> std::string {
+  this->current_state.store(compiled_graph::npos);
+  if (this->run_timeout_outcome.empty()) {
+    throw std::runtime_error("State machine execution timed out in state '" + graph.state_name(current) + "'.");
+  }
+
+  this->invoke_end_callbacks(bb, this->run_timeout_outcome);
+  if (!this->end_hooks.empty()) {
+    invoke_hooks(this->end_hooks, bb,
+                 hook_event{graph, {}, {}, this->run_timeout_outcome, graph.find_outcome(this->run_timeout_outcome)},
+                 "end");
+  }
+  return this->run_timeout_outcome;
+}
+
 auto msm_engine::add_start_callback(start_callback_t callback, const std::vector<std::string>& args) -> void {
   this->start_callbacks.emplace_back(callback, args);
 }
@@ -64,7 +180,75 @@ auto msm_engine::add_transition_callback(transition_callback_t callback, const s
   this->transition_callbacks.emplace_back(callback, args);
 }
 
+auto msm_engine::add_transition_callback(delta_transition_callback_t callback, const std::vector<std::string>& args)
+    -> void {
+  this->delta_transition_callbacks.emplace_back(callback, args);
+}
+
+auto msm_engine::has_delta_transition_callbacks() const noexcept -> bool {
+  return !this->delta_transition_callbacks.empty();
+}
+
+auto msm_engine::tracks_writes(const compiled_graph& graph, const recorder* log) -> bool {
+  if (log && log->records_blackboard()) return true;
+  for (auto s = std::size_t{0}; s < graph.scope_count(); ++s) {
+    if (graph.get_scope(static_cast<compiled_graph::id_t>(s)).engine->has_delta_transition_callbacks()) return true;
+  }
+  return false;
+}
+
+auto msm_engine::run_steps(const compiled_graph& graph, const blackboard::ptr& bb, std::size_t first,
+                           std::size_t last, std::optional<std::uint64_t> since) -> void {
+  for (auto i = first; i < last; ++i) {
+    const auto& step = graph.get_step(i);
+    auto* engine = graph.get_scope(step.scope).engine;
+    switch (step.type) {
+      case compiled_graph::step::kind::start:
+        engine->invoke_start_callbacks(bb, graph.label(step.to));
+        if (!engine->start_hooks.empty()) {
+          invoke_hooks(engine->start_hooks, bb, hook_event{graph, {}, graph.label(step.to), {}, compiled_graph::npos},
+                       "start");
+        }
+        break;
+      case compiled_graph::step::kind::transition:
+        engine->invoke_transition_callbacks(bb, graph.label(step.from), graph.label(step.to),
+                                            graph.outcome_name(step.outcome), since);
+        if (!engine->transition_hooks.empty()) {
+          invoke_hooks(engine->transition_hooks, bb,
+                       hook_event{graph, graph.label(step.from), graph.label(step.to),
+                                  graph.outcome_name(step.outcome), step.outcome},
+                       "transition");
+        }
+        break;
+      case compiled_graph::step::kind::end:
+        engine->invoke_end_callbacks(bb, graph.outcome_name(step.outcome));
+        if (!engine->end_hooks.empty()) {
+          invoke_hooks(engine->end_hooks, bb, hook_event{graph, {}, {}, graph.outcome_name(step.outcome), step.outcome},
+                       "end");
+        }
+        break;
+    }
+  }
+}
+
+auto msm_engine::invoke_hooks(const std::vector<hook_t>& hooks, const blackboard::ptr& bb, const hook_event& event,
+                              const char* kind) -> void {
+  MSM_TRACE_SCOPE(callback, MSM_TRACE_NAME("hooks"));
+  try {
+    for (const auto& hook : hooks) hook(bb, event);
+  } catch (const std::exception& e) {
+    throw std::runtime_error(std::string("Error invoking ") + kind + " hooks: " + e.what());
+  }
+}
+
+auto msm_engine::add_start_hook(hook_t hook) -> void { this->start_hooks.push_back(std::move(hook)); }
+
+auto msm_engine::add_transition_hook(hook_t hook) -> void { this->transition_hooks.push_back(std::move(hook)); }
+
+auto msm_engine::add_end_hook(hook_t hook) -> void { this->end_hooks.push_back(std::move(hook)); }
+
 auto msm_engine::invoke_start_callbacks(blackboard::ptr bb, const std::string& initial_state) -> void {
+  MSM_TRACE_SCOPE(callback, MSM_TRACE_NAME("start callbacks"));
   try {
     for (const auto& [callback, args] : this->start_callbacks) {
       callback(bb, initial_state, args);
@@ -75,6 +259,7 @@ auto msm_engine::invoke_start_callbacks(blackboard::ptr bb, const std::string& i
 }
 
 auto msm_engine::invoke_end_callbacks(blackboard::ptr bb, const std::string& outcome) -> void {
+  MSM_TRACE_SCOPE(callback, MSM_TRACE_NAME("end callbacks"));
   try {
     for (const auto& [callback, args] : this->end_callbacks) {
       callback(bb, outcome, args);
@@ -85,60 +270,345 @@ auto msm_engine::invoke_end_callbacks(blackboard::ptr bb, const std::string& out
 }
 
 auto msm_engine::invoke_transition_callbacks(blackboard::ptr bb, const std::string& from_state,
-                                             const std::string& to_state, const std::string& outcome) -> void {
+                                             const std::string& to_state, const std::string& outcome,
+                                             std::optional<std::uint64_t> since) -> void {
+  MSM_TRACE_SCOPE(callback, MSM_TRACE_NAME("transition callbacks"));
   try {
     for (const auto& [callback, args] : this->transition_callbacks) {
       callback(bb, from_state, to_state, outcome, args);
     }
+    if (!this->delta_transition_callbacks.empty()) {
+      auto written = since ? bb->changes_since(*since) : std::vector<std::string>{};
+      for (const auto& [callback, args] : this->delta_transition_callbacks) {
+        callback(bb, from_state, to_state, outcome, written, args);
+      }
+    }
   } catch (const std::exception& e) {
     throw std::runtime_error(std::string("Error invoking transition callbacks: ") + e.what());
   }
 }
 
-auto msm_engine::validate(bool forced = false) -> void {
-  if (!forced && this->is_valid.load()) return;
+auto msm_engine::subgraphs_changed() -> bool {
+  const auto& graph = *this->graph;
+  auto changed = false;
+  for (auto s = compiled_graph::id_t{1}; s < static_cast<compiled_graph::id_t>(graph.scope_count()); ++s) {
+    const auto& scope = graph.get_scope(s);
+    if (scope.parent != 0) continue;  // checked by its own parent
+    scope.engine->validate();
+    changed = changed || scope.engine->get_graph() != scope.source;
+  }
+  return changed;
+}
+
+auto msm_engine::validate(bool forced) -> void {
+  if (!forced && this->is_valid.load() && !this->subgraphs_changed()) return;
 
-  // Check that initial state is set and valid
-  if (this->initial_state.empty() || this->states.find(this->initial_state) == this->states.end()) {
-    throw std::runtime_error("State machine validation failed: initial state is not set or invalid.");
+  // recursively validate nested states if they are state machines
+  for (const auto& [_, state] : this->states) {
+    if (auto nested = std::dynamic_pointer_cast<msm_engine>(state)) nested->validate(forced);
   }
 
-  auto final_outcomes = std::unordered_set<std::string>{};
-  for (const auto& [name, state] : this->states) {
-    const auto& state_transitions = this->transitions[name];
-    const auto& state_outcomes = state->get_outcomes();
+  this->graph = compiled_graph::compile(this->states, this->transitions, this->initial_state, this->get_outcome_set(),
+                                        forced, this, this->state_timeouts);
+  this->is_valid.store(true);  // Mark the state machine as valid
+}
+
+auto msm_engine::execute() -> std::string { return this->execute(std::make_shared<blackboard>()); }
+
+auto msm_engine::advance(const blackboard::ptr& bb, compiled_graph::id_t current, const std::string& result,
+                         std::optional<std::uint64_t> since, recorder* log) -> compiled_graph::id_t {
+  const auto& graph = *this->graph;
 
-    if (forced) {
-      for (const auto& out : state_outcomes) {
-        if (transitions.find(out) == transitions.end() &&
-            this->get_outcomes().find(out) == this->get_outcomes().end()) {
-          throw std::runtime_error("State machine validation failed: outcome '" + out + "' of state '" + name +
-                                   "' is neither a valid transition nor a final outcome.");
-        } else if (this->get_outcomes().find(out) != this->get_outcomes().end()) {
-          final_outcomes.insert(out);  // outcome is a final outcome of the state machine
+  auto edge = graph.find_edge(current, result);
+  if (edge == compiled_graph::npos) {
+    throw std::logic_error("Invalid outcome: " + result + " from state: " + graph.state(current)->to_string());
+  }
+  if (log) {
+    log->record_step(current, graph.edge_outcome(edge));
+    if (since && log->records_blackboard()) log->record_writes(*bb, *since);
+  }
+
+  auto target = graph.edge_target(edge);
+  if (target == compiled_graph::unmapped) {
+    throw std::runtime_error("State machine execution failed: outcome '" + result + "' of state '" +
+                             graph.state_name(current) + "' has no transition.");
+  }
+
+  if (compiled_graph::is_terminal(target)) {
+    MSM_TRACE_INSTANT(transition, graph.state_trace_id(current),
+                      graph.outcome_trace_id(compiled_graph::terminal_outcome(target)));
+    run_steps(graph, bb, graph.step_begin(edge), graph.step_end(edge), since);
+    this->current_state.store(compiled_graph::npos);
+    return target;
+  }
+
+  if (this->is_cancelled()) {
+    throw std::runtime_error("State machine execution cancelled in state '" + graph.state_name(current) + "'.");
+  }
+
+  MSM_TRACE_INSTANT(transition, graph.state_trace_id(current), graph.state_trace_id(target));
+  run_steps(graph, bb, graph.step_begin(edge), graph.step_end(edge), since);
+  this->current_state.store(target);
+  return target;
+}
+
+auto msm_engine::execute(blackboard::ptr bb) -> std::string {
+  this->validate();
+
+  const auto& graph = *this->graph;  // keep a reference so the loop never touches the shared_ptr
+  auto current = this->take_resume_state(graph);
+  auto resuming = current != compiled_graph::npos;
+  if (!resuming) current = graph.initial_state();
+  this->current_state.store(current);
+
+  auto log = resuming ? nullptr : this->run_recorder;
+  const auto run_deadline = this->run_deadline();
+  try {
+    if (log) log->begin_run(graph, *bb);
+    if (!resuming) run_steps(graph, bb, graph.entry_begin(), graph.entry_end(), std::nullopt);
+
+    const auto tracked = tracks_writes(graph, log.get());
+    while (!compiled_graph::is_terminal(current)) {
+      auto since = written_since(tracked, bb);
+      auto result = std::string{};
+      auto deadline = deadline_of(graph, current, run_deadline);
+      auto timer = deadline_timer{graph.state(current), deadline};
+      try {
+        MSM_TRACE_SCOPE(state, graph.state_trace_id(current));
+        result = graph.state(current)->invoke(bb);
+      } catch (...) {
+        if (!timer.expired()) throw;  // a state that gives up by throwing once cancelled has timed out
+      }
+      if (timer.expired()) {
+        if (deadline == run_deadline) {
+          auto outcome = this->time_out(graph, bb, current);
+          if (log) log->end_run(compiled_graph::npos);
+          return outcome;
         }
+        result = graph.outcome_name(graph.state_timeout(current).outcome);
       }
+      current = this->advance(bb, current, result, since, log.get());
     }
+    if (log) log->end_run(compiled_graph::terminal_outcome(current));
+    return graph.outcome_name(compiled_graph::terminal_outcome(current));
+  } catch (...) {
+    if (log) log->end_run(compiled_graph::npos);
+    this->current_state.store(compiled_graph::npos);
+    throw;
+  }
+}
 
-    // recursively validate nested states if they are state machines
-    if (std::dynamic_pointer_cast<msm_engine>(state)) {
-      std::dynamic_pointer_cast<msm_engine>(state)->validate(forced);
-    }
+auto msm_engine::execute_async(blackboard::ptr bb) -> task<std::string> {
+  this->validate();
+
+  const auto graph = this->graph;  // held by the coroutine frame for the whole run
+  auto current = this->take_resume_state(*graph);
+  auto resuming = current != compiled_graph::npos;
+  if (!resuming) current = graph->initial_state();
+  this->current_state.store(current);
 
-    for (const auto& [_, target_state] : state_transitions) {
-      final_outcomes.insert(target_state);  // outcome is a transition to another state
+  auto log = resuming ? nullptr : this->run_recorder;
+  const auto run_deadline = this->run_deadline();
+  try {
+    if (log) log->begin_run(*graph, *bb);
+    if (!resuming) run_steps(*graph, bb, graph->entry_begin(), graph->entry_end(), std::nullopt);
+
+    const auto tracked = tracks_writes(*graph, log.get());
+    while (!compiled_graph::is_terminal(current)) {
+      auto* state = graph->state(current);
+      auto since = written_since(tracked, bb);
+      auto result = std::string{};
+      auto deadline = deadline_of(*graph, current, run_deadline);
+      auto timer = deadline_timer{state, deadline};
+      try {
+        MSM_TRACE_SCOPE(state, graph->state_trace_id(current));
+        if (graph->is_async(current)) {
+          result = co_await static_cast<async_state*>(state)->invoke_async(bb);
+        } else {
+          result = state->invoke(bb);
+        }
+      } catch (...) {
+        if (!timer.expired()) throw;
+      }
+      if (timer.expired()) {
+        if (deadline == run_deadline) {
+          auto outcome = this->time_out(*graph, bb, current);
+          if (log) log->end_run(compiled_graph::npos);
+          co_return outcome;
+        }
+        result = graph->outcome_name(graph->state_timeout(current).outcome);
+      }
+      current = this->advance(bb, current, result, since, log.get());
     }
+    if (log) log->end_run(compiled_graph::terminal_outcome(current));
+  } catch (...) {
+    if (log) log->end_run(compiled_graph::npos);
+    this->current_state.store(compiled_graph::npos);
+    throw;
   }
+  co_return graph->outcome_name(compiled_graph::terminal_outcome(current));
+}
+
+namespace {
+constexpr auto snapshot_magic = std::uint32_t{0x45534d4d};  // "MMSE"
+constexpr auto snapshot_version = std::uint32_t{1};
+}  // namespace
+
+auto msm_engine::snapshot() const -> std::vector<std::byte> {
+  auto current = this->current_state.load();
+  auto path = current == compiled_graph::npos || !this->graph ? std::vector<std::string>{}
+                                                                 : this->graph->state_path(current);
+
+  auto bytes = 3 * sizeof(std::uint32_t);
+  for (const auto& name : path) bytes += sizeof(std::uint32_t) + name.size();
+
+  auto result = std::vector<std::byte>(bytes);
+  auto writer = snapshot_writer{result};
+  writer.put(snapshot_magic);
+  writer.put(snapshot_version);
+  writer.put(static_cast<std::uint32_t>(path.size()));
+  for (const auto& name : path) writer.put_string(name);
+  return result;
+}
+
+auto msm_engine::restore(std::span<const std::byte> bytes) -> void {
+  auto reader = snapshot_reader{bytes};
+  if (reader.get<std::uint32_t>() != snapshot_magic || reader.get<std::uint32_t>() != snapshot_version) {
+    throw std::runtime_error("Not a state machine snapshot.");
+  }
+
+  // the path names a state of the flattened graph, one level of nesting per name
+  auto name = std::string{};
+  for (auto depth = reader.get<std::uint32_t>(); depth > 0; --depth) {
+    if (!name.empty()) name += '/';
+    name += reader.get_string();
+  }
+  if (name.empty()) return;
+
+  this->validate();
+  auto state = this->graph->find_state(name);
+  if (state == compiled_graph::npos) throw std::runtime_error("Snapshot state not found: " + name);
 
-  auto msm_outcome_set = std::unordered_set<std::string>{this->get_outcomes().begin(), this->get_outcomes().end()};
-  for (const auto& out : final_outcomes) {
-    if (msm_outcome_set.find(out) == msm_outcome_set.end()) {
-      throw std::runtime_error("State machine validation failed: outcome '" + out +
-                               "' is neither a valid transition nor a final outcome of the state machine.");
+  this->resume_graph = this->graph;
+  this->resume_state.store(state);
+  this->current_state.store(state);
+}
+
+auto msm_engine::take_resume_state(const compiled_graph& graph) -> compiled_graph::id_t {
+  auto state = this->resume_state.exchange(compiled_graph::npos);
+  auto saved = std::move(this->resume_graph);
+  if (state == compiled_graph::npos || saved.get() == &graph) return state;
+
+  // recompiled since restore(): ids are renumbered, so find the state again by its path
+  const auto& name = saved->state_name(state);
+  state = graph.find_state(name);
+  if (state == compiled_graph::npos) throw std::runtime_error("Snapshot state not found: " + name);
+  return state;
+}
+
+auto msm_engine::start_events(blackboard::ptr bb, std::size_t capacity) -> void {
+  this->validate();
+
+  auto* queue = this->event_queue.load(std::memory_order_relaxed);  // only the consumer thread stores it
+  if (!queue) {
+    this->event_storage = std::make_unique<mpsc_queue<compiled_graph::id_t>>(capacity);
+    queue = this->event_storage.get();
+  } else {
+    if (capacity > queue->get_capacity()) {
+      throw std::logic_error("Cannot grow the event queue of a started engine, producers may still hold it.");
     }
+    queue->consume(queue->get_capacity(), [](compiled_graph::id_t) -> void {});  // meant for the previous run
   }
+  this->event_bb = std::move(bb);
+  this->events_posted_base.store(queue->pushed());
+  this->events_dropped_base.store(queue->dropped());
+  this->events_dispatched.store(0);
+  this->events_ignored.store(0);
+  this->event_batches.store(0);
 
-  this->is_valid.store(true);  // Mark the state machine as valid
+  this->current_state.store(this->graph->initial_state());
+  run_steps(*this->graph, this->event_bb, this->graph->entry_begin(), this->graph->entry_end(), std::nullopt);
+  this->event_queue.store(queue, std::memory_order_release);
+}
+
+auto msm_engine::event_id(const std::string& outcome) const -> compiled_graph::id_t {
+  return this->graph ? this->graph->find_outcome(outcome) : compiled_graph::npos;
+}
+
+auto msm_engine::post(compiled_graph::id_t event) noexcept -> bool {
+  auto* queue = this->event_queue.load(std::memory_order_acquire);
+  return queue && queue->try_push(event);
+}
+
+auto msm_engine::post(const std::string& outcome) -> bool {
+  auto event = this->event_id(outcome);
+  if (event == compiled_graph::npos) throw std::invalid_argument("Unknown event: " + outcome);
+  return this->post(event);
+}
+
+auto msm_engine::process_events(std::size_t max_batch) -> std::size_t {
+  auto* queue = this->event_queue.load(std::memory_order_relaxed);
+  if (!queue) return 0;
+
+  const auto& graph = *this->graph;
+  auto current = this->current_state.load(std::memory_order_relaxed);  // only this thread moves it
+
+  auto consumed = queue->consume(max_batch, [&](compiled_graph::id_t event) -> void {
+    auto edge = compiled_graph::npos;
+    if (current != compiled_graph::npos) {
+      for (auto e = graph.edge_begin(current); e < graph.edge_end(current); ++e) {
+        if (graph.edge_outcome(e) == event) {
+          edge = static_cast<compiled_graph::id_t>(e);
+          break;
+        }
+      }
+    }
+
+    auto target = edge == compiled_graph::npos ? compiled_graph::unmapped : graph.edge_target(edge);
+    if (target == compiled_graph::unmapped) {
+      this->events_ignored.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    if (compiled_graph::is_terminal(target)) {
+      MSM_TRACE_INSTANT(transition, graph.state_trace_id(current),
+                        graph.outcome_trace_id(compiled_graph::terminal_outcome(target)));
+    } else {
+      MSM_TRACE_INSTANT(transition, graph.state_trace_id(current), graph.state_trace_id(target));
+    }
+    run_steps(graph, this->event_bb, graph.step_begin(edge), graph.step_end(edge), std::nullopt);
+    current = compiled_graph::is_terminal(target) ? compiled_graph::npos : target;
+    this->current_state.store(current, std::memory_order_release);
+    this->events_dispatched.fetch_add(1, std::memory_order_relaxed);
+  });
+
+  if (consumed > 0) this->event_batches.fetch_add(1, std::memory_order_relaxed);
+  return consumed;
+}
+
+auto msm_engine::get_event_stats() const noexcept -> event_stats {
+  auto* queue = this->event_queue.load(std::memory_order_acquire);
+  return event_stats{queue ? queue->pushed() - this->events_posted_base.load() : 0,
+                     queue ? queue->dropped() - this->events_dropped_base.load() : 0, this->events_dispatched.load(),
+                     this->events_ignored.load(), this->event_batches.load()};
+}
+
+auto msm_engine::operator()() -> std::string { return (*this)(std::make_shared<blackboard>()); }
+
+auto msm_engine::cancel() -> void {
+  msm_state::cancel();
+
+  auto current = this->current_state.load();
+  if (current != compiled_graph::npos && this->graph) this->graph->state(current)->cancel();
+}
+
+auto msm_engine::to_string() const -> std::string {
+  std::string result = "State Machine with states: ";
+  for (const auto& [name, _] : this->states) {
+    result += name + ", ";
+  }
+  result += "Initial state: " + this->initial_state;
+  return result;
 }
 
-}  // namespace msm
\ No newline at end of file
+}  // namespace msm
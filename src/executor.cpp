@@ -0,0 +1,120 @@
+#include "executor.hpp"
+
+namespace msm {
+namespace {
+struct worker_identity {
+  const thread_pool_executor* pool = nullptr;
+  std::size_t index = 0;
+};
+
+thread_local worker_identity current_worker;
+}  // namespace
+
+thread_pool_executor::thread_pool_executor(std::size_t threads) {
+  if (threads == 0) threads = 1;
+
+  queues.reserve(threads);
+  for (auto i = std::size_t{0}; i < threads; ++i) {
+    queues.push_back(std::make_unique<worker_queue>());
+  }
+
+  workers.reserve(threads);
+  for (auto i = std::size_t{0}; i < threads; ++i) {
+    workers.emplace_back([this, i]() -> void { run(i); });
+  }
+}
+
+thread_pool_executor::~thread_pool_executor() {
+  {
+    auto lock = std::lock_guard(sleep_mtx);
+    stopping.store(true);
+  }
+  wake.notify_all();
+
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+auto thread_pool_executor::worker_index() const noexcept -> std::size_t {
+  return current_worker.pool == this ? current_worker.index : queues.size();
+}
+
+auto thread_pool_executor::pop_own(std::size_t index) -> task {
+  auto& queue = *queues[index];
+  auto lock = std::lock_guard(queue.mtx);
+  if (queue.tasks.empty()) return nullptr;
+
+  auto work = std::move(queue.tasks.back());
+  queue.tasks.pop_back();
+  return work;
+}
+
+auto thread_pool_executor::steal(std::size_t thief) -> task {
+  for (auto offset = std::size_t{1}; offset <= queues.size(); ++offset) {
+    auto& queue = *queues[(thief + offset) % queues.size()];
+    auto lock = std::lock_guard(queue.mtx);
+    if (queue.tasks.empty()) continue;
+
+    auto work = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    return work;
+  }
+  return nullptr;
+}
+
+auto thread_pool_executor::take(std::size_t index) -> task {
+  auto work = index < queues.size() ? pop_own(index) : nullptr;
+  if (!work) work = steal(index % queues.size());
+  if (work) pending.fetch_sub(1);
+  return work;
+}
+
+auto thread_pool_executor::run(std::size_t index) -> void {
+  current_worker = worker_identity{this, index};
+
+  while (true) {
+    if (auto work = take(index)) {
+      work();
+      continue;
+    }
+
+    auto lock = std::unique_lock(sleep_mtx);
+    wake.wait(lock, [this]() { return pending.load() > 0 || stopping.load(); });
+    if (stopping.load() && pending.load() == 0) return;
+  }
+}
+
+auto thread_pool_executor::submit(task work) -> void {
+  auto index = worker_index();
+  if (index == queues.size()) index = next_queue.fetch_add(1) % queues.size();
+
+  {
+    auto lock = std::lock_guard(sleep_mtx);  // pairs with the predicate check in run() so the wakeup is not lost
+    pending.fetch_add(1);
+  }
+
+  {
+    auto& queue = *queues[index];
+    auto lock = std::lock_guard(queue.mtx);
+    queue.tasks.push_back(std::move(work));
+  }
+  wake.notify_one();
+}
+
+auto thread_pool_executor::concurrency() const noexcept -> std::size_t { return workers.size(); }
+
+auto thread_pool_executor::try_run_one() -> bool {
+  auto work = take(worker_index());
+  if (!work) return false;
+
+  work();
+  return true;
+}
+
+auto thread_pool_executor::shared() -> executor::ptr {
+  static auto pool = std::make_shared<thread_pool_executor>();
+  return pool;
+}
+
+}  // namespace msm
@@ -0,0 +1,536 @@
+#include "graph.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <typeinfo>
+
+#include "async.hpp"
+#include "engine.hpp"
+#include "trace.hpp"
+
+namespace msm {
+auto compiled_graph::compile(const state_table& states, const transition_tables& transitions,
+                             const std::string& initial_state, const msm_state::outcome_set& final_outcomes,
+                             bool strict, msm_engine* owner, const timeout_map& timeouts) -> ptr {
+  if (initial_state.empty() || states.find(initial_state) == states.end()) {
+    throw std::runtime_error("State machine validation failed: initial state is not set or invalid.");
+  }
+
+  auto graph = std::shared_ptr<compiled_graph>(new compiled_graph{});
+  // keys view names owned by the caller's maps or by nested graphs, all of which outlive compile()
+  auto outcome_ids = std::unordered_map<std::string_view, id_t>{};
+  auto label_ids = std::unordered_map<std::string_view, id_t>{};
+  label_ids.reserve(states.size());
+
+  auto intern_outcome = [&](std::string_view name) -> id_t {
+    auto [it, inserted] = outcome_ids.try_emplace(name, static_cast<id_t>(graph->outcome_names.size()));
+    if (inserted) graph->outcome_names.emplace_back(name);
+    return it->second;
+  };
+  auto intern_label = [&](std::string_view name) -> id_t {
+    auto [it, inserted] = label_ids.try_emplace(name, static_cast<id_t>(graph->labels.size()));
+    if (inserted) graph->labels.emplace_back(name);
+    return it->second;
+  };
+
+  // A state added to this engine: either one state of the graph, or a nested engine whose states and scopes are
+  // copied in starting at first_state and first_scope
+  struct member {
+    std::string_view name;
+    const msm_state::ptr* state;
+    const compiled_graph* nested;
+    id_t label;
+    id_t first_state;
+    id_t first_scope;
+  };
+  auto members = std::vector<member>{};
+  auto member_ids = std::unordered_map<std::string_view, std::size_t>{};
+  members.reserve(states.size());
+  member_ids.reserve(states.size());
+
+  graph->scopes.push_back(scope{owner, npos, npos, nullptr});
+
+  for (const auto& out : final_outcomes) intern_outcome(out);
+
+  // the initial state always gets id 0 (a nested engine's initial state is its id 0 too), the rest follow in map
+  // order
+  auto add_member = [&](std::string_view name, const msm_state::ptr& state) -> void {
+    auto m = member{name, &state, nullptr, intern_label(name), static_cast<id_t>(graph->state_names.size()),
+                    static_cast<id_t>(graph->scopes.size())};
+    member_ids.try_emplace(name, members.size());
+
+    // a nested engine under a budget of its own, or of this engine, is run as a state so the budget covers it whole
+    auto timed = timeouts.find(name);
+    if (typeid(*state) != typeid(msm_engine) || timed != timeouts.end() ||
+        static_cast<msm_engine*>(state.get())->get_timeout().count() > 0) {
+      graph->state_names.emplace_back(name);
+      graph->state_labels.push_back(m.label);
+      graph->state_scopes.push_back(0);
+      graph->state_ptrs.push_back(state);
+      graph->async_states.push_back(std::dynamic_pointer_cast<async_state>(state) != nullptr);
+      graph->state_timeouts.push_back(timed == timeouts.end()
+                                          ? timeout{}
+                                          : timeout{timed->second.first, intern_outcome(timed->second.second)});
+      members.push_back(m);
+      return;
+    }
+
+    auto source = static_cast<msm_engine*>(state.get())->get_graph();
+    if (!source) throw std::runtime_error("State machine validation failed: nested state machine '" +
+                                          std::string{name} + "' is not validated.");
+    m.nested = source.get();
+    for (auto s = std::size_t{0}; s < source->scopes.size(); ++s) {
+      const auto& inner = source->scopes[s];
+      graph->scopes.push_back(s == 0 ? scope{static_cast<msm_engine*>(state.get()), 0, m.label, source}
+                                     : scope{inner.engine, m.first_scope + inner.parent,
+                                             intern_label(source->labels[inner.label]), inner.source});
+    }
+    for (auto id = std::size_t{0}; id < source->state_names.size(); ++id) {
+      graph->state_names.push_back(std::string{name} + "/" + source->state_names[id]);
+      graph->state_labels.push_back(intern_label(source->labels[source->state_labels[id]]));
+      graph->state_scopes.push_back(m.first_scope + source->state_scopes[id]);
+      graph->state_ptrs.push_back(source->state_ptrs[id]);
+      graph->async_states.push_back(source->async_states[id]);
+      auto inner = source->state_timeouts[id];
+      if (inner.outcome != npos) inner.outcome = intern_outcome(source->outcome_names[inner.outcome]);
+      graph->state_timeouts.push_back(inner);
+    }
+    members.push_back(m);
+  };
+  add_member(initial_state, states.find(initial_state)->second);
+  for (const auto& [name, state] : states) {
+    if (std::string_view{name} != initial_state) add_member(name, state);
+  }
+  graph->initial = 0;
+
+  // copies a step of a nested graph, renumbering its scope, labels and outcome
+  auto copy_step = [&](const member& m, const step& inner) -> void {
+    auto relabel = [&](id_t label) { return label == npos ? npos : intern_label(m.nested->labels[label]); };
+    auto outcome = inner.outcome == npos ? npos : intern_outcome(m.nested->outcome_names[inner.outcome]);
+    graph->steps.push_back(
+        step{inner.type, m.first_scope + inner.scope, relabel(inner.from), relabel(inner.to), outcome});
+  };
+
+  // entering a member: its state id, and for a nested engine the start callbacks down to its initial state
+  auto enter = [&](const member& m) -> id_t {
+    if (m.nested) {
+      for (auto i = m.nested->entry_first; i < m.nested->entry_last; ++i) copy_step(m, m.nested->steps[i]);
+    }
+    return m.first_state;
+  };
+
+  // Where outcome `out` of member `m` leads in this engine, appending the steps of that transition
+  auto resolve = [&](const member& m, std::string_view out) -> id_t {
+    auto mapped = std::optional<std::string_view>{};
+    if (auto transitions_it = transitions.find(m.name); transitions_it != transitions.end()) {
+      if (auto it = transitions_it->second.find(out); it != transitions_it->second.end()) mapped = it->second;
+    }
+
+    if (mapped) {
+      if (auto member_it = member_ids.find(*mapped); member_it != member_ids.end()) {
+        const auto& target = members[member_it->second];
+        graph->steps.push_back(step{step::kind::transition, 0, m.label, target.label, intern_outcome(out)});
+        return enter(target);
+      }
+      if (final_outcomes.find(*mapped) != final_outcomes.end()) {
+        auto outcome = intern_outcome(*mapped);
+        graph->steps.push_back(step{step::kind::end, 0, npos, npos, outcome});
+        return terminal(outcome);
+      }
+      throw std::runtime_error("State machine validation failed: outcome '" + std::string{out} + "' of state '" +
+                               std::string{m.name} + "' transitions to '" + std::string{*mapped} +
+                               "', which is neither a state nor a final outcome of the state machine.");
+    }
+    if (final_outcomes.find(out) != final_outcomes.end()) {  // outcome is a final outcome of the state machine
+      auto outcome = intern_outcome(out);
+      graph->steps.push_back(step{step::kind::end, 0, npos, npos, outcome});
+      return terminal(outcome);
+    }
+    if (strict) {
+      throw std::runtime_error("State machine validation failed: outcome '" + std::string{out} + "' of state '" +
+                               std::string{m.name} + "' is neither a valid transition nor a final outcome.");
+    }
+    return unmapped;
+  };
+
+  graph->edge_offsets.reserve(graph->state_names.size() + 1);
+  for (const auto& m : members) {
+    if (!m.nested) {
+      graph->edge_offsets.push_back(graph->edge_outcomes.size());
+      for (const auto& out : (*m.state)->get_outcome_set()) {
+        graph->step_offsets.push_back(graph->steps.size());
+        auto target = resolve(m, out);
+        graph->edge_outcomes.push_back(intern_outcome(out));
+        graph->edge_targets.push_back(target);
+      }
+      continue;
+    }
+
+    // edges inside the nested engine keep their steps; the ones that end it continue with this engine's transition
+    const auto& nested = *m.nested;
+    for (auto id = id_t{0}; id < static_cast<id_t>(nested.state_count()); ++id) {
+      graph->edge_offsets.push_back(graph->edge_outcomes.size());
+      for (auto e = nested.edge_begin(id); e < nested.edge_end(id); ++e) {
+        graph->step_offsets.push_back(graph->steps.size());
+        for (auto i = nested.step_begin(e); i < nested.step_end(e); ++i) copy_step(m, nested.steps[i]);
+
+        auto target = nested.edge_target(e);
+        if (is_terminal(target)) {
+          target = resolve(m, nested.outcome_name(terminal_outcome(target)));
+        } else if (target != unmapped) {
+          target += m.first_state;
+        }
+        graph->edge_outcomes.push_back(intern_outcome(nested.outcome_name(nested.edge_outcome(e))));
+        graph->edge_targets.push_back(target);
+      }
+    }
+  }
+  graph->edge_offsets.push_back(graph->edge_outcomes.size());
+  graph->step_offsets.push_back(graph->steps.size());
+  graph->reorder();
+  graph->analyze(final_outcomes.size(), strict);
+
+  graph->entry_first = graph->steps.size();
+  graph->steps.push_back(step{step::kind::start, 0, npos, members.front().label, npos});
+  enter(members.front());
+  graph->entry_last = graph->steps.size();
+
+  // FNV-1a over everything that decides where a run goes
+  auto hash = std::uint64_t{0xcbf29ce484222325};
+  auto mix = [&hash](const void* data, std::size_t size) {
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    for (auto i = std::size_t{0}; i < size; ++i) hash = (hash ^ bytes[i]) * 0x100000001b3;
+  };
+  for (const auto& name : graph->state_names) mix(name.c_str(), name.size() + 1);
+  for (const auto& name : graph->outcome_names) mix(name.c_str(), name.size() + 1);
+  mix(graph->edge_offsets.data(), graph->edge_offsets.size() * sizeof(std::size_t));
+  mix(graph->edge_outcomes.data(), graph->edge_outcomes.size() * sizeof(id_t));
+  mix(graph->edge_targets.data(), graph->edge_targets.size() * sizeof(id_t));
+  mix(&graph->initial, sizeof(id_t));
+  graph->hash = hash;
+
+#ifdef MSM_ENABLE_TRACING
+  for (const auto& name : graph->state_names) graph->state_trace_ids.push_back(tracer::intern(name));
+  for (const auto& name : graph->outcome_names) graph->outcome_trace_ids.push_back(tracer::intern(name));
+#endif
+  return graph;
+}
+
+auto compiled_graph::save(std::vector<std::byte>& out) const -> void {
+  if (!savable()) throw std::runtime_error("Cannot save a graph with nested state machines flattened in.");
+
+  auto writer = snapshot_builder{out};
+  auto put_strings = [&writer](const std::vector<std::string>& names) {
+    writer.put(static_cast<std::uint32_t>(names.size()));
+    for (const auto& name : names) writer.put_string(name);
+  };
+  auto put_array = [&writer](const auto& values) {
+    writer.put(static_cast<std::uint64_t>(values.size()));
+    writer.put_bytes(values.data(), values.size() * sizeof(values[0]));
+  };
+
+  put_strings(state_names);
+  put_array(state_labels);
+  writer.put(static_cast<std::uint64_t>(state_timeouts.size()));
+  for (const auto& limit : state_timeouts) {
+    writer.put(static_cast<std::int64_t>(limit.budget.count()));
+    writer.put(limit.outcome);
+  }
+  put_strings(outcome_names);
+  put_array(edge_offsets);
+  put_array(edge_outcomes);
+  put_array(edge_targets);
+  put_array(step_offsets);
+  put_strings(labels);
+  writer.put(static_cast<std::uint64_t>(steps.size()));
+  for (const auto& s : steps) {  // field by field, so the padding of step never reaches the file
+    writer.put(s.type);
+    writer.put(s.from);
+    writer.put(s.to);
+    writer.put(s.outcome);
+  }
+  writer.put(entry_first);
+  writer.put(entry_last);
+  put_strings(pruned);
+  put_array(traps);
+  writer.put(outcome_words);
+  put_array(reachable);
+  writer.put(initial);
+  writer.put(hash);
+}
+
+auto compiled_graph::load(snapshot_reader& in, std::vector<msm_state::ptr> states, msm_engine* owner) -> ptr {
+  auto graph = std::shared_ptr<compiled_graph>(new compiled_graph{});
+  auto get_strings = [&in](std::vector<std::string>& names) {
+    auto count = in.check_count(in.get<std::uint32_t>(), sizeof(std::uint32_t));  // each has a length prefix
+    names.reserve(count);
+    for (auto i = std::uint32_t{0}; i < count; ++i) names.emplace_back(in.get_string());
+  };
+  auto get_count = [&in](std::size_t element_size) -> std::size_t {
+    return in.check_count(in.get<std::uint64_t>(), element_size);
+  };
+  auto get_array = [&](auto& values) {
+    values.resize(get_count(sizeof(values[0])));
+    auto bytes = in.bytes(values.size() * sizeof(values[0]));
+    if (!bytes.empty()) std::memcpy(values.data(), bytes.data(), bytes.size());
+  };
+
+  get_strings(graph->state_names);
+  get_array(graph->state_labels);
+  graph->state_timeouts.resize(get_count(sizeof(std::int64_t) + sizeof(id_t)));
+  for (auto& limit : graph->state_timeouts) {
+    limit.budget = std::chrono::nanoseconds{in.get<std::int64_t>()};
+    limit.outcome = in.get<id_t>();
+  }
+  get_strings(graph->outcome_names);
+  get_array(graph->edge_offsets);
+  get_array(graph->edge_outcomes);
+  get_array(graph->edge_targets);
+  get_array(graph->step_offsets);
+  get_strings(graph->labels);
+  graph->steps.resize(get_count(sizeof(step::kind) + 3 * sizeof(id_t)));
+  for (auto& s : graph->steps) {
+    s.type = in.get<step::kind>();
+    s.scope = 0;
+    s.from = in.get<id_t>();
+    s.to = in.get<id_t>();
+    s.outcome = in.get<id_t>();
+  }
+  graph->entry_first = in.get<std::size_t>();
+  graph->entry_last = in.get<std::size_t>();
+  get_strings(graph->pruned);
+  get_array(graph->traps);
+  graph->outcome_words = in.get<std::size_t>();
+  get_array(graph->reachable);
+  graph->initial = in.get<id_t>();
+  graph->hash = in.get<std::uint64_t>();
+
+  // the execution loop indexes with these without checking, so a damaged file must not get past here
+  const auto count = graph->state_names.size();
+  const auto edges = graph->edge_outcomes.size();
+  const auto outcomes = static_cast<id_t>(graph->outcome_names.size());
+  const auto labels = static_cast<id_t>(graph->labels.size());
+  auto is_outcome = [outcomes](id_t id) { return id >= 0 && id < outcomes; };
+  auto is_label = [labels](id_t id) { return id == npos || (id >= 0 && id < labels); };
+  auto well_formed =
+      count > 0 && states.size() == count && graph->initial == 0 && graph->state_labels.size() == count &&
+      graph->state_timeouts.size() == count && graph->edge_offsets.size() == count + 1 &&
+      graph->edge_offsets.front() == 0 && graph->edge_offsets.back() == edges &&
+      std::is_sorted(graph->edge_offsets.begin(), graph->edge_offsets.end()) && graph->edge_targets.size() == edges &&
+      graph->step_offsets.size() == edges + 1 && graph->step_offsets.front() == 0 &&
+      graph->step_offsets.back() <= graph->steps.size() &&
+      std::is_sorted(graph->step_offsets.begin(), graph->step_offsets.end()) &&
+      graph->entry_first <= graph->entry_last && graph->entry_last <= graph->steps.size() &&
+      graph->outcome_words <= static_cast<std::size_t>(outcomes) &&
+      graph->reachable.size() == count * graph->outcome_words &&
+      std::all_of(graph->state_labels.begin(), graph->state_labels.end(),
+                  [&](id_t label) { return label != npos && is_label(label); }) &&
+      std::all_of(graph->state_timeouts.begin(), graph->state_timeouts.end(),
+                  [&](const timeout& t) { return t.outcome == npos || is_outcome(t.outcome); }) &&
+      std::all_of(graph->edge_outcomes.begin(), graph->edge_outcomes.end(), is_outcome) &&
+      std::all_of(graph->edge_targets.begin(), graph->edge_targets.end(),
+                  [&](id_t t) {
+                    return t == unmapped || (t >= 0 && static_cast<std::size_t>(t) < count) ||
+                           (is_terminal(t) && is_outcome(terminal_outcome(t)));
+                  }) &&
+      std::all_of(graph->steps.begin(), graph->steps.end(),
+                  [&](const step& s) {
+                    return s.type <= step::kind::end && is_label(s.from) && is_label(s.to) &&
+                           (s.outcome == npos || is_outcome(s.outcome));
+                  }) &&
+      std::all_of(graph->traps.begin(), graph->traps.end(),
+                  [count](id_t t) { return t >= 0 && static_cast<std::size_t>(t) < count; });
+  if (!well_formed || !in.done()) throw std::runtime_error("Compiled graph is malformed.");
+
+  for (auto id = id_t{0}; id < static_cast<id_t>(count); ++id) {
+    const auto& declared = states[id]->get_outcome_set();
+    auto matches = declared.size() == graph->edge_end(id) - graph->edge_begin(id);
+    for (auto e = graph->edge_begin(id); matches && e < graph->edge_end(id); ++e) {
+      matches = declared.find(graph->outcome_names[graph->edge_outcomes[e]]) != declared.end();
+    }
+    if (!matches) {
+      throw std::runtime_error("State '" + graph->state_names[id] +
+                               "' does not declare the outcomes its graph was compiled with.");
+    }
+    graph->async_states.push_back(std::dynamic_pointer_cast<async_state>(states[id]) != nullptr);
+    graph->state_scopes.push_back(0);
+  }
+  graph->state_ptrs = std::move(states);
+  graph->scopes.push_back(scope{owner, npos, npos, nullptr});
+
+#ifdef MSM_ENABLE_TRACING
+  for (const auto& name : graph->state_names) graph->state_trace_ids.push_back(tracer::intern(name));
+  for (const auto& name : graph->outcome_names) graph->outcome_trace_ids.push_back(tracer::intern(name));
+#endif
+  return graph;
+}
+
+auto compiled_graph::reorder() -> void {
+  auto count = state_names.size();
+  auto order = std::vector<id_t>{initial};
+  auto renumbered = std::vector<id_t>(count, npos);
+  order.reserve(count);
+  renumbered[initial] = 0;
+  for (auto i = std::size_t{0}; i < order.size(); ++i) {
+    for (auto e = edge_begin(order[i]); e < edge_end(order[i]); ++e) {
+      auto target = edge_targets[e];
+      if (target >= 0 && renumbered[target] == npos) {
+        renumbered[target] = static_cast<id_t>(order.size());
+        order.push_back(target);
+      }
+    }
+  }
+
+  for (auto id = std::size_t{0}; id < count; ++id) {
+    if (renumbered[id] == npos) pruned.push_back(state_names[id]);
+  }
+
+  // rebuild every per-state and per-edge array in the new order
+  auto names = std::vector<std::string>{};
+  auto local_labels = std::vector<id_t>{};
+  auto local_scopes = std::vector<id_t>{};
+  auto ptrs = std::vector<msm_state::ptr>{};
+  auto async = std::vector<bool>{};
+  auto budgets = std::vector<timeout>{};
+  auto offsets = std::vector<std::size_t>{};
+  auto outcomes = std::vector<id_t>{};
+  auto targets = std::vector<id_t>{};
+  auto firsts = std::vector<std::size_t>{};
+  auto copied = std::vector<step>{};
+  offsets.reserve(order.size() + 1);
+  for (auto id : order) {
+    names.push_back(std::move(state_names[id]));
+    local_labels.push_back(state_labels[id]);
+    local_scopes.push_back(state_scopes[id]);
+    ptrs.push_back(std::move(state_ptrs[id]));
+    async.push_back(async_states[id]);
+    budgets.push_back(state_timeouts[id]);
+
+    offsets.push_back(outcomes.size());
+    for (auto e = edge_begin(id); e < edge_end(id); ++e) {
+      outcomes.push_back(edge_outcomes[e]);
+      targets.push_back(edge_targets[e] >= 0 ? renumbered[edge_targets[e]] : edge_targets[e]);
+      firsts.push_back(copied.size());
+      copied.insert(copied.end(), steps.begin() + step_offsets[e], steps.begin() + step_offsets[e + 1]);
+    }
+  }
+  offsets.push_back(outcomes.size());
+  firsts.push_back(copied.size());
+
+  state_names = std::move(names);
+  state_labels = std::move(local_labels);
+  state_scopes = std::move(local_scopes);
+  state_ptrs = std::move(ptrs);
+  async_states = std::move(async);
+  state_timeouts = std::move(budgets);
+  edge_offsets = std::move(offsets);
+  edge_outcomes = std::move(outcomes);
+  edge_targets = std::move(targets);
+  step_offsets = std::move(firsts);
+  steps = std::move(copied);
+  initial = 0;
+}
+
+auto compiled_graph::analyze(std::size_t final_count, bool strict) -> void {
+  auto count = state_names.size();
+  outcome_words = (final_count + 63) / 64;
+  reachable.assign(count * outcome_words, 0);
+
+  // Tarjan's strongly connected components, iteratively. Components are completed sinks first, so the final
+  // outcomes of a component are its own terminal edges plus those of components already completed.
+  auto index = std::vector<id_t>(count, npos);
+  auto low = std::vector<id_t>(count, 0);
+  auto on_stack = std::vector<bool>(count, false);
+  auto stack = std::vector<id_t>{};
+  auto frames = std::vector<std::pair<id_t, std::size_t>>{};  // state, next edge to visit
+  auto component = std::vector<id_t>{};
+  auto next_index = id_t{0};
+
+  auto visit = [&](id_t state) -> void {
+    index[state] = low[state] = next_index++;
+    stack.push_back(state);
+    on_stack[state] = true;
+    frames.emplace_back(state, edge_begin(state));
+  };
+
+  for (auto root = id_t{0}; root < static_cast<id_t>(count); ++root) {
+    if (index[root] != npos) continue;
+    visit(root);
+
+    while (!frames.empty()) {
+      auto [state, edge] = frames.back();
+      if (edge < edge_end(state)) {
+        ++frames.back().second;
+        auto target = edge_targets[edge];
+        if (target < 0) continue;
+        if (index[target] == npos) {
+          visit(target);
+        } else if (on_stack[target]) {
+          low[state] = std::min(low[state], index[target]);
+        }
+        continue;
+      }
+
+      frames.pop_back();
+      if (!frames.empty()) low[frames.back().first] = std::min(low[frames.back().first], low[state]);
+      if (low[state] != index[state]) continue;
+
+      component.clear();
+      do {
+        component.push_back(stack.back());
+        on_stack[stack.back()] = false;
+        stack.pop_back();
+      } while (component.back() != state);
+
+      auto* bits = reachable.data() + state * outcome_words;
+      for (auto member : component) {
+        for (auto e = edge_begin(member); e < edge_end(member); ++e) {
+          auto target = edge_targets[e];
+          if (is_terminal(target)) {
+            auto outcome = static_cast<std::size_t>(terminal_outcome(target));
+            bits[outcome / 64] |= std::uint64_t{1} << (outcome % 64);
+          } else if (target >= 0 && !on_stack[target]) {  // a completed component, or this one's own (still zero)
+            for (auto w = std::size_t{0}; w < outcome_words; ++w) bits[w] |= reachable[target * outcome_words + w];
+          }
+        }
+      }
+      for (auto member : component) {
+        std::copy(bits, bits + outcome_words, reachable.data() + member * outcome_words);
+      }
+    }
+  }
+
+  for (auto state = id_t{0}; state < static_cast<id_t>(count); ++state) {
+    auto* bits = reachable.data() + state * outcome_words;
+    if (std::all_of(bits, bits + outcome_words, [](std::uint64_t word) { return word == 0; })) traps.push_back(state);
+  }
+  if (strict && !traps.empty()) {
+    throw std::runtime_error("State machine validation failed: state '" + state_names[traps.front()] +
+                             "' cannot reach a final outcome.");
+  }
+}
+
+auto compiled_graph::find_state(const std::string& name) const noexcept -> id_t {
+  for (auto id = std::size_t{0}; id < state_names.size(); ++id) {
+    if (state_names[id] == name) return static_cast<id_t>(id);
+  }
+  return npos;
+}
+
+auto compiled_graph::find_outcome(const std::string& name) const noexcept -> id_t {
+  for (auto id = std::size_t{0}; id < outcome_names.size(); ++id) {
+    if (outcome_names[id] == name) return static_cast<id_t>(id);
+  }
+  return npos;
+}
+
+auto compiled_graph::state_path(id_t state) const -> std::vector<std::string> {
+  auto path = std::vector<std::string>{state_label(state)};
+  for (auto s = state_scopes[state]; s != 0; s = scopes[s].parent) path.push_back(labels[scopes[s].label]);
+  std::reverse(path.begin(), path.end());
+  return path;
+}
+}  // namespace msm
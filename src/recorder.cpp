@@ -0,0 +1,251 @@
+#include "recorder.hpp"
+
+#include <algorithm>
+
+namespace msm {
+namespace {
+constexpr auto recording_magic = std::uint32_t{0x4c534d4d};  // "MMSL"
+constexpr auto recording_version = std::uint32_t{1};
+
+auto round_up(std::size_t n) noexcept -> std::size_t {
+  auto power = std::size_t{64};
+  while (power < n) power <<= 1;
+  return power;
+}
+}  // namespace
+
+recorder::recorder(const std::string& path, recorder_options options_)
+    : out{path, std::ios::binary | std::ios::trunc},
+      ring(round_up(options_.buffer_size)),
+      mask{ring.size() - 1},
+      options{options_} {
+  if (!out) throw std::runtime_error("Cannot open recording file: " + path);
+  out.write(reinterpret_cast<const char*>(&recording_magic), sizeof(recording_magic));
+  out.write(reinterpret_cast<const char*>(&recording_version), sizeof(recording_version));
+  this->flusher = std::thread([this] { this->run(); });
+}
+
+recorder::~recorder() {
+  {
+    auto lock = std::lock_guard(this->mtx);
+    this->stopping = true;
+  }
+  this->wake.notify_one();
+  this->flusher.join();
+}
+
+auto recorder::append_slow(const void* data, std::size_t size) noexcept -> void {
+  const auto* bytes = static_cast<const std::byte*>(data);
+  auto t = this->tail.load(std::memory_order_relaxed);
+  while (size > 0) {
+    auto h = this->head.load(std::memory_order_acquire);
+    auto used = t - h;
+    // the fast path runs to half full, then once more to full after waking the flusher: one wakeup per half ring
+    auto half = this->ring.size() / 2;
+    this->limit = h + (used < half ? half : this->ring.size());
+    if (used >= half) this->wake.notify_one();
+    if (used == this->ring.size()) {  // full: wait for the flusher
+      this->waits.fetch_add(1, std::memory_order_relaxed);
+      std::this_thread::yield();
+      continue;
+    }
+
+    // records may wrap around the end of the ring, and ones larger than the ring go in pieces
+    auto offset = t & this->mask;
+    auto count = std::min({size, this->ring.size() - used, this->ring.size() - offset});
+    std::memcpy(this->ring.data() + offset, bytes, count);
+    bytes += count;
+    size -= count;
+    t += count;
+    this->tail.store(t, std::memory_order_release);
+  }
+}
+
+auto recorder::drain() -> std::size_t {
+  auto h = this->head.load(std::memory_order_relaxed);
+  auto t = this->tail.load(std::memory_order_acquire);
+  while (h != t) {
+    auto offset = h & this->mask;
+    auto count = std::min(t - h, this->ring.size() - offset);
+    this->out.write(reinterpret_cast<const char*>(this->ring.data() + offset), static_cast<std::streamsize>(count));
+    h += count;
+  }
+  this->out.flush();
+  this->head.store(h, std::memory_order_release);
+  return h;
+}
+
+auto recorder::run() -> void {
+  auto lock = std::unique_lock(this->mtx);
+  while (true) {
+    this->wake.wait_for(lock, this->options.flush_interval, [this] {
+      return this->stopping || this->flush_requested ||
+             this->tail.load(std::memory_order_relaxed) - this->head.load(std::memory_order_relaxed) >=
+                 this->ring.size() / 2;
+    });
+    auto stop = this->stopping;
+    this->flush_requested = false;
+
+    lock.unlock();
+    auto h = this->drain();
+    lock.lock();
+
+    this->written = h;
+    this->flushed.notify_all();
+    if (stop) return;
+  }
+}
+
+auto recorder::flush() -> void {
+  auto target = this->tail.load(std::memory_order_acquire);
+  auto lock = std::unique_lock(this->mtx);
+  this->flush_requested = true;
+  this->wake.notify_one();
+  this->flushed.wait(lock, [&] { return this->written >= target; });
+}
+
+auto recorder::begin_run(const compiled_graph& graph, const blackboard& bb) -> void {
+  auto snapshot = std::vector<std::byte>{};
+  if (this->options.blackboard_writes) {
+    try {
+      snapshot = bb.snapshot();
+    } catch (const std::runtime_error&) {
+      this->unrecorded.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  std::byte record[1 + sizeof(std::uint64_t) + sizeof(std::uint32_t)];
+  auto writer = snapshot_writer{record};
+  writer.put(kind::run_begin);
+  writer.put(graph.fingerprint());
+  writer.put(static_cast<std::uint32_t>(snapshot.size()));
+  this->append(record, sizeof(record));
+  this->append(snapshot.data(), snapshot.size());
+}
+
+auto recorder::record_writes(const blackboard& bb, std::uint64_t since) -> void {
+  if (bb.get_version() == since) return;
+
+  auto delta = std::vector<std::byte>{};
+  try {
+    delta = bb.snapshot_changes(since);
+  } catch (const std::runtime_error&) {
+    this->unrecorded.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  std::byte record[1 + sizeof(std::uint32_t)];
+  auto writer = snapshot_writer{record};
+  writer.put(kind::writes);
+  writer.put(static_cast<std::uint32_t>(delta.size()));
+  this->append(record, sizeof(record));
+  this->append(delta.data(), delta.size());
+}
+
+auto recorder::end_run(compiled_graph::id_t outcome) noexcept -> void {
+  std::byte record[1 + sizeof(compiled_graph::id_t)];
+  record[0] = static_cast<std::byte>(kind::run_end);
+  std::memcpy(record + 1, &outcome, sizeof(outcome));
+  this->append(record, sizeof(record));
+}
+
+replayer::replayer(const std::string& path) : file{std::make_unique<mapped_file>(path)} {
+  auto reader = snapshot_reader{this->file->bytes()};
+  try {
+    if (reader.get<std::uint32_t>() != recording_magic || reader.get<std::uint32_t>() != recording_version) {
+      throw std::runtime_error("Not an execution recording.");
+    }
+  } catch (const std::runtime_error&) {
+    throw std::runtime_error("Not an execution recording: " + path);
+  }
+
+  // index the runs, stopping at a record cut short by a crash
+  this->length = reader.position();
+  try {
+    while (!reader.done()) {
+      auto offset = reader.position();
+      switch (reader.get<recorder::kind>()) {
+        case recorder::kind::run_begin:
+          reader.get<std::uint64_t>();
+          reader.bytes(reader.get<std::uint32_t>());
+          this->runs.push_back(offset);
+          break;
+        case recorder::kind::step:
+          reader.bytes(2 * sizeof(compiled_graph::id_t));
+          break;
+        case recorder::kind::writes:
+          reader.bytes(reader.get<std::uint32_t>());
+          break;
+        case recorder::kind::run_end:
+          reader.get<compiled_graph::id_t>();
+          break;
+        default:
+          throw std::logic_error("Corrupt execution recording: " + path);
+      }
+      this->length = reader.position();
+    }
+  } catch (const std::runtime_error&) {
+  }
+}
+
+auto replayer::replay(msm_engine& engine, const blackboard::ptr& bb, std::size_t index) const
+    -> std::optional<std::string> {
+  if (index >= this->runs.size()) throw std::out_of_range("No recorded run " + std::to_string(index) + ".");
+
+  engine.validate();
+  const auto graph = engine.graph;
+  auto reader = snapshot_reader{this->file->bytes().first(this->length).subspan(this->runs[index])};
+  reader.get<recorder::kind>();
+  if (reader.get<std::uint64_t>() != graph->fingerprint()) {
+    throw std::runtime_error("Recording was made with a different state machine.");
+  }
+  auto initial = reader.bytes(reader.get<std::uint32_t>());
+  if (!initial.empty()) bb->restore(initial);
+
+  auto diverged = [&graph](compiled_graph::id_t current) {
+    return std::runtime_error("Replay diverged from the recording in state '" +
+                              (compiled_graph::is_terminal(current) ? std::string{} : graph->state_name(current)) +
+                              "'.");
+  };
+
+  auto current = graph->initial_state();
+  engine.current_state.store(current);
+  try {
+    msm_engine::run_steps(*graph, bb, graph->entry_begin(), graph->entry_end(), std::nullopt);
+
+    while (!reader.done()) {
+      auto type = reader.get<recorder::kind>();
+      if (type == recorder::kind::run_begin) break;  // the recorded run never ended
+      if (type == recorder::kind::run_end) {
+        auto outcome = reader.get<compiled_graph::id_t>();
+        if (outcome == compiled_graph::npos) break;  // it threw
+        if (!compiled_graph::is_terminal(current) || compiled_graph::terminal_outcome(current) != outcome) {
+          throw diverged(current);
+        }
+        return graph->outcome_name(outcome);
+      }
+      if (type != recorder::kind::step) throw diverged(current);
+
+      auto state = reader.get<compiled_graph::id_t>();
+      auto outcome = reader.get<compiled_graph::id_t>();
+      if (compiled_graph::is_terminal(current) || state != current ||
+          outcome < 0 || static_cast<std::size_t>(outcome) >= graph->outcome_count()) {
+        throw diverged(current);
+      }
+
+      // what the state wrote lands before the transition callbacks run, as it did when it was recorded
+      auto since = bb->get_version();
+      if (auto next = reader; !next.done() && next.get<recorder::kind>() == recorder::kind::writes) {
+        reader = next;
+        bb->apply(reader.bytes(reader.get<std::uint32_t>()));
+      }
+      current = engine.advance(bb, current, graph->outcome_name(outcome), since, nullptr);
+    }
+  } catch (...) {
+    engine.current_state.store(compiled_graph::npos);
+    throw;
+  }
+  engine.current_state.store(compiled_graph::npos);
+  return std::nullopt;
+}
+}  // namespace msm
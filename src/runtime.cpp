@@ -0,0 +1,187 @@
+#include "runtime.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace msm {
+namespace {
+auto pin_to_core(std::size_t index) -> void {
+#if defined(__linux__)
+  auto cores = std::max(std::thread::hardware_concurrency(), 1u);
+  auto set = cpu_set_t{};
+  CPU_ZERO(&set);
+  CPU_SET(index % cores, &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);  // best effort, a restricted cpuset keeps the default
+#endif
+}
+}  // namespace
+
+sharded_runtime::sharded_runtime(std::size_t shard_count, bool pin, std::size_t batch_)
+    : batch{std::max<std::size_t>(batch_, 1)} {
+  if (shard_count == 0) shard_count = 1;
+
+  shards.reserve(shard_count);
+  for (auto i = std::size_t{0}; i < shard_count; ++i) {
+    shards.push_back(std::make_unique<shard>());
+  }
+
+  workers.reserve(shard_count);
+  for (auto i = std::size_t{0}; i < shard_count; ++i) {
+    workers.emplace_back([this, i, pin]() -> void { work(i, pin); });
+  }
+}
+
+sharded_runtime::~sharded_runtime() {
+  {
+    auto lock = std::lock_guard(sleep_mtx);
+    stopping.store(true);
+  }
+  wake.notify_all();
+
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+auto sharded_runtime::home(const msm_engine* engine) const noexcept -> std::size_t {
+  // engines are heap blocks with their low bits clear, so mix the address before taking it modulo the shards
+  auto key = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(engine)) * 0x9e3779b97f4a7c15;
+  return static_cast<std::size_t>(key >> 32) % shards.size();
+}
+
+auto sharded_runtime::enqueue(std::size_t index, std::shared_ptr<instance> ready) -> void {
+  {
+    auto& target = *shards[index];
+    auto lock = std::lock_guard(target.mtx);
+    pending.fetch_add(1);  // before it can be taken, so pending never goes below the queued count
+    target.queue.push_back(std::move(ready));
+  }
+
+  // pairs with the sleepers increment in work(): either the sleeper sees pending, or this sees the sleeper
+  if (sleepers.load() > 0) {
+    auto lock = std::lock_guard(sleep_mtx);
+    wake.notify_one();
+  }
+}
+
+auto sharded_runtime::take(std::size_t index) -> std::shared_ptr<instance> {
+  // own queue in FIFO order; other queues from the back, where an instance would wait longest for its own worker
+  for (auto offset = std::size_t{0}; offset < shards.size(); ++offset) {
+    auto& source = *shards[(index + offset) % shards.size()];
+    auto lock = std::lock_guard(source.mtx);
+    if (source.queue.empty()) continue;
+
+    auto ready = std::shared_ptr<instance>{};
+    if (offset == 0) {
+      ready = std::move(source.queue.front());
+      source.queue.pop_front();
+    } else {
+      ready = std::move(source.queue.back());
+      source.queue.pop_back();
+      shards[index]->steals.fetch_add(1, std::memory_order_relaxed);
+    }
+    pending.fetch_sub(1);
+    return ready;
+  }
+  return nullptr;
+}
+
+auto sharded_runtime::execute(std::size_t index, const std::shared_ptr<instance>& ready) -> void {
+  auto& owner = *shards[home(ready->engine.get())];
+  for (auto done = std::size_t{0};; ++done) {
+    auto next = run{};
+    {
+      auto lock = std::lock_guard(owner.mtx);
+      if (ready->runs.empty()) {
+        ready->scheduled = false;
+        owner.instances.erase(ready->engine.get());
+        return;
+      }
+      if (done == batch) break;  // give the other instances queued here a turn
+      next = std::move(ready->runs.front());
+      ready->runs.pop_front();
+    }
+
+    auto outcome = std::optional<std::string>{};
+    auto error = std::exception_ptr{};
+    try {
+      outcome.emplace(ready->engine->execute(next.bb));
+    } catch (...) {
+      error = std::current_exception();
+    }
+    shards[index]->runs.fetch_add(1, std::memory_order_relaxed);
+    try {
+      next.on_done(std::move(outcome), error);
+    } catch (...) {  // nowhere to report it, and the worker must keep going
+    }
+  }
+  enqueue(index, ready);  // still scheduled, now on the queue of the core it ran on
+}
+
+auto sharded_runtime::work(std::size_t index, bool pin) -> void {
+  if (pin) pin_to_core(index);
+
+  while (true) {
+    if (auto ready = take(index)) {
+      execute(index, ready);
+      continue;
+    }
+
+    auto lock = std::unique_lock(sleep_mtx);
+    sleepers.fetch_add(1);
+    wake.wait(lock, [this]() { return pending.load() > 0 || stopping.load(); });
+    sleepers.fetch_sub(1);
+    if (stopping.load() && pending.load() == 0) return;
+  }
+}
+
+auto sharded_runtime::submit(std::shared_ptr<msm_engine> engine, blackboard::ptr bb, completion_t on_done) -> void {
+  if (!engine) throw std::invalid_argument("Cannot submit a run without an engine.");
+  if (!bb) bb = std::make_shared<blackboard>();
+
+  auto index = home(engine.get());
+  auto& owner = *shards[index];
+  auto ready = std::shared_ptr<instance>{};
+  {
+    auto lock = std::lock_guard(owner.mtx);
+    auto& slot = owner.instances[engine.get()];
+    if (!slot) {
+      slot = std::make_shared<instance>();
+      slot->engine = std::move(engine);
+    }
+    slot->runs.push_back(run{std::move(bb), std::move(on_done)});
+    if (!slot->scheduled) {
+      slot->scheduled = true;
+      ready = slot;
+    }
+  }
+  if (ready) enqueue(index, std::move(ready));
+}
+
+auto sharded_runtime::submit(std::shared_ptr<msm_engine> engine, blackboard::ptr bb) -> std::future<std::string> {
+  auto promise = std::make_shared<std::promise<std::string>>();
+  auto result = promise->get_future();
+  submit(std::move(engine), std::move(bb), [promise](std::optional<std::string> outcome, std::exception_ptr error) {
+    if (error) {
+      promise->set_exception(error);
+    } else {
+      promise->set_value(std::move(*outcome));
+    }
+  });
+  return result;
+}
+
+auto sharded_runtime::get_stats() const noexcept -> runtime_stats {
+  auto stats = runtime_stats{0, 0};
+  for (const auto& s : shards) {
+    stats.runs += s->runs.load(std::memory_order_relaxed);
+    stats.steals += s->steals.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+}  // namespace msm
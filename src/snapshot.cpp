@@ -0,0 +1,82 @@
+#include "snapshot.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <filesystem>
+
+namespace msm {
+mapped_file::mapped_file(const std::string& path) {
+  auto fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) throw std::runtime_error("Cannot open snapshot file: " + path);
+
+  struct stat info {};
+  if (::fstat(fd, &info) != 0) {
+    ::close(fd);
+    throw std::runtime_error("Cannot read snapshot file: " + path);
+  }
+
+  length = static_cast<std::size_t>(info.st_size);
+  if (length > 0) {
+    auto* mapping = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      ::close(fd);
+      throw std::runtime_error("Cannot map snapshot file: " + path);
+    }
+    data = static_cast<const std::byte*>(mapping);
+  }
+  ::close(fd);  // the mapping stays valid
+}
+
+mapped_file::~mapped_file() {
+  if (data) ::munmap(const_cast<std::byte*>(data), length);
+}
+
+namespace {
+// Writes all of bytes to fd, retrying short writes and interrupted calls
+auto write_all(int fd, std::span<const std::byte> bytes) -> bool {
+  while (!bytes.empty()) {
+    auto written = ::write(fd, bytes.data(), bytes.size());
+    if (written < 0 && errno == EINTR) continue;
+    if (written <= 0) return false;
+    bytes = bytes.subspan(static_cast<std::size_t>(written));
+  }
+  return true;
+}
+
+auto sync_directory(const std::string& path) -> bool {
+  auto directory = std::filesystem::path{path}.parent_path();
+  auto fd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0) return false;
+  auto synced = ::fsync(fd) == 0;
+  ::close(fd);
+  return synced;
+}
+}  // namespace
+
+auto write_snapshot_file(const std::string& path, std::span<const std::byte> bytes) -> void {
+  // unique per process and call, so concurrent writers of the same path never share a temporary
+  static auto sequence = std::atomic<std::uint64_t>{0};
+  auto temporary = path + ".tmp." + std::to_string(::getpid()) + "." + std::to_string(sequence.fetch_add(1));
+
+  auto fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+  if (fd < 0) throw std::runtime_error("Cannot create snapshot file: " + temporary);
+  auto written = write_all(fd, bytes) && ::fsync(fd) == 0;  // the data is on disk before the name points at it
+  if (::close(fd) != 0) written = false;
+  if (!written) {
+    ::unlink(temporary.c_str());
+    throw std::runtime_error("Cannot write snapshot file: " + temporary);
+  }
+
+  if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+    ::unlink(temporary.c_str());
+    throw std::runtime_error("Cannot replace snapshot file: " + path);
+  }
+  if (!sync_directory(path)) throw std::runtime_error("Cannot sync the directory of snapshot file: " + path);
+}
+}  // namespace msm
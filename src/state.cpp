@@ -1,12 +1,32 @@
 #include "state.hpp"
 
-#include <future>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <stdexcept>
 
+#include "trace.hpp"
+
 namespace msm {
 
+namespace {
+auto make_outcome_set(const std::unordered_set<std::string>& outcomes,
+                      const std::pmr::polymorphic_allocator<>& allocator) -> msm_state::outcome_set {
+  auto result = msm_state::outcome_set{outcomes.size(), allocator};
+  for (const auto& outcome : outcomes) result.emplace(outcome);
+  return result;
+}
+}  // namespace
+
 msm_state::msm_state(const std::unordered_set<std::string>& outcomes_)
-    : active{false}, cancelled{false}, outcomes{outcomes_} {
+    : msm_state{outcomes_, std::pmr::polymorphic_allocator<>{std::pmr::get_default_resource()}} {}
+
+msm_state::msm_state(const std::unordered_set<std::string>& outcomes_,
+                     const std::pmr::polymorphic_allocator<>& allocator)
+    : msm_state{std::in_place, make_outcome_set(outcomes_, allocator)} {}
+
+msm_state::msm_state(std::in_place_t, outcome_set outcomes_)
+    : active{false}, cancelled{false}, outcomes{std::move(outcomes_)} {
   if (outcomes.empty()) {
     throw std::logic_error("State must have at least one outcome.");
   }
@@ -26,27 +46,210 @@ auto msm_state::operator()(blackboard::ptr bb) -> std::string {
   return outcome;
 }
 
-auto msm_state::cancel() -> void { cancelled.store(true); }
+auto msm_state::invoke(const blackboard::ptr& bb) -> std::string {
+  begin_execution();
+  try {
+    auto outcome = execute(bb);
+    end_execution();
+    return outcome;
+  } catch (...) {
+    end_execution();
+    throw;
+  }
+}
+
+auto msm_state::invoke(const blackboard::ptr& bb, const std::atomic<bool>& cancel_token) -> std::string {
+  begin_execution(&cancel_token);
+  try {
+    auto outcome = execute(bb);
+    end_execution();
+    return outcome;
+  } catch (...) {
+    end_execution();
+    throw;
+  }
+}
+
+auto msm_state::begin_execution(const std::atomic<bool>* cancel_token) noexcept -> void {
+  cancelled.store(deadline_passed());
+  // checked after the reset: whoever sets the token cancels this state afterwards, or is seen here
+  if (cancel_token && cancel_token->load()) cancelled.store(true);
+  active.store(true);
+}
+
+auto msm_state::end_execution() noexcept -> void { active.store(false); }
+
+auto msm_state::cancel() -> void {
+  cancelled.store(true);
+  auto lock = std::lock_guard(wait_mtx);
+  if (waiting_on) waiting_on->wake_waiters();  // registered before the waiter first checks the flag
+}
+
+auto msm_state::begin_wait(blackboard* bb) const -> void {
+  auto lock = std::lock_guard(wait_mtx);
+  waiting_on = bb;
+}
+
+auto msm_state::end_wait() const noexcept -> void {
+  auto lock = std::lock_guard(wait_mtx);
+  waiting_on = nullptr;
+}
 
 auto msm_state::is_active() const noexcept -> bool { return active.load(); }
 
 auto msm_state::is_cancelled() const noexcept -> bool { return cancelled.load(); }
 
-auto msm_state::get_outcomes() const noexcept -> const std::unordered_set<std::string>& { return outcomes; }
+auto msm_state::get_deadline() const noexcept -> clock::time_point {
+  return clock::time_point{clock::duration{deadline.load()}};
+}
+
+auto msm_state::set_deadline(clock::time_point deadline_) noexcept -> void {
+  deadline.store(deadline_.time_since_epoch().count());
+}
+
+auto msm_state::deadline_passed() const noexcept -> bool {
+  auto until = get_deadline();
+  return until != clock::time_point::max() && until <= clock::now();
+}
+
+auto msm_state::get_outcomes() const -> std::unordered_set<std::string> { return outcomes; }
+
+auto msm_state::get_outcome_set() const noexcept -> const outcome_set& { return outcomes; }
+
+callback_state::~callback_state() {
+  if (callback_func) destroy_func(allocator, callback_func);
+}
 
 auto callback_state::execute(blackboard::ptr bb) -> std::string {
   if (!callback_func) {
     throw std::logic_error("Callback function is not set for callback_state.");
   }
-  return callback_func(bb);
+  return invoke_func(callback_func, std::move(bb));
+}
+
+auto callback_state::to_string() const -> std::string {
+  std::string result = "Callback State with outcomes: ";
+  for (const auto& outcome : outcomes) {
+    result += outcome + ", ";
+  }
+  if (!outcomes.empty()) {
+    result.pop_back();  // Remove last space
+    result.pop_back();  // Remove last comma
+  }
+  return result;
 }
 
+struct parallel_state::compiled_outcomes {
+  static constexpr auto npos = static_cast<std::size_t>(-1);
+  using allocator_type = parallel_state::allocator_type;
+
+  explicit compiled_outcomes(const allocator_type& allocator)
+      : offsets{allocator}, names{allocator}, outcomes{allocator}, required{allocator}, constrained{allocator} {}
+
+  std::pmr::vector<std::size_t> offsets;  // branch -> first bit, size is the branch count + 1
+  std::pmr::vector<std::pmr::string> names;  // bit -> outcome of its branch
+  std::pmr::vector<std::pmr::string> outcomes;
+  std::size_t words = 1;
+  std::pmr::vector<std::uint64_t> required;     // outcome * words + word
+  std::pmr::vector<std::uint64_t> constrained;  // same layout
+
+  auto bit_of(std::size_t branch, std::string_view outcome) const noexcept -> std::size_t {
+    for (auto bit = offsets[branch]; bit < offsets[branch + 1]; ++bit) {
+      if (names[bit] == outcome) return bit;
+    }
+    return npos;
+  }
+
+  // Number of outcomes whose required bits are all set, the first of them, and whether some outcome is still open
+  // (unmet, but no branch it depends on has returned something else)
+  auto match(const std::uint64_t* bits, std::size_t& first, bool& open) const noexcept -> std::size_t {
+    auto satisfied = std::size_t{0};
+    auto undecided = false;
+    if (words == 1) {
+      // branch-free over the outcomes so the compiler can vectorize it
+      const auto word = bits[0];
+      for (auto k = std::size_t{0}; k < outcomes.size(); ++k) {
+        auto met = (word & required[k]) == required[k];
+        auto possible = (word & constrained[k] & ~required[k]) == 0;
+        satisfied += met;
+        undecided |= !met & possible;
+      }
+    } else {
+      for (auto k = std::size_t{0}; k < outcomes.size(); ++k) {
+        auto met = true;
+        auto possible = true;
+        for (auto w = std::size_t{0}; w < words; ++w) {
+          auto need = required[k * words + w];
+          met &= (bits[w] & need) == need;
+          possible &= (bits[w] & constrained[k * words + w] & ~need) == 0;
+        }
+        satisfied += met;
+        undecided |= !met & possible;
+      }
+    }
+
+    first = npos;
+    for (auto k = std::size_t{0}; satisfied > 0 && k < outcomes.size(); ++k) {
+      auto met = true;
+      for (auto w = std::size_t{0}; w < words; ++w) {
+        auto need = required[k * words + w];
+        met &= (bits[w] & need) == need;
+      }
+      if (met) {
+        first = k;
+        break;
+      }
+    }
+    open = undecided;
+    return satisfied;
+  }
+};
+
+struct parallel_state::join_context {
+  join_context(std::size_t branches, std::size_t words_)
+      : words{words_}, bits{std::make_unique<std::atomic<std::uint64_t>[]>(words_)}, remaining(branches) {}
+
+  auto load(std::uint64_t* out) const noexcept -> void {
+    for (auto w = std::size_t{0}; w < words; ++w) out[w] = bits[w].load(std::memory_order_acquire);
+  }
+
+  // branch results, one bit per (branch, outcome) as in compiled_outcomes, published without the mutex
+  std::size_t words;
+  std::unique_ptr<std::atomic<std::uint64_t>[]> bits;
+
+  std::mutex mtx;
+  std::condition_variable changed;
+  std::size_t remaining;
+  std::exception_ptr error;
+  bool finished = false;  // the outcome is decided, branches that have not started yet are skipped
+
+  std::atomic<bool> cancelled{false};  // this execution was cancelled, set before its branches are
+};
+
 parallel_state::parallel_state(const std::unordered_set<msm_state::ptr>& states_, const std::string& default_outcome_,
-                               const std::unordered_map<std::string, state_map>& outcome_map_)
-    : msm_state{generate_outcomes(outcome_map_, default_outcome_)}, states{states_}, default_outcome(default_outcome_) {
+                               const std::unordered_map<std::string, state_map>& outcome_map_,
+                               executor::ptr executor_)
+    : parallel_state{std::allocator_arg, allocator_type{std::pmr::get_default_resource()}, states_, default_outcome_,
+                     outcome_map_, std::move(executor_)} {}
+
+parallel_state::parallel_state(std::allocator_arg_t, const allocator_type& allocator,
+                               const std::unordered_set<msm_state::ptr>& states_, const std::string& default_outcome_,
+                               const std::unordered_map<std::string, state_map>& outcome_map_,
+                               executor::ptr executor_)
+    : msm_state{std::in_place, generate_outcomes(outcome_map_, default_outcome_, allocator)},
+      active{false},
+      branches{states_.begin(), states_.end(), allocator},
+      branch_executor{executor_ ? std::move(executor_) : thread_pool_executor::shared()},
+      policy{join_policy::wait_all},
+      states{states_.begin(), states_.end(), states_.size(), allocator},
+      default_outcome{default_outcome_, allocator},
+      state_outcomes{allocator},
+      outcome_map{allocator},
+      intermediate_outcomes{allocator} {
   for (const auto& [outcome, prerequisites] : outcome_map_) {
+    auto& expected = outcome_map.try_emplace(std::pmr::string{outcome, allocator}).first->second;
     for (const auto& [state, intermediate_outcome] : prerequisites) {
-      if (state->get_outcomes().find(intermediate_outcome) == state->get_outcomes().end()) {
+      if (state->get_outcome_set().find(intermediate_outcome) == state->get_outcome_set().end()) {
         throw std::logic_error("State " + state->to_string() + " does not have outcome " + intermediate_outcome);
       }
 
@@ -54,72 +257,203 @@ parallel_state::parallel_state(const std::unordered_set<msm_state::ptr>& states_
         throw std::logic_error("State " + state->to_string() + " is not part of the parallel_state.");
       }
 
-      intermediate_outcomes.try_emplace(state, nullptr);
+      expected.try_emplace(state, intermediate_outcome);
+      intermediate_outcomes.try_emplace(state);
     }
   }
+
+  // every (branch, outcome of the branch) pair gets a bit, and each outcome of the outcome_map two masks: the bits
+  // it requires, and every bit of the branches it depends on
+  auto table = std::allocate_shared<compiled_outcomes>(allocator);
+  for (const auto& branch : branches) {
+    table->offsets.push_back(table->names.size());
+    table->names.insert(table->names.end(), branch->get_outcome_set().begin(), branch->get_outcome_set().end());
+  }
+  table->offsets.push_back(table->names.size());
+  table->words = std::max<std::size_t>(1, (table->names.size() + 63) / 64);
+
+  for (const auto& [outcome, prerequisites] : outcome_map) {
+    table->outcomes.push_back(outcome);
+    table->required.resize(table->outcomes.size() * table->words);
+    table->constrained.resize(table->outcomes.size() * table->words);
+    auto* required = table->required.data() + (table->outcomes.size() - 1) * table->words;
+    auto* constrained = table->constrained.data() + (table->outcomes.size() - 1) * table->words;
+
+    for (const auto& [state, expected_outcome] : prerequisites) {
+      auto index = static_cast<std::size_t>(std::find(branches.begin(), branches.end(), state) - branches.begin());
+      auto bit = table->bit_of(index, expected_outcome);
+      required[bit / 64] |= std::uint64_t{1} << (bit % 64);
+      for (auto b = table->offsets[index]; b < table->offsets[index + 1]; ++b) {
+        constrained[b / 64] |= std::uint64_t{1} << (b % 64);
+      }
+    }
+  }
+  compiled = std::move(table);
 }
 
+auto parallel_state::set_join_policy(join_policy policy_) noexcept -> void { policy.store(policy_); }
+
+auto parallel_state::get_join_policy() const noexcept -> join_policy { return policy.load(); }
+
 auto parallel_state::execute(blackboard::ptr bb) -> std::string {
-  auto futures = std::vector<std::future<void>>{};
+  const auto mode = policy.load();
+  const auto& table = *compiled;
 
-  for (const auto& state : states) {
-    futures.emplace_back(std::async(std::launch::async, [this, &state, &bb]() -> void {
-      auto outcome = state->execute(bb);
-      auto lock = std::lock_guard(intermediate_mutex);
-      intermediate_outcomes[state] = outcome;
-    }));
-  }
+  // under a deadline every branch runs on the executor and inherits it, so a branch that hangs is abandoned when
+  // the deadline cancels this state instead of holding up the calling thread
+  const auto until = get_deadline();
+  const auto bounded = until != clock::time_point::max();
 
-  for (auto& future : futures) {
-    future.get();  // blocks until each task is done
+  // branches the last execution abandoned may still be running on the same branch states
+  auto previous = std::shared_ptr<join_context>{};
+  {
+    auto lock = std::lock_guard(intermediate_mutex);
+    previous = std::move(abandoned);
+  }
+  if (previous) {
+    auto lock = std::unique_lock(previous->mtx);
+    while (previous->remaining > 0) {
+      lock.unlock();
+      auto ran = branch_executor->try_run_one();  // its skipped branches may be queued behind this thread
+      lock.lock();
+      if (!ran) previous->changed.wait_for(lock, std::chrono::microseconds(200));
+    }
   }
 
-  if (cancelled.load()) {
-    return default_outcome;
+  auto join = std::make_shared<join_context>(branches.size(), table.words);
+  {
+    // checked under the mutex: a cancel() sets the flag before taking it, so it is either seen here or finds the join
+    auto lock = std::lock_guard(intermediate_mutex);
+    join->cancelled.store(deadline_passed() || is_cancelled());
+    current_join = join;
   }
 
-  // Collect all satisfied outcomes from the intermediate outcomes
-  auto all_outcomes = std::unordered_set<std::string>{};
-  for (const auto& [outcome, prerequisites] : outcome_map) {
-    // Check if all intermediate prerequisites for this outcome are met
-    auto all_met = true;
+  // branch tasks only touch the join context and the compiled table, so they may keep running after an early return
+  auto run_branch = [join, bb, table = compiled, until](const msm_state::ptr& state, std::size_t index) -> void {
+    {
+      auto lock = std::lock_guard(join->mtx);
+      if (join->finished || join->cancelled.load()) {
+        --join->remaining;
+        join->changed.notify_all();
+        return;
+      }
+    }
 
-    // Iterate through the prerequisites for this outcome
-    for (const auto& [state, expected_outcome] : prerequisites) {
-      auto it = intermediate_outcomes.find(state);
-      if (it == intermediate_outcomes.end() || it->second != expected_outcome) {
-        all_met = false;
-        break;
+    auto error = std::exception_ptr{};
+    state->set_deadline(until);
+    try {
+      auto outcome = state->invoke(bb, join->cancelled);
+      auto bit = table->bit_of(index, outcome);
+      if (bit == compiled_outcomes::npos) {
+        throw std::logic_error("Invalid outcome: " + outcome + " from state: " + state->to_string());
       }
+      join->bits[bit / 64].fetch_or(std::uint64_t{1} << (bit % 64), std::memory_order_release);
+    } catch (...) {
+      error = std::current_exception();
     }
+    state->set_deadline(clock::time_point::max());
+
+    auto lock = std::lock_guard(join->mtx);
+    if (error && !join->error) join->error = error;
+    --join->remaining;
+    join->changed.notify_all();
+  };
 
-    if (all_met) all_outcomes.insert(outcome);
+  // with wait_all the calling thread takes part in running the branches, early-exit policies and deadlines keep it
+  // free to return: whatever it ran inline could be one of its own branches, which it would then have to finish
+  const auto helps = mode == join_policy::wait_all && !bounded;
+  auto first_submitted = helps ? std::size_t{1} : std::size_t{0};
+  for (auto i = first_submitted; i < branches.size(); ++i) {
+    branch_executor->submit([run_branch, state = branches[i], i]() -> void { run_branch(state, i); });
   }
+  if (first_submitted == 1 && !branches.empty()) run_branch(branches.front(), 0);
 
-  if (all_outcomes.empty()) {
-    return default_outcome;
-  } else if (all_outcomes.size() == 1) {
-    return std::move(*all_outcomes.begin());
-  } else {
-    throw std::logic_error("Multiple outcomes satisfied: " + std::to_string(all_outcomes.size()));
+  // help the executor while waiting for all branches, so nested parallel states on pool threads cannot starve it
+  MSM_TRACE_SCOPE(join, MSM_TRACE_NAME("parallel_state join"));
+  auto results = std::vector<std::uint64_t>(table.words);
+  auto first = std::size_t{0};
+  auto open = false;
+  auto lock = std::unique_lock(join->mtx);
+  while (!join->error && !join->cancelled.load() && join->remaining > 0) {
+    if (mode == join_policy::first_completed && join->remaining < branches.size()) break;
+    if (mode == join_policy::first_decisive) {
+      join->load(results.data());
+      if (table.match(results.data(), first, open) > 0 || !open) break;
+    }
+
+    lock.unlock();
+    auto ran = helps && branch_executor->try_run_one();
+    lock.lock();
+    if (!ran) join->changed.wait_for(lock, std::chrono::microseconds(200));
   }
+  join->finished = true;
+  join->load(results.data());
+  auto error = join->error;
+  auto cancelled = join->cancelled.load();
+  auto unfinished = join->remaining > 0;
+  lock.unlock();
 
-  return default_outcome;  // Fallback if no outcomes are satisfied
+  // a branch has finished if one of its bits is set
+  auto outcome_of = [&](std::size_t branch) -> const std::pmr::string* {
+    for (auto bit = table.offsets[branch]; bit < table.offsets[branch + 1]; ++bit) {
+      if (results[bit / 64] >> (bit % 64) & 1) return &table.names[bit];
+    }
+    return nullptr;
+  };
+
+  {
+    auto intermediate_lock = std::lock_guard(intermediate_mutex);
+    current_join.reset();
+    if (unfinished) abandoned = join;
+    for (auto i = std::size_t{0}; i < branches.size(); ++i) {
+      if (const auto* outcome = outcome_of(i)) intermediate_outcomes[branches[i]] = *outcome;
+    }
+  }
+
+  for (auto i = std::size_t{0}; i < branches.size(); ++i) {
+    if (!outcome_of(i)) branches[i]->cancel();  // siblings still running are no longer needed
+  }
+
+  if (error) std::rethrow_exception(error);
+
+  if (cancelled) {
+    return std::string{default_outcome};
+  }
+
+  auto satisfied = table.match(results.data(), first, open);
+  if (satisfied == 0) {
+    return std::string{default_outcome};
+  } else if (satisfied == 1) {
+    return std::string{table.outcomes[first]};
+  } else {
+    throw std::logic_error("Multiple outcomes satisfied: " + std::to_string(satisfied));
+  }
 }
 
 auto parallel_state::cancel() -> void {
+  msm_state::cancel();  // before the mutex, for an execution that has begun but not published its join yet
+  auto lock = std::lock_guard(intermediate_mutex);  // held throughout, so a later execution is left alone
+  if (!current_join) return;
+  {
+    auto join_lock = std::lock_guard(current_join->mtx);  // the waiter checks cancelled under this mutex
+    current_join->cancelled.store(true);
+    current_join->changed.notify_all();
+  }
+
+  // the token goes first, so a branch that begins after this either sees it or gets the cancel() below
   for (const auto& state : states) {
     state->cancel();
   }
-  cancelled.store(true);
 }
 
 auto parallel_state::generate_outcomes(const std::unordered_map<std::string, state_map>& outcome_map,
-                                       const std::string& default_outcome) -> std::unordered_set<std::string> {
-  auto outcomes = std::unordered_set<std::string>{default_outcome};
+                                       const std::string& default_outcome,
+                                       const std::pmr::polymorphic_allocator<>& allocator) -> outcome_set {
+  auto outcomes = outcome_set{outcome_map.size() + 1, allocator};
+  outcomes.emplace(default_outcome);
 
   for (const auto& [outcome, _] : outcome_map) {
-    outcomes.insert(outcome);
+    outcomes.emplace(outcome);
   }
 
   return outcomes;
@@ -0,0 +1,110 @@
+#include "timer_wheel.hpp"
+
+#include <algorithm>
+
+namespace msm {
+timer_wheel::timer_wheel(clock::duration tick_, std::size_t slot_count)
+    : tick{std::max(tick_, clock::duration{1})}, start{clock::now()}, slots(std::max<std::size_t>(slot_count, 1)) {
+  this->worker = std::thread([this] { this->run(); });
+}
+
+timer_wheel::~timer_wheel() {
+  {
+    auto lock = std::lock_guard(this->mtx);
+    this->stopping = true;
+  }
+  this->wake.notify_one();
+  this->worker.join();
+}
+
+auto timer_wheel::tick_of(clock::time_point time) const noexcept -> std::uint64_t {
+  if (time <= this->start) return 0;
+  return static_cast<std::uint64_t>((time - this->start + this->tick - clock::duration{1}) / this->tick);
+}
+
+auto timer_wheel::schedule(clock::time_point deadline, callback_t callback) -> timer_id {
+  auto lock = std::lock_guard(this->mtx);
+  if (this->pending == 0) {  // nothing to fire in between, skip the idle ticks instead of walking them
+    auto now = clock::now();
+    this->current = std::max(this->current, static_cast<std::uint64_t>((now - this->start) / this->tick));
+  }
+
+  auto due_tick = std::max(this->tick_of(deadline), this->current + 1);
+  auto slot = due_tick % this->slots.size();
+  auto id = this->next_sequence++ * this->slots.size() + slot;
+  this->slots[slot].push_back(timer{id, (due_tick - this->current - 1) / this->slots.size(), std::move(callback)});
+  if (++this->pending == 1) this->wake.notify_one();  // the wheel thread sleeps without a deadline when idle
+  return id;
+}
+
+auto timer_wheel::cancel(timer_id id) -> bool {
+  auto lock = std::unique_lock(this->mtx);
+  auto matches = [id](const timer& t) { return t.id == id; };
+
+  auto& slot = this->slots[id % this->slots.size()];
+  if (auto it = std::find_if(slot.begin(), slot.end(), matches); it != slot.end()) {
+    if (&*it != &slot.back()) *it = std::move(slot.back());
+    slot.pop_back();
+    --this->pending;
+    return true;
+  }
+  if (auto it = std::find_if(this->due.begin(), this->due.end(), matches); it != this->due.end()) {
+    this->due.erase(it);
+    return true;
+  }
+
+  if (this->running == id && std::this_thread::get_id() != this->worker.get_id()) {
+    this->finished.wait(lock, [this, id] { return this->running != id; });
+  }
+  return false;
+}
+
+auto timer_wheel::run() -> void {
+  auto lock = std::unique_lock(this->mtx);
+  while (!this->stopping) {
+    if (this->pending == 0) {
+      this->wake.wait(lock, [this] { return this->stopping || this->pending > 0; });
+      continue;
+    }
+    auto next = this->start + this->tick * static_cast<clock::rep>(this->current + 1);
+    if (clock::now() < next) {
+      this->wake.wait_until(lock, next);
+      continue;
+    }
+
+    // one tick: timers of its slot that have no turns left are due, the others get one turn closer
+    auto& slot = this->slots[++this->current % this->slots.size()];
+    for (auto i = std::size_t{0}; i < slot.size();) {
+      if (slot[i].rounds > 0) {
+        --slot[i].rounds;
+        ++i;
+        continue;
+      }
+      this->due.push_back(std::move(slot[i]));
+      if (i + 1 != slot.size()) slot[i] = std::move(slot.back());
+      slot.pop_back();
+      --this->pending;
+    }
+
+    while (!this->due.empty()) {
+      auto fired = std::move(this->due.front());
+      this->due.erase(this->due.begin());
+      this->running = fired.id;
+      lock.unlock();
+      try {
+        fired.callback();
+      } catch (...) {
+      }
+      fired.callback = nullptr;
+      lock.lock();
+      this->running = 0;
+      this->finished.notify_all();
+    }
+  }
+}
+
+auto timer_wheel::shared() -> const std::shared_ptr<timer_wheel>& {
+  static const auto wheel = std::make_shared<timer_wheel>();
+  return wheel;
+}
+}  // namespace msm
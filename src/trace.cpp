@@ -0,0 +1,284 @@
+#include "trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+namespace msm {
+namespace {
+struct trace_record {
+  std::uint64_t start;
+  std::uint64_t duration;
+  std::uint32_t name;
+  std::uint32_t detail;
+  tracer::kind type;
+};
+
+constexpr auto chunk_size = std::size_t{4096};
+constexpr auto max_chunks = std::size_t{256};  // about 1M records per thread, later records are dropped
+
+// Written by its owning thread only. Readers see the first `published` records: the count is released after each
+// record (and after linking a new chunk) is complete.
+struct thread_buffer {
+  struct chunk {
+    std::array<trace_record, chunk_size> records;
+    std::unique_ptr<chunk> next;
+  };
+
+  std::uint32_t thread = 0;
+  std::unique_ptr<chunk> head = std::make_unique<chunk>();
+  chunk* tail = head.get();
+  std::size_t chunks = 1;
+  std::atomic<std::size_t> published{0};
+  std::atomic<std::uint64_t> dropped{0};
+
+  auto append(const trace_record& r) noexcept -> void {
+    auto count = published.load(std::memory_order_relaxed);
+    auto offset = count % chunk_size;
+    if (count > 0 && offset == 0) {
+      if (!tail->next) {
+        if (chunks == max_chunks) {
+          dropped.fetch_add(1, std::memory_order_relaxed);
+          return;
+        }
+        tail->next = std::unique_ptr<chunk>(new (std::nothrow) chunk);
+        if (!tail->next) {
+          dropped.fetch_add(1, std::memory_order_relaxed);
+          return;
+        }
+        ++chunks;
+      }
+      tail = tail->next.get();
+    }
+    tail->records[offset] = r;
+    published.store(count + 1, std::memory_order_release);
+  }
+
+  template <typename Visitor>
+  auto visit(Visitor&& visitor) const -> void {
+    auto count = published.load(std::memory_order_acquire);
+    const auto* current = head.get();
+    for (auto i = std::size_t{0}; i < count; ++i) {
+      if (i > 0 && i % chunk_size == 0) current = current->next.get();
+      visitor(current->records[i % chunk_size], thread);
+    }
+  }
+};
+
+struct trace_registry {
+  std::mutex mtx;
+  std::vector<std::shared_ptr<thread_buffer>> buffers;  // kept after their threads exit, until exported
+  std::deque<std::string> names;                        // id -> name, deque so references stay valid
+  std::unordered_map<std::string_view, std::uint32_t> ids;
+};
+
+auto registry() -> trace_registry& {
+  static auto instance = trace_registry{};
+  return instance;
+}
+
+auto local_buffer() -> thread_buffer* {
+  thread_local auto buffer = [] {
+    auto created = std::make_shared<thread_buffer>();
+    auto& r = registry();
+    auto lock = std::lock_guard(r.mtx);
+    created->thread = static_cast<std::uint32_t>(r.buffers.size() + 1);
+    r.buffers.push_back(created);
+    return created;
+  }();
+  return buffer.get();
+}
+
+// Copies the buffer list and name table so the visitors run without the registry lock
+auto collect(std::vector<std::shared_ptr<thread_buffer>>& buffers, std::vector<std::string>& names) -> void {
+  auto& r = registry();
+  auto lock = std::lock_guard(r.mtx);
+  buffers = r.buffers;
+  names.assign(r.names.begin(), r.names.end());
+}
+
+auto name_of(const std::vector<std::string>& names, std::uint32_t id) -> const std::string& {
+  static const auto unknown = std::string{"?"};
+  return id < names.size() ? names[id] : unknown;
+}
+
+auto escape_json(const std::string& text) -> std::string {
+  auto result = std::string{};
+  result.reserve(text.size());
+  for (auto c : text) {
+    if (c == '"' || c == '\\') {
+      result += '\\';
+      result += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      result += ' ';
+    } else {
+      result += c;
+    }
+  }
+  return result;
+}
+
+auto kind_name(tracer::kind type) -> const char* {
+  switch (type) {
+    case tracer::kind::state:
+      return "state";
+    case tracer::kind::transition:
+      return "transition";
+    case tracer::kind::callback:
+      return "callback";
+    case tracer::kind::join:
+      return "join";
+  }
+  return "unknown";
+}
+
+auto histograms_of(tracer::kind type) -> std::map<std::string, tracer::histogram> {
+  auto buffers = std::vector<std::shared_ptr<thread_buffer>>{};
+  auto names = std::vector<std::string>{};
+  collect(buffers, names);
+
+  auto result = std::map<std::string, tracer::histogram>{};
+  for (const auto& buffer : buffers) {
+    buffer->visit([&](const trace_record& r, std::uint32_t) {
+      if (r.type == type) result[name_of(names, r.name)].add(r.duration);
+    });
+  }
+  return result;
+}
+}  // namespace
+
+auto tracer::histogram::add(std::uint64_t duration_ns) noexcept -> void {
+  auto bucket = std::size_t{0};
+  while (bucket + 1 < buckets.size() && (duration_ns >> (bucket + 1)) != 0) ++bucket;
+  ++buckets[bucket];
+  ++count;
+  total_ns += duration_ns;
+  max_ns = std::max(max_ns, duration_ns);
+}
+
+auto tracer::histogram::percentile(double fraction) const noexcept -> std::uint64_t {
+  auto wanted = static_cast<std::uint64_t>(fraction * static_cast<double>(count));
+  auto seen = std::uint64_t{0};
+  for (auto bucket = std::size_t{0}; bucket < buckets.size(); ++bucket) {
+    seen += buckets[bucket];
+    if (seen > wanted || seen == count) return std::min(max_ns, (std::uint64_t{2} << bucket) - 1);
+  }
+  return max_ns;
+}
+
+auto tracer::intern(std::string_view name) -> std::uint32_t {
+  auto& r = registry();
+  auto lock = std::lock_guard(r.mtx);
+  if (auto it = r.ids.find(name); it != r.ids.end()) return it->second;
+
+  auto id = static_cast<std::uint32_t>(r.names.size());
+  const auto& stored = r.names.emplace_back(name);
+  r.ids.emplace(stored, id);
+  return id;
+}
+
+auto tracer::record(kind type, std::uint32_t name, std::uint32_t detail, std::uint64_t start,
+                    std::uint64_t end) noexcept -> void {
+  local_buffer()->append(trace_record{start, end - start, name, detail, type});
+}
+
+auto tracer::state_histograms() -> std::map<std::string, histogram> { return histograms_of(kind::state); }
+
+auto tracer::transition_counts() -> std::map<std::string, std::uint64_t> {
+  auto buffers = std::vector<std::shared_ptr<thread_buffer>>{};
+  auto names = std::vector<std::string>{};
+  collect(buffers, names);
+
+  auto result = std::map<std::string, std::uint64_t>{};
+  for (const auto& buffer : buffers) {
+    buffer->visit([&](const trace_record& r, std::uint32_t) {
+      if (r.type == kind::transition) ++result[name_of(names, r.name) + " -> " + name_of(names, r.detail)];
+    });
+  }
+  return result;
+}
+
+auto tracer::dropped() noexcept -> std::uint64_t {
+  auto& r = registry();
+  auto lock = std::lock_guard(r.mtx);
+  auto total = std::uint64_t{0};
+  for (const auto& buffer : r.buffers) total += buffer->dropped.load(std::memory_order_relaxed);
+  return total;
+}
+
+auto tracer::write_chrome_trace(std::ostream& out) -> void {
+  auto buffers = std::vector<std::shared_ptr<thread_buffer>>{};
+  auto names = std::vector<std::string>{};
+  collect(buffers, names);
+
+  // timestamps are microseconds with fractional nanoseconds
+  auto micros = [](std::uint64_t ns) -> std::string {
+    auto text = std::to_string(ns / 1000) + "." + std::to_string(1000 + ns % 1000);
+    text.erase(text.size() - 4, 1);  // drop the padding digit
+    return text;
+  };
+
+  out << "{\"traceEvents\":[";
+  auto first = true;
+  for (const auto& buffer : buffers) {
+    buffer->visit([&](const trace_record& r, std::uint32_t thread) {
+      out << (first ? "" : ",") << "\n{\"cat\":\"" << kind_name(r.type) << "\",\"pid\":1,\"tid\":" << thread
+          << ",\"ts\":" << micros(r.start);
+      first = false;
+
+      auto name = escape_json(name_of(names, r.name));
+      if (r.type == kind::transition) {
+        out << ",\"ph\":\"i\",\"s\":\"t\",\"name\":\"" << name << " -> " << escape_json(name_of(names, r.detail))
+            << "\"}";
+      } else {
+        out << ",\"ph\":\"X\",\"dur\":" << micros(r.duration) << ",\"name\":\"" << name << "\"";
+        if (r.detail != no_detail) out << ",\"args\":{\"detail\":\"" << escape_json(name_of(names, r.detail)) << "\"}";
+        out << "}";
+      }
+    });
+  }
+  out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+}
+
+auto tracer::summary() -> std::string {
+  auto out = std::ostringstream{};
+  auto table = [&out](const char* title, const std::map<std::string, histogram>& rows) {
+    if (rows.empty()) return;
+    out << title << ": count, total / mean / p50 / p99 / max in us\n";
+    for (const auto& [name, h] : rows) {
+      auto us = [](std::uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+      out << "  " << name << ": " << h.count << ", " << us(h.total_ns) << " / " << us(h.total_ns / h.count) << " / "
+          << us(h.percentile(0.5)) << " / " << us(h.percentile(0.99)) << " / " << us(h.max_ns) << '\n';
+    }
+  };
+
+  table("states", histograms_of(kind::state));
+  table("callbacks", histograms_of(kind::callback));
+  table("parallel joins", histograms_of(kind::join));
+
+  auto transitions = transition_counts();
+  if (!transitions.empty()) {
+    out << "transitions: count\n";
+    for (const auto& [name, count] : transitions) out << "  " << name << ": " << count << '\n';
+  }
+  if (auto lost = dropped()) out << "dropped records: " << lost << '\n';
+  return out.str();
+}
+
+auto tracer::clear() -> void {
+  auto& r = registry();
+  auto lock = std::lock_guard(r.mtx);
+  for (const auto& buffer : r.buffers) {
+    buffer->head->next.reset();
+    buffer->tail = buffer->head.get();
+    buffer->chunks = 1;
+    buffer->published.store(0);
+    buffer->dropped.store(0);
+  }
+}
+}  // namespace msm
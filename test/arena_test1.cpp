@@ -0,0 +1,181 @@
+#include "arena.hpp"
+#include "engine.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+using msm::blackboard;
+using msm::callback_state;
+using msm::machine_arena;
+using msm::msm_engine;
+using msm::msm_state;
+using msm::parallel_state;
+
+namespace {
+std::atomic<std::size_t> allocations{0};
+
+// Upstream of the arena: counts the blocks it hands out and gets back. They come from malloc, so that the counting
+// operator new below only sees what bypasses the arena
+class counting_resource final : public std::pmr::memory_resource {
+ public:
+  std::size_t allocations = 0;
+  std::size_t outstanding = 0;
+
+ private:
+  auto do_allocate(std::size_t bytes, std::size_t alignment) -> void* override {
+    ++allocations;
+    ++outstanding;
+    alignment = std::max(alignment, alignof(std::max_align_t));
+    if (auto* memory = std::aligned_alloc(alignment, (bytes + alignment - 1) / alignment * alignment)) return memory;
+    throw std::bad_alloc{};
+  }
+  auto do_deallocate(void* p, std::size_t, std::size_t) -> void override {
+    --outstanding;
+    std::free(p);
+  }
+  auto do_is_equal(const std::pmr::memory_resource& other) const noexcept -> bool override { return this == &other; }
+};
+
+// Written against the std containers the outcomes used to be
+class legacy_state final : public msm_state {
+ public:
+  legacy_state() : msm_state{{"next"}} {
+    outcomes.insert(std::string{"skipped"});
+    auto copy = std::unordered_set<std::string>{outcomes};
+    if (copy.size() != 2) throw std::logic_error("outcomes did not convert");
+  }
+
+  auto execute(blackboard::ptr) -> std::string override { return "next"; }
+  auto to_string() const -> std::string override { return "Legacy State"; }
+};
+
+auto make_step(const std::string& key) {
+  return [key](blackboard::ptr bb) -> std::string {
+    bb->set<int>(key, bb->get<int>(key).value_or(0) + 1);
+    return "next";
+  };
+}
+}  // namespace
+
+// counts every heap allocation of the process, as in engine_test4
+[[gnu::noinline]] auto operator new(std::size_t size) -> void* {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (auto* memory = std::malloc(size ? size : 1)) return memory;
+  throw std::bad_alloc{};
+}
+[[gnu::noinline]] auto operator new[](std::size_t size) -> void* { return ::operator new(size); }
+[[gnu::noinline]] auto operator delete(void* memory) noexcept -> void { std::free(memory); }
+[[gnu::noinline]] auto operator delete(void* memory, std::size_t) noexcept -> void { ::operator delete(memory); }
+[[gnu::noinline]] auto operator delete[](void* memory) noexcept -> void { ::operator delete(memory); }
+[[gnu::noinline]] auto operator delete[](void* memory, std::size_t) noexcept -> void { ::operator delete(memory); }
+
+auto main(int argc, char** argv) -> int {
+  auto upstream = counting_resource{};
+  {
+    auto arena = machine_arena{4096, &upstream};
+
+    // the arguments are built up front, so that only the machine itself is counted
+    auto engine_outcomes = std::unordered_set<std::string>{"done", "failed"};
+    auto step_outcomes = std::unordered_set<std::string>{"next"};
+    auto names = std::vector<std::string>{};
+    auto transitions = std::vector<std::unordered_map<std::string, std::string>>{};
+    for (auto i = 0; i < 20; ++i) {
+      names.push_back("s" + std::to_string(i));
+      transitions.push_back({{"next", i + 1 < 20 ? "s" + std::to_string(i + 1) : std::string{"fork"}}});
+    }
+    auto fork_transitions = std::unordered_map<std::string, std::string>{{"joined", "done"}};
+    auto pool = msm::thread_pool_executor::shared();
+
+    // s0 -> ... -> s19 -> fork (two branches) -> done, every object of the machine made in the arena, without a
+    // single global heap allocation
+    auto heap_before = allocations.load();
+    auto engine = arena.make<msm_engine>(engine_outcomes);
+    for (auto i = 0; i < 20; ++i) {
+      engine->add_state(names[i], arena.make<callback_state>(make_step(names[i]), step_outcomes), transitions[i]);
+    }
+    auto left = arena.make<callback_state>(make_step("left"), step_outcomes);
+    auto right = arena.make<callback_state>(make_step("right"), step_outcomes);
+    auto heap_allocations = allocations.load() - heap_before;
+
+    auto branches = std::unordered_set<msm_state::ptr>{left, right};
+    auto outcome_map = std::unordered_map<std::string, std::unordered_map<msm_state::ptr, std::string>>{
+        {"joined", {{left, "next"}, {right, "next"}}}};
+
+    heap_before = allocations.load();
+    auto fork = arena.make<parallel_state>(branches, "failed", outcome_map, pool);
+    engine->add_state("fork", fork, fork_transitions);
+    heap_allocations += allocations.load() - heap_before;
+
+    if (heap_allocations != 0) {
+      std::cerr << "building the machine made " << heap_allocations << " global heap allocations\n";
+      return 1;
+    }
+    engine->validate();
+
+    if (engine->get_state_table().get_allocator().resource() != &arena) {
+      std::cerr << "engine tables are not in the arena\n";
+      return 1;
+    }
+
+    auto bb = arena.make<blackboard>();
+    auto before = arena.bytes_allocated();
+    for (auto i = 0; i < 3; ++i) {
+      if (engine->execute(bb) != "done") {
+        std::cerr << "arena machine did not finish\n";
+        return 1;
+      }
+    }
+    if (bb->get<int>("s19") != 3 || bb->get<int>("left") != 3 || bb->get<int>("right") != 3) {
+      std::cerr << "arena machine ran its states the wrong number of times\n";
+      return 1;
+    }
+    if (arena.bytes_allocated() <= before) {
+      std::cerr << "blackboard storage is not in the arena\n";
+      return 1;
+    }
+
+    // a copy made in the arena keeps the values, one made on the heap does not borrow the arena
+    auto copy = arena.make<blackboard>(*bb);
+    auto heap_copy = bb->clone();
+    if (copy->get<int>("s0") != 3 || heap_copy->get<int>("s0") != 3) {
+      std::cerr << "blackboard copies lost values\n";
+      return 1;
+    }
+
+    // dozens of objects and tables from a handful of upstream blocks
+    if (upstream.allocations == 0 || upstream.allocations > 8) {
+      std::cerr << "arena took " << upstream.allocations << " blocks from upstream\n";
+      return 1;
+    }
+  }
+
+  // everything went back in one go with the arena
+  if (upstream.outstanding != 0) {
+    std::cerr << upstream.outstanding << " blocks outlived the arena\n";
+    return 1;
+  }
+
+  // the default construction path is unchanged
+  auto engine = std::make_shared<msm_engine>(std::unordered_set<std::string>{"done"});
+  auto only = std::make_shared<callback_state>(make_step("only"), std::unordered_set<std::string>{"next"});
+  engine->add_state("only", only, {{"next", "done"}});
+  if (engine->get_state_table().get_allocator().resource() != std::pmr::get_default_resource() ||
+      engine->execute(std::make_shared<blackboard>(8)) != "done") {
+    std::cerr << "default engine broken\n";
+    return 1;
+  }
+
+  // and so are the std-typed getters
+  auto legacy = std::make_shared<legacy_state>();
+  engine->add_state("legacy", legacy, {{"skipped", "done"}});
+  auto outcomes = std::unordered_set<std::string>{legacy->get_outcomes()};
+  auto states = std::unordered_map<std::string, msm_state::ptr>{engine->get_states()};
+  auto transitions = engine->get_transitions("legacy");
+  if (outcomes != std::unordered_set<std::string>{"next", "skipped"} || states.at("legacy") != legacy ||
+      transitions.at("legacy").at("skipped") != "done") {
+    std::cerr << "std-typed accessors broken\n";
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,112 @@
+#include "engine.hpp"
+#include <iostream>
+
+using msm::async_state;
+using msm::blackboard;
+using msm::callback_state;
+using msm::msm_engine;
+using msm::task;
+
+namespace {
+// Waits on a timer without blocking the thread, then reports how many times it has been run on this blackboard
+class timer_state : public async_state {
+ public:
+  timer_state() : async_state{{"again", "done"}} {}
+
+  auto execute_async(blackboard::ptr bb) -> task<std::string> override {
+    co_await msm::sleep_for(std::chrono::milliseconds(20));
+    auto& waits = bb->operator[]<int>("waits");
+    co_return ++waits < 2 ? "again" : "done";
+  }
+
+  auto to_string() const -> std::string override { return "Timer State"; }
+};
+
+auto make_engine() -> std::shared_ptr<msm_engine> {
+  auto inner = std::make_shared<msm_engine>(std::unordered_set<std::string>{"waited"});
+  inner->add_state("wait", std::make_shared<timer_state>(), {{"again", "wait"}, {"done", "waited"}});
+
+  auto engine = std::make_shared<msm_engine>(std::unordered_set<std::string>{"finished"});
+  engine->add_state("inner", inner, {{"waited", "count"}});
+  engine->add_state("count",
+                    std::make_shared<callback_state>(
+                        [](blackboard::ptr bb) -> std::string {
+                          bb->set<bool>("counted", true);
+                          return "ok";
+                        },
+                        std::unordered_set<std::string>{"ok"}),
+                    {{"ok", "finished"}});
+  return engine;
+}
+}  // namespace
+
+auto main(int argc, char** argv) -> int {
+  // a thousand machines, each waiting 2 x 20ms, multiplexed on the calling thread
+  constexpr auto machines = 1000;
+  auto loop = msm::event_loop{};
+  auto engines = std::vector<std::shared_ptr<msm_engine>>{};
+  auto boards = std::vector<blackboard::ptr>{};
+  auto finished = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (auto i = 0; i < machines; ++i) {
+    engines.push_back(make_engine());
+    boards.push_back(std::make_shared<blackboard>());
+    loop.spawn(engines.back()->execute_async(boards.back()),
+               [&finished](std::optional<std::string> outcome, std::exception_ptr error) -> void {
+                 if (!error && outcome == "finished") ++finished;
+               });
+  }
+  loop.run();
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  if (finished != machines || elapsed > std::chrono::seconds(5)) {
+    std::cerr << finished << " machines finished in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << "ms\n";
+    return 1;
+  }
+  for (const auto& bb : boards) {
+    if (bb->get<int>("waits") != 2 || bb->get<bool>("counted") != true) {
+      std::cerr << "unexpected blackboard " << bb->serialize() << '\n';
+      return 1;
+    }
+  }
+
+  // the synchronous entry point drives async states on a private loop
+  auto bb = std::make_shared<blackboard>();
+  if (make_engine()->execute(bb) != "finished" || bb->get<int>("waits") != 2) {
+    std::cerr << "synchronous execution of async states failed\n";
+    return 1;
+  }
+
+  // a stop() before run() is not lost, and restart() lets the remaining work finish
+  auto stopped_loop = msm::event_loop{};
+  auto stopped_result = std::optional<std::string>{};
+  auto stopped_engine = make_engine();
+  stopped_loop.stop();
+  stopped_loop.spawn(stopped_engine->execute_async(std::make_shared<blackboard>()),
+                     [&stopped_result](std::optional<std::string> outcome, std::exception_ptr) -> void {
+                       stopped_result = std::move(outcome);
+                     });
+  stopped_loop.run();
+  if (stopped_result) {
+    std::cerr << "run() ignored an earlier stop()\n";
+    return 1;
+  }
+  stopped_loop.restart();
+  stopped_loop.run();
+  if (stopped_result != "finished") {
+    std::cerr << "restart() did not resume the loop\n";
+    return 1;
+  }
+
+  // timer awaitables need a loop thread
+  try {
+    msm::yield();
+    std::cerr << "yield() off a loop thread did not throw\n";
+    return 1;
+  } catch (const std::logic_error&) {
+  }
+
+  return 0;
+}
@@ -0,0 +1,142 @@
+#include "batch.hpp"
+#include <iostream>
+
+using msm::blackboard;
+using msm::callback_state;
+using msm::msm_batch;
+using msm::msm_engine;
+
+namespace {
+// An engine run as an opaque state, flags a run that overlaps another one
+class guarded_engine final : public msm_engine {
+ public:
+  std::atomic<int> inside{0};
+  std::atomic<bool> overlapped{false};
+
+  guarded_engine() : msm_engine{std::unordered_set<std::string>{"done"}} {}
+
+  auto execute(blackboard::ptr bb) -> std::string override {
+    if (this->inside.fetch_add(1) != 0) this->overlapped = true;
+    auto result = msm_engine::execute(bb);
+    this->inside.fetch_sub(1);
+    return result;
+  }
+};
+}  // namespace
+
+auto main(int argc, char** argv) -> int {
+  auto engine = std::make_shared<msm_engine>(std::unordered_set<std::string>{"even", "odd"});
+  engine->add_state("count",
+                    std::make_shared<callback_state>(
+                        [](blackboard::ptr bb) -> std::string {
+                          auto& count = bb->operator[]<int>("count");
+                          return ++count < bb->get<int>("limit").value_or(1) ? "again" : "check";
+                        },
+                        std::unordered_set<std::string>{"again", "check"}),
+                    {{"again", "count"}, {"check", "check"}});
+  engine->add_state("check",
+                    std::make_shared<callback_state>(
+                        [](blackboard::ptr bb) -> std::string { return *bb->get<int>("count") % 2 ? "odd" : "even"; },
+                        std::unordered_set<std::string>{"even", "odd"}),
+                    {{"even", "even"}, {"odd", "odd"}});
+
+  std::atomic<int> ended{0};
+  engine->add_end_callback(
+      [&ended](blackboard::ptr, const std::string&, const std::vector<std::string>&) -> void { ++ended; });
+
+  // instances run different numbers of steps over the same definition
+  constexpr auto instances = 10000;
+  auto batch = msm_batch{engine};
+  for (auto i = 0; i < instances; ++i) {
+    auto instance = batch.spawn();
+    batch.get_blackboard(instance)->set<int>("limit", 1 + i % 5);
+  }
+
+  batch.step_all(256);
+  if (batch.running_count() != instances || batch.get_current_state(0) != "check" ||
+      batch.get_current_state(1) != "count") {
+    std::cerr << "unexpected state after one step: " << batch.get_current_state(1) << '\n';
+    return 1;
+  }
+
+  batch.execute_batch(256);
+  if (batch.running_count() != 0 || ended != instances) {
+    std::cerr << batch.running_count() << " instances still running, " << ended << " ended\n";
+    return 1;
+  }
+  for (auto i = 0; i < instances; ++i) {
+    auto expected = (1 + i % 5) % 2 ? "odd" : "even";
+    if (batch.get_outcome(i) != expected) {
+      std::cerr << "instance " << i << " finished with " << batch.get_outcome(i).value_or("nothing") << '\n';
+      return 1;
+    }
+  }
+
+  // released slots and their blackboards are reused
+  auto old_board = batch.get_blackboard(7);
+  batch.release(7);
+  auto reused = batch.spawn();
+  if (reused != 7 || batch.get_blackboard(reused) != old_board || batch.get_blackboard(reused)->get<int>("count") ||
+      batch.size() != instances) {
+    std::cerr << "released instance was not reused\n";
+    return 1;
+  }
+
+  // a slot released twice would be handed out twice
+  batch.release(reused);
+  try {
+    batch.release(reused);
+    std::cerr << "releasing an instance twice did not throw\n";
+    return 1;
+  } catch (const std::logic_error&) {
+  }
+  if (batch.spawn() != reused || batch.spawn() == reused) {
+    std::cerr << "a released slot was handed out twice\n";
+    return 1;
+  }
+
+  // a state that keeps per-run data never runs for two instances at once
+  auto inner = std::make_shared<guarded_engine>();
+  inner->add_state("work",
+                   std::make_shared<callback_state>(
+                       [](blackboard::ptr bb) -> std::string {
+                         bb->set<int>("worked", bb->get<int>("worked").value_or(0) + 1);
+                         return "ok";
+                       },
+                       std::unordered_set<std::string>{"ok"}),
+                   {{"ok", "done"}});
+  auto outer = std::make_shared<msm_engine>(std::unordered_set<std::string>{"finished"});
+  outer->add_state("inner", inner, {{"done", "finished"}});
+  auto serial = msm_batch{outer};
+  for (auto i = 0; i < 2000; ++i) serial.spawn();
+  serial.execute_batch(16);
+  if (inner->overlapped || serial.running_count() != 0 || serial.get_outcome(1999) != "finished" ||
+      serial.get_blackboard(0)->get<int>("worked") != 1) {
+    std::cerr << "stateful state ran concurrently or instances did not finish\n";
+    return 1;
+  }
+
+  // time budgets are rejected rather than ignored
+  auto timed = std::make_shared<msm_engine>(std::unordered_set<std::string>{"even", "odd"});
+  timed->add_state("check",
+                   std::make_shared<callback_state>([](blackboard::ptr) -> std::string { return "even"; },
+                                                    std::unordered_set<std::string>{"even", "odd"}),
+                   {{"even", "even"}, {"odd", "odd"}});
+  timed->set_state_timeout("check", std::chrono::seconds(1), "odd");
+  try {
+    auto rejected = msm_batch{timed};
+    std::cerr << "state timeout was accepted by a batch\n";
+    return 1;
+  } catch (const std::invalid_argument&) {
+  }
+  timed->set_state_timeout("check", std::chrono::nanoseconds(0), "odd");
+  timed->set_timeout(std::chrono::seconds(1), "odd");
+  try {
+    auto rejected = msm_batch{timed};
+    std::cerr << "run budget was accepted by a batch\n";
+    return 1;
+  } catch (const std::invalid_argument&) {
+  }
+
+  return 0;
+}
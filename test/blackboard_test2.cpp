@@ -0,0 +1,43 @@
+#include "blackboard.hpp"
+#include <iostream>
+
+using msm::blackboard;
+
+auto main(int argc, char** argv) -> int {
+  blackboard bb;
+
+  auto speed = bb.resolve<double>("speed");
+  auto ticks = bb.resolve<int>("ticks");
+
+  if (bb.get(speed).has_value() || bb.contains("speed")) {
+    std::cerr << "resolved key should not create a value\n";
+    return 1;
+  }
+
+  bb.set(speed, 1.5);
+  bb[ticks] += 2;
+  bb.set<int>("ticks", bb.get<int>("ticks").value_or(0) + 1);
+
+  if (bb.get<double>("speed") != 1.5 || bb.get(ticks) != 3 || bb.size() != 2) {
+    std::cerr << "key access does not match name access\n";
+    return 1;
+  }
+
+  try {
+    bb.resolve<std::string>("speed");
+    std::cerr << "resolving with the wrong type should throw\n";
+    return 1;
+  } catch (const std::runtime_error&) {
+  }
+
+  // keys stay valid across remove() and for copies of the blackboard
+  bb.remove("speed");
+  blackboard copy{bb};
+  copy.set(speed, 2.5);
+  if (bb.contains("speed") || copy.get<double>("speed") != 2.5 || copy.get(ticks) != 3) {
+    std::cerr << "keys should survive remove() and copies\n";
+    return 1;
+  }
+
+  return 0;
+}
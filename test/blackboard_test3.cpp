@@ -0,0 +1,46 @@
+#include "blackboard.hpp"
+#include <iostream>
+
+using msm::blackboard;
+
+struct point {
+  double x, y;
+};
+
+auto main(int argc, char** argv) -> int {
+  auto bb = std::make_shared<blackboard>(8);
+
+  auto position = bb->resolve<point>("position");
+  bb->set(position, point{1.0, 2.0});
+  bb->set<std::string>("name", "rover");
+  bb->set<int>("ticks", 7);
+
+  // references handed out by operator[] must survive growth past a page
+  auto& ticks = bb->operator[]<int>("ticks");
+  for (auto i = 0; i < 100; ++i) bb->set<int>("filler_" + std::to_string(i), i);
+  ticks += 1;
+
+  auto copy = bb->clone();
+  copy->set<std::string>("name", "lander");
+  copy->operator[](position).x = 5.0;
+
+  if (bb->get<std::string>("name") != "rover" || bb->get(position)->x != 1.0 || copy->get<int>("ticks") != 8 ||
+      copy->get(position)->x != 5.0 || copy->size() != bb->size()) {
+    std::cerr << "clone should be deep: " << copy->serialize() << '\n';
+    return 1;
+  }
+
+  // reset keeps keys and storage, only the values go away
+  bb->reset();
+  if (bb->size() != 0 || bb->get(position).has_value()) {
+    std::cerr << "reset should drop values\n";
+    return 1;
+  }
+  bb->set(position, point{3.0, 4.0});
+  if (bb->get<point>("position")->y != 4.0 || bb->size() != 1) {
+    std::cerr << "keys should survive reset\n";
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,79 @@
+#include "blackboard.hpp"
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using msm::blackboard;
+
+struct pair {
+  long first, second;  // always written equal, a torn read would see them differ
+};
+
+auto main(int argc, char** argv) -> int {
+  blackboard bb;
+  auto value = bb.resolve<pair>("pair");
+  bb.set(value, pair{0, 0});
+
+  auto torn = std::atomic<int>{0};
+  auto readers = std::vector<std::thread>{};
+  for (auto t = 0; t < 4; ++t) {
+    readers.emplace_back([&]() {
+      for (auto i = 0; i < 100000; ++i) {
+        auto current = bb.get(value);
+        if (!current || current->first != current->second) ++torn;
+        auto by_name = bb.get<pair>("pair");
+        if (!by_name || by_name->first != by_name->second) ++torn;
+      }
+    });
+  }
+
+  for (auto i = 1L; i <= 100000; ++i) {
+    bb.set(value, pair{i, i});
+    if (i % 1000 == 0) bb.set<int>("filler_" + std::to_string(i), 0);  // grow while readers are running
+  }
+  for (auto& reader : readers) reader.join();
+
+  if (torn.load() != 0) {
+    std::cerr << torn.load() << " torn reads\n";
+    return 1;
+  }
+
+  // clear() under lock-free readers: pages stay alive, and a key resolved before it never sees a newer key's value
+  auto cleared = blackboard{};
+  auto old = cleared.resolve<int>("old");
+  cleared.set(old, -1);
+  auto leaked = std::atomic<int>{0};
+  auto done = std::atomic<bool>{false};
+  auto reader = std::thread([&]() {
+    while (!done.load()) {
+      if (auto current = cleared.get(old); current && *current != -1) ++leaked;
+    }
+  });
+  for (auto i = 0; i < 20000; ++i) {
+    cleared.clear();
+    cleared.set<int>("new", i);  // takes the slot "old" had
+  }
+  done = true;
+  reader.join();
+  if (leaked.load() != 0 || cleared.get(old)) {
+    std::cerr << leaked.load() << " reads through a stale key saw another key's value\n";
+    return 1;
+  }
+  try {
+    cleared.set(old, 1);
+    std::cerr << "writing through a stale key did not throw\n";
+    return 1;
+  } catch (const std::runtime_error&) {
+  }
+
+  // no fixed limit on the number of keys
+  auto large = blackboard{};
+  for (auto i = 0; i < 20000; ++i) large.set<int>("key_" + std::to_string(i), i);
+  if (large.size() != 20000 || large.get<int>("key_19999") != 19999 ||
+      large.get(large.resolve<int>("key_9000")) != 9000) {
+    std::cerr << "blackboard lost keys past the first pages\n";
+    return 1;
+  }
+
+  return 0;
+}
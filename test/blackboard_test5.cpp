@@ -0,0 +1,69 @@
+#include "engine.hpp"
+#include <iostream>
+
+using msm::blackboard;
+using msm::callback_state;
+using msm::msm_engine;
+
+auto main(int argc, char** argv) -> int {
+  auto bb = blackboard{};
+  bb.set<int>("a", 1);
+  bb.set<int>("b", 2);
+  auto start = bb.get_version();
+
+  bb.set<int>("b", 3);
+  bb.operator[]<int>("c") = 4;
+  bb.remove("a");
+  if (bb.changes_since(start) != std::vector<std::string>{"a", "b", "c"} ||
+      !bb.changes_since(bb.get_version()).empty()) {
+    std::cerr << "unexpected changes since version " << start << '\n';
+    return 1;
+  }
+
+  // once the journal has wrapped, old versions are answered from the per-slot versions
+  for (auto i = 0; i < 1000; ++i) bb.set<int>("b", i);
+  auto changes = bb.changes_since(start);
+  if (changes != std::vector<std::string>{"a", "b", "c"} || bb.changes_since(bb.get_version() - 1).size() != 1) {
+    std::cerr << "journal overflow lost changes\n";
+    return 1;
+  }
+
+  // copies keep the history
+  auto copy = blackboard{bb};
+  if (copy.get_version() != bb.get_version() || copy.changes_since(start) != changes) {
+    std::cerr << "copy lost the change history\n";
+    return 1;
+  }
+
+  // transition callbacks can receive the keys each state wrote
+  auto engine = msm_engine{{"done"}};
+  engine.add_state("write",
+                   std::make_shared<callback_state>(
+                       [](blackboard::ptr board) -> std::string {
+                         board->set<int>("x", 1);
+                         board->set<std::string>("y", "written");
+                         return "next";
+                       },
+                       std::unordered_set<std::string>{"next"}),
+                   {{"next", "read"}});
+  engine.add_state("read",
+                   std::make_shared<callback_state>(
+                       [](blackboard::ptr board) -> std::string { return board->get<int>("x") ? "ok" : "missing"; },
+                       std::unordered_set<std::string>{"ok", "missing"}),
+                   {{"ok", "done"}, {"missing", "done"}});
+
+  auto written = std::vector<std::string>{};
+  engine.add_transition_callback([&written](blackboard::ptr, const std::string& from, const std::string&,
+                                            const std::string&, const std::vector<std::string>& keys,
+                                            const std::vector<std::string>&) -> void {
+    if (from == "write") written = keys;
+  });
+
+  engine.execute(std::make_shared<blackboard>());
+  if (written != std::vector<std::string>{"x", "y"}) {
+    std::cerr << "transition callback got " << written.size() << " written keys\n";
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,110 @@
+#include "state.hpp"
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+using msm::blackboard;
+using msm::callback_state;
+
+auto main(int argc, char** argv) -> int {
+  using namespace std::chrono_literals;
+  auto bb = std::make_shared<blackboard>();
+
+  // watch callbacks run on the writer
+  auto seen = std::vector<std::string>{};
+  auto id = bb->watch("ready", [&seen, &bb](const std::string& key) -> void {
+    seen.push_back(key + "=" + std::to_string(bb->get<int>(key).value_or(-1)));
+  });
+  bb->set<int>("ready", 1);
+  bb->set<int>("other", 2);
+  bb->remove("ready");
+  bb->unwatch(id);
+  bb->set<int>("ready", 3);
+  if (seen != std::vector<std::string>{"ready=1", "ready=-1"}) {
+    std::cerr << "unexpected watch notifications: " << seen.size() << '\n';
+    return 1;
+  }
+
+  // a blocked waiter is woken by the publishing thread
+  auto publisher = std::thread([&bb]() -> void {
+    for (auto i = 4; i <= 10; ++i) {
+      std::this_thread::sleep_for(2ms);
+      bb->set<int>("ready", i);
+    }
+  });
+  auto value = bb->wait_for<int>("ready", [](int v) { return v >= 10; }, 5s);
+  publisher.join();
+  if (value != 10) {
+    std::cerr << "wait_for returned " << value.value_or(-1) << '\n';
+    return 1;
+  }
+
+  // a clear() during the wait moves the waiter to the key's new slot
+  auto cleared = std::thread([&bb]() -> void {
+    std::this_thread::sleep_for(20ms);
+    bb->clear();
+    bb->set<int>("first", 1);  // takes the first slot, the waited key gets another one than before
+    std::this_thread::sleep_for(20ms);
+    bb->set<int>("ready", 11);
+  });
+  auto start = std::chrono::steady_clock::now();
+  auto after_clear = bb->wait_for<int>("ready", [](int v) { return v == 11; }, 5s);
+  cleared.join();
+  if (after_clear != 11 || std::chrono::steady_clock::now() - start > 2s) {
+    std::cerr << "a set() after clear() did not wake the waiter\n";
+    return 1;
+  }
+
+  // timeouts and cancellation end the wait
+  start = std::chrono::steady_clock::now();
+  if (bb->wait_for<int>("never", [](int) { return true; }, 20ms) ||
+      std::chrono::steady_clock::now() - start < 20ms) {
+    std::cerr << "wait_for did not time out\n";
+    return 1;
+  }
+
+  auto waiting = std::make_shared<callback_state>(
+      [](blackboard::ptr) -> std::string { return "done"; }, std::unordered_set<std::string>{"done"});
+  auto canceller = std::thread([&waiting]() -> void {
+    std::this_thread::sleep_for(20ms);
+    waiting->cancel();
+  });
+  start = std::chrono::steady_clock::now();
+  auto cancelled = waiting->wait_for<int>(bb, "never", [](int) { return true; }, 10s);
+  canceller.join();
+  if (cancelled || std::chrono::steady_clock::now() - start > 5s) {
+    std::cerr << "cancelling the state did not end the wait\n";
+    return 1;
+  }
+
+  // any cancellation source can wake waiters without polling
+  auto stop = std::atomic<bool>{false};
+  auto stopper = std::thread([&stop, &bb]() -> void {
+    std::this_thread::sleep_for(20ms);
+    stop.store(true);
+    bb->wake_waiters();
+  });
+  start = std::chrono::steady_clock::now();
+  auto stopped = bb->wait_for<int>("never", [](int) { return true; }, 10s, [&stop] { return stop.load(); });
+  stopper.join();
+  if (stopped || std::chrono::steady_clock::now() - start > 5s) {
+    std::cerr << "wake_waiters() did not end the wait\n";
+    return 1;
+  }
+
+  // a throwing watch callback reaches the writer instead of terminating, after the write is done
+  bb->set<int>("guarded", 1);
+  bb->watch("guarded", [](const std::string&) -> void { throw std::runtime_error("watcher failed"); });
+  try {
+    bb->remove("guarded");
+    std::cerr << "watch callback exception was swallowed\n";
+    return 1;
+  } catch (const std::runtime_error&) {
+  }
+  if (bb->contains("guarded")) {
+    std::cerr << "remove() did not complete before notifying\n";
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,163 @@
+#include "definition.hpp"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+using msm::blackboard;
+using msm::callback_state;
+using msm::machine_definition;
+using msm::msm_state;
+using msm::state_registry;
+
+namespace {
+const auto text = std::string{R"(# counts to a limit, then reports
+outcomes done failed
+
+state start add:1   next=check
+state check below   yes=more no=report
+state more  add:10  next=check    # loops back
+state report emit   ok=done
+state orphan emit   ok=done       # unreachable, pruned
+timeout 5000 failed check
+)"};
+
+auto make_registry(int limit) -> state_registry {
+  auto registry = state_registry{};
+  registry.add("add", [](std::string_view argument) -> msm_state::ptr {
+    auto amount = std::stoi(std::string{argument});
+    return std::make_shared<callback_state>(
+        [amount](blackboard::ptr bb) -> std::string {
+          bb->set<int>("count", bb->get<int>("count").value_or(0) + amount);
+          return "next";
+        },
+        std::unordered_set<std::string>{"next"});
+  });
+  registry.add_callback(
+      "below", [limit](blackboard::ptr bb) -> std::string { return *bb->get<int>("count") < limit ? "yes" : "no"; },
+      {"yes", "no", "failed"});
+  registry.add_callback(
+      "emit", [](blackboard::ptr bb) -> std::string { return "ok"; }, {"ok"});
+  return registry;
+}
+
+auto run(msm::msm_engine& engine) -> int {
+  auto bb = std::make_shared<blackboard>();
+  if (engine.execute(bb) != "done") return -1;
+  return bb->get<int>("count").value_or(0);
+}
+
+template <typename F>
+auto throws(F&& body) -> bool {
+  try {
+    body();
+  } catch (const std::runtime_error&) {
+    return true;
+  }
+  return false;
+}
+}  // namespace
+
+auto main(int argc, char** argv) -> int {
+  auto registry = make_registry(25);
+  auto definition = machine_definition::parse(text);
+  auto built = definition.build(registry);
+  if (run(*built) != 31 || built->get_graph()->unreachable_states() != std::vector<std::string>{"orphan"}) {
+    std::cerr << "text definition built the wrong machine\n";
+    return 1;
+  }
+
+  // the binary form runs the same graph without validating, and leaves the pruned state out
+  auto binary = definition.compile(registry);
+  auto loaded = machine_definition::load(binary, registry);
+  if (run(*loaded) != 31 || loaded->get_graph()->fingerprint() != built->get_graph()->fingerprint() ||
+      loaded->get_states().count("orphan") != 0 || loaded->get_initial_state() != "start") {
+    std::cerr << "binary definition loaded the wrong machine\n";
+    return 1;
+  }
+  auto check = loaded->get_graph()->find_state("check");
+  if (loaded->get_graph()->state_timeout(check).budget != std::chrono::milliseconds(5000)) {
+    std::cerr << "state timeout was not kept\n";
+    return 1;
+  }
+
+  // the cache is written on first use, used while the text is unchanged, and rebuilt when it changes
+  auto directory = std::filesystem::temp_directory_path();
+  auto path = (directory / "msm_definition_test1.txt").string();
+  auto cache_path = (directory / "msm_definition_test1.bin").string();
+  std::filesystem::remove(cache_path);
+  std::ofstream{path} << text;
+  if (run(*machine_definition::load_cached(path, cache_path, registry)) != 31 ||
+      !std::filesystem::exists(cache_path) || run(*machine_definition::load_file(cache_path, registry)) != 31 ||
+      run(*machine_definition::load_cached(path, cache_path, registry)) != 31) {
+    std::cerr << "cached definition loaded the wrong machine\n";
+    return 1;
+  }
+  // a cache whose counts run past its end is rebuilt, not allocated from
+  auto damaged = std::vector<std::byte>{};
+  {
+    auto cache = std::ifstream{cache_path, std::ios::binary};
+    damaged.resize(16);  // magic, version and source hash of the valid cache
+    cache.read(reinterpret_cast<char*>(damaged.data()), 16);
+  }
+  auto writer = msm::snapshot_builder{damaged};
+  writer.put(std::uint32_t{1});           // final outcomes
+  writer.put_string("done");
+  writer.put(std::int64_t{0});            // run budget
+  writer.put_string("");                  // run timeout outcome
+  writer.put(std::uint32_t{0xffffffff});  // states
+  std::ofstream{cache_path, std::ios::binary}.write(reinterpret_cast<const char*>(damaged.data()),
+                                                    static_cast<std::streamsize>(damaged.size()));
+  if (!throws([&] { machine_definition::load(damaged, registry); }) ||
+      run(*machine_definition::load_cached(path, cache_path, registry)) != 31 ||
+      run(*machine_definition::load_file(cache_path, registry)) != 31) {
+    std::cerr << "damaged cache was not rebuilt\n";
+    return 1;
+  }
+
+  std::ofstream{path} << text << "state extra emit ok=done\ninitial report\n";
+  if (run(*machine_definition::load_cached(path, cache_path, registry)) != 0 ||
+      machine_definition::load_file(cache_path, registry)->get_initial_state() != "report") {
+    std::cerr << "stale cache was used\n";
+    return 1;
+  }
+
+  // malformed text, unknown types, damaged files and registries that changed are refused
+  auto changed = make_registry(25);
+  changed.add_callback(
+      "emit", [](blackboard::ptr) -> std::string { return "ok"; }, {"ok", "late"});
+  auto truncated = std::vector<std::byte>{binary.begin(), binary.end() - 3};
+  if (!throws([] { machine_definition::parse("outcomes done\nstate a\n"); }) ||
+      !throws([] { machine_definition::parse("outcomes done\nstate a t x\n"); }) ||
+      !throws([&] { machine_definition::parse("outcomes done\nstate a missing\n").build(registry); }) ||
+      !throws([&] { machine_definition::load(truncated, registry); }) ||
+      !throws([&] { machine_definition::load(binary, changed); })) {
+    std::cerr << "invalid definition was accepted\n";
+    return 1;
+  }
+
+  // a registry state that is an engine is flattened into the graph, which has no binary form: load_cached() still
+  // returns the machine, it just cannot cache it
+  auto nesting = make_registry(25);
+  nesting.add("sub", [](std::string_view) -> msm_state::ptr {
+    auto inner = std::make_shared<msm::msm_engine>(std::unordered_set<std::string>{"ok"});
+    inner->add_state("bump", std::make_shared<callback_state>(
+                                 [](blackboard::ptr bb) -> std::string {
+                                   bb->set<int>("count", 7);
+                                   return "ok";
+                                 },
+                                 std::unordered_set<std::string>{"ok"}));
+    inner->validate();
+    return inner;
+  });
+  std::filesystem::remove(cache_path);
+  std::ofstream{path} << "outcomes done\nstate inner sub ok=done\n";
+  if (run(*machine_definition::load_cached(path, cache_path, nesting)) != 7 ||
+      run(*machine_definition::load_cached(path, cache_path, nesting)) != 7 || std::filesystem::exists(cache_path)) {
+    std::cerr << "nested engine definition was not loaded uncached\n";
+    return 1;
+  }
+
+  std::filesystem::remove(path);
+  std::filesystem::remove(cache_path);
+  return 0;
+}
@@ -0,0 +1,44 @@
+#include "engine.hpp"
+#include <iostream>
+
+using msm::blackboard;
+using msm::callback_state;
+using msm::msm_engine;
+
+auto main(int argc, char** argv) -> int {
+  auto engine = msm_engine{{"done", "failed"}};
+
+  auto counter = std::make_shared<callback_state>(
+      [](blackboard::ptr bb) -> std::string {
+        auto& count = bb->operator[]<int>("count");
+        return ++count < 3 ? "again" : "next";
+      },
+      std::unordered_set<std::string>{"again", "next"});
+  auto finish = std::make_shared<callback_state>([](blackboard::ptr) -> std::string { return "ok"; },
+                                                 std::unordered_set<std::string>{"ok", "error"});
+
+  engine.add_state("count", counter, {{"again", "count"}, {"next", "finish"}});
+  engine.add_state("finish", finish, {{"ok", "done"}, {"error", "failed"}});
+
+  auto transitions = 0;
+  engine.add_transition_callback([&transitions](blackboard::ptr, const std::string&, const std::string&,
+                                                 const std::string&, const std::vector<std::string>&) -> void {
+    ++transitions;
+  });
+
+  auto bb = std::make_shared<blackboard>();
+  auto outcome = engine.execute(bb);
+
+  if (outcome != "done" || bb->get<int>("count") != 3 || transitions != 3) {
+    std::cerr << "unexpected result: " << outcome << " after " << transitions << " transitions\n";
+    return 1;
+  }
+
+  auto graph = engine.get_graph();
+  if (!graph || graph->state_count() != 2 || graph->state_name(graph->initial_state()) != "count") {
+    std::cerr << "unexpected compiled graph\n";
+    return 1;
+  }
+
+  return 0;
+}
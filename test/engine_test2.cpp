@@ -0,0 +1,106 @@
+#include "engine.hpp"
+#include <atomic>
+#include <iostream>
+#include <thread>
+
+using msm::blackboard;
+using msm::callback_state;
+using msm::msm_engine;
+
+namespace {
+auto make_engine() -> std::shared_ptr<msm_engine> {
+  auto never = [](blackboard::ptr) -> std::string { return "stop"; };
+  auto engine = std::make_shared<msm_engine>(std::unordered_set<std::string>{"stopped"});
+  engine->add_state("ping", std::make_shared<callback_state>(never, std::unordered_set<std::string>{"go", "stop"}),
+                    {{"go", "pong"}, {"stop", "stopped"}});
+  engine->add_state("pong", std::make_shared<callback_state>(never, std::unordered_set<std::string>{"go", "stop"}),
+                    {{"go", "ping"}, {"stop", "stopped"}});
+  return engine;
+}
+}  // namespace
+
+auto main(int argc, char** argv) -> int {
+  // four producers post concurrently while this thread consumes
+  constexpr auto producers = 4;
+  constexpr auto per_producer = 20000;
+
+  auto engine = make_engine();
+  auto transitions = 0;
+  engine->add_transition_callback([&transitions](blackboard::ptr, const std::string&, const std::string&,
+                                                 const std::string&, const std::vector<std::string>&) -> void {
+    ++transitions;
+  });
+  engine->start_events(std::make_shared<blackboard>(), 256);
+
+  auto go = engine->event_id("go");
+  auto threads = std::vector<std::thread>{};
+  for (auto p = 0; p < producers; ++p) {
+    threads.emplace_back([&engine, go]() -> void {
+      for (auto i = 0; i < per_producer; ++i) {
+        while (!engine->post(go)) std::this_thread::yield();
+      }
+    });
+  }
+
+  auto consumed = std::size_t{0};
+  while (consumed < producers * per_producer) consumed += engine->process_events();
+  for (auto& thread : threads) thread.join();
+
+  auto stats = engine->get_event_stats();
+  if (transitions != producers * per_producer || stats.posted != consumed || stats.dispatched != consumed ||
+      engine->get_current_state() != "ping") {
+    std::cerr << "unexpected event dispatch: " << transitions << " transitions, " << stats.dispatched
+              << " dispatched, state " << engine->get_current_state() << '\n';
+    return 1;
+  }
+
+  // a terminal outcome ends the machine and later events are ignored
+  auto outcome = std::string{};
+  engine->add_end_callback([&outcome](blackboard::ptr, const std::string& result, const std::vector<std::string>&)
+                               -> void { outcome = result; });
+  engine->post("stop");
+  engine->post("go");
+  engine->process_events();
+  stats = engine->get_event_stats();
+  if (outcome != "stopped" || !engine->get_current_state().empty() || stats.ignored != 1) {
+    std::cerr << "terminal event was not handled, outcome " << outcome << '\n';
+    return 1;
+  }
+
+  // a full queue refuses events instead of blocking the producer
+  auto bounded = make_engine();
+  bounded->start_events(std::make_shared<blackboard>(), 4);
+  auto accepted = 0;
+  for (auto i = 0; i < 10; ++i) accepted += bounded->post("go") ? 1 : 0;
+  if (accepted != 4 || bounded->get_event_stats().dropped != 6 || bounded->process_events() != 4) {
+    std::cerr << "bounded queue accepted " << accepted << " events\n";
+    return 1;
+  }
+
+  // restarting while a producer posts keeps the queue the producer holds, and drops what was queued for the old run
+  auto restarted = make_engine();
+  restarted->start_events(std::make_shared<blackboard>(), 64);
+  auto posting = std::atomic<bool>{true};
+  auto producer = std::thread([&restarted, &posting, go = restarted->event_id("go")]() -> void {
+    while (posting.load()) restarted->post(go);
+  });
+  for (auto i = 0; i < 200; ++i) {
+    restarted->start_events(std::make_shared<blackboard>(), 64);
+    restarted->process_events();
+  }
+  posting.store(false);
+  producer.join();
+  restarted->start_events(std::make_shared<blackboard>(), 16);
+  if (restarted->process_events() != 0 || restarted->get_event_stats().posted != 0) {
+    std::cerr << "restart kept events of the previous run\n";
+    return 1;
+  }
+  try {
+    restarted->start_events(std::make_shared<blackboard>(), 1024);
+    std::cerr << "event queue grew under its producers\n";
+    return 1;
+  } catch (const std::logic_error&) {
+  }
+
+  return 0;
+}
@@ -0,0 +1,84 @@
+#include "engine.hpp"
+#include <iostream>
+
+using msm::blackboard;
+using msm::callback_state;
+using msm::msm_engine;
+
+namespace {
+auto log_callbacks(msm_engine& engine, const std::string& name, std::vector<std::string>& log) -> void {
+  engine.add_start_callback([&log, name](blackboard::ptr, const std::string& initial, const std::vector<std::string>&)
+                                -> void { log.push_back(name + " start " + initial); });
+  engine.add_transition_callback([&log, name](blackboard::ptr, const std::string& from, const std::string& to,
+                                              const std::string& outcome, const std::vector<std::string>&) -> void {
+    log.push_back(name + " " + from + " -> " + to + " on " + outcome);
+  });
+  engine.add_end_callback([&log, name](blackboard::ptr, const std::string& outcome, const std::vector<std::string>&)
+                              -> void { log.push_back(name + " end " + outcome); });
+}
+
+auto returning(const std::string& outcome) -> msm::msm_state::ptr {
+  return std::make_shared<callback_state>([outcome](blackboard::ptr) -> std::string { return outcome; },
+                                          std::unordered_set<std::string>{outcome});
+}
+}  // namespace
+
+auto main(int argc, char** argv) -> int {
+  // outer { middle { inner { a -> b } -> tail } }, flattened into one graph
+  auto log = std::vector<std::string>{};
+  auto path = std::string{};
+  auto inner = std::make_shared<msm_engine>(std::unordered_set<std::string>{"done"});
+  auto middle = std::make_shared<msm_engine>(std::unordered_set<std::string>{"finished"});
+  auto outer = std::make_shared<msm_engine>(std::unordered_set<std::string>{"exit"});
+
+  inner->add_state("a", returning("next"), {{"next", "b"}});
+  inner->add_state("b",
+                   std::make_shared<callback_state>(
+                       [&](blackboard::ptr) -> std::string {
+                         path = outer->get_current_state();
+                         return "done";
+                       },
+                       std::unordered_set<std::string>{"done"}));
+  middle->add_state("inner", inner, {{"done", "tail"}});
+  middle->add_state("tail", returning("finished"));
+  outer->add_state("middle", middle, {{"finished", "exit"}});
+  log_callbacks(*inner, "inner", log);
+  log_callbacks(*middle, "middle", log);
+  log_callbacks(*outer, "outer", log);
+
+  if (outer->execute(std::make_shared<blackboard>()) != "exit" || path != "middle/inner/b") {
+    std::cerr << "nested run failed, current state was '" << path << "'\n";
+    return 1;
+  }
+
+  auto expected = std::vector<std::string>{"outer start middle",
+                                           "middle start inner",
+                                           "inner start a",
+                                           "inner a -> b on next",
+                                           "inner end done",
+                                           "middle inner -> tail on done",
+                                           "middle end finished",
+                                           "outer end exit"};
+  if (log != expected) {
+    std::cerr << "unexpected callbacks:\n";
+    for (const auto& entry : log) std::cerr << "  " << entry << '\n';
+    return 1;
+  }
+
+  auto graph = outer->get_graph();
+  if (graph->state_count() != 3 || graph->scope_count() != 3 || graph->state_name(0) != "middle/inner/a") {
+    std::cerr << "nested engines were not flattened\n";
+    return 1;
+  }
+
+  // changing a nested engine recompiles the engines around it on their next run
+  inner->set_initial_state("b");
+  log.clear();
+  if (outer->execute(std::make_shared<blackboard>()) != "exit" || outer->get_graph() == graph ||
+      outer->get_graph()->state_name(0) != "middle/inner/b") {
+    std::cerr << "nested change was not picked up\n";
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,83 @@
+#include "engine.hpp"
+#include <cstdlib>
+#include <iostream>
+
+using msm::blackboard;
+using msm::callback_state;
+using msm::inplace_function;
+using msm::msm_engine;
+
+namespace {
+std::atomic<std::size_t> allocations{0};
+}  // namespace
+
+// counts every heap allocation of the process. The array forms are replaced along with the scalar ones, and all of
+// them are kept out of line so GCC never pairs an inlined malloc() or free() with a new or delete expression.
+[[gnu::noinline]] auto operator new(std::size_t size) -> void* {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (auto* memory = std::malloc(size ? size : 1)) return memory;
+  throw std::bad_alloc{};
+}
+[[gnu::noinline]] auto operator new[](std::size_t size) -> void* { return ::operator new(size); }
+[[gnu::noinline]] auto operator delete(void* memory) noexcept -> void { std::free(memory); }
+[[gnu::noinline]] auto operator delete(void* memory, std::size_t) noexcept -> void { ::operator delete(memory); }
+[[gnu::noinline]] auto operator delete[](void* memory) noexcept -> void { ::operator delete(memory); }
+[[gnu::noinline]] auto operator delete[](void* memory, std::size_t) noexcept -> void { ::operator delete(memory); }
+
+auto main(int argc, char** argv) -> int {
+  // inplace_function copies and moves its callable in place
+  auto calls = 0;
+  auto increment = inplace_function<int(int)>{[&calls](int by) -> int { return calls += by; }};
+  auto copied = increment;
+  auto moved = std::move(increment);
+  if (copied(1) != 1 || moved(2) != 3 || increment) {
+    std::cerr << "inplace_function copy/move failed\n";
+    return 1;
+  }
+
+  auto engine = msm_engine{{"done"}};
+  engine.add_state("count",
+                   std::make_shared<callback_state>(
+                       [](blackboard::ptr bb) -> std::string {
+                         return ++bb->operator[]<int>("count") % 100 != 0 ? "again" : "next";
+                       },
+                       std::unordered_set<std::string>{"again", "next"}),
+                   {{"again", "count"}, {"next", "finish"}});
+  engine.add_state("finish",
+                   std::make_shared<callback_state>([](blackboard::ptr) -> std::string { return "ok"; },
+                                                    std::unordered_set<std::string>{"ok"}),
+                   {{"ok", "done"}});
+
+  // the payload is bound by capture: a counter and the outcome id to count
+  struct tally {
+    std::size_t* counter;
+    msm::compiled_graph::id_t outcome;
+  };
+  auto again = std::size_t{0};
+  auto ends = std::size_t{0};
+  engine.validate();
+  engine.add_transition_hook([payload = tally{&again, engine.event_id("again")}](
+                                 const blackboard::ptr&, const msm_engine::hook_event& event) -> void {
+    if (event.outcome_id == payload.outcome && event.from == "count") ++*payload.counter;
+  });
+  engine.add_end_hook([&ends](const blackboard::ptr&, const msm_engine::hook_event& event) -> void {
+    if (event.outcome == "done") ++ends;
+  });
+
+  auto bb = std::make_shared<blackboard>();
+  engine.execute(bb);  // creates the blackboard entry
+
+  // a warmed-up run allocates nothing: states, transitions and hooks included
+  bb->set<int>("count", 0);
+  auto before = allocations.load();
+  auto outcome = engine.execute(bb);
+  auto allocated = allocations.load() - before;
+
+  if (outcome != "done" || again != 2 * 99 || ends != 2 || allocated != 0) {
+    std::cerr << "unexpected run: " << again << " transitions on again, " << ends << " ends, " << allocated
+              << " allocations\n";
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,76 @@
+#include "engine.hpp"
+#include <iostream>
+
+using msm::blackboard;
+using msm::callback_state;
+using msm::compiled_graph;
+using msm::msm_engine;
+
+namespace {
+auto returning(std::unordered_set<std::string> outcomes) -> msm::msm_state::ptr {
+  auto first = *outcomes.begin();
+  return std::make_shared<callback_state>([first](blackboard::ptr) -> std::string { return first; }, outcomes);
+}
+}  // namespace
+
+auto main(int argc, char** argv) -> int {
+  // start -> {left, right}, left -> ok, right -> loop <-> spin (a trap), dead is never entered
+  auto engine = msm_engine{{"ok", "failed"}};
+  engine.add_state("dead", returning({"go"}), {{"go", "start"}});
+  engine.add_state("start", returning({"a", "b"}), {{"a", "left"}, {"b", "right"}});
+  engine.add_state("left", returning({"ok"}));
+  engine.add_state("right", returning({"x", "failed"}), {{"x", "loop"}});
+  engine.add_state("loop", returning({"y"}), {{"y", "spin"}});
+  engine.add_state("spin", returning({"y"}), {{"y", "loop"}});
+  engine.set_initial_state("start");
+  engine.validate();
+
+  auto graph = engine.get_graph();
+  auto ok = graph->find_outcome("ok");
+  auto failed = graph->find_outcome("failed");
+  auto id = [&graph](const std::string& name) { return graph->find_state(name); };
+
+  if (graph->state_count() != 5 || graph->unreachable_states() != std::vector<std::string>{"dead"}) {
+    std::cerr << "unreachable state was not pruned\n";
+    return 1;
+  }
+  // breadth-first: start, its two successors, then what follows them
+  if (id("start") != 0 || id("left") + id("right") != 3 || id("loop") != 3 || id("spin") != 4) {
+    std::cerr << "states are not in breadth-first order\n";
+    return 1;
+  }
+  if (!graph->can_reach(id("start"), ok) || !graph->can_reach(id("start"), failed) ||
+      graph->can_reach(id("left"), failed) || !graph->can_reach(id("right"), failed) ||
+      graph->can_reach(id("loop"), ok) || graph->trap_states() != std::vector<compiled_graph::id_t>{3, 4}) {
+    std::cerr << "unexpected reachable outcomes\n";
+    return 1;
+  }
+
+  try {
+    engine.validate(true);
+    std::cerr << "strict validation accepted a trap\n";
+    return 1;
+  } catch (const std::runtime_error&) {
+  }
+
+  // a long chain with a dead state hanging off every link validates in linear time
+  constexpr auto length = 100000;
+  auto chain = msm_engine{{"done"}};
+  auto next = returning({"next"});
+  for (auto i = 0; i < length; ++i) {
+    auto target = i + 1 < length ? "s" + std::to_string(i + 1) : std::string{"done"};
+    chain.add_state("s" + std::to_string(i), next, {{"next", target}});
+    chain.add_state("d" + std::to_string(i), next, {{"next", "s" + std::to_string(i)}});
+  }
+  chain.set_initial_state("s0");
+  chain.validate(true);
+  auto long_graph = chain.get_graph();
+  if (long_graph->state_count() != length || long_graph->unreachable_states().size() != length ||
+      long_graph->state_name(length - 1) != "s" + std::to_string(length - 1) ||
+      !long_graph->can_reach(0, long_graph->find_outcome("done"))) {
+    std::cerr << "long chain was not compiled as expected\n";
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,57 @@
+#include "engine.hpp"
+#include <iostream>
+
+using msm::blackboard;
+using msm::callback_state;
+using msm::msm_state;
+using msm::parallel_state;
+
+namespace {
+auto make_branch(const std::string& key, const std::string& outcome) -> msm_state::ptr {
+  return std::make_shared<callback_state>(
+      [key, outcome](blackboard::ptr bb) -> std::string {
+        bb->set<int>(key, 1);
+        return outcome;
+      },
+      std::unordered_set<std::string>{"ok", "failed"});
+}
+}  // namespace
+
+auto main(int argc, char** argv) -> int {
+  auto pool = std::make_shared<msm::thread_pool_executor>(2);
+
+  // inner parallel states run on pool threads and wait on branches submitted to the same small pool
+  auto outer_branches = std::unordered_set<msm_state::ptr>{};
+  auto outer_map = std::unordered_map<std::string, std::unordered_map<msm_state::ptr, std::string>>{{"all_ok", {}}};
+  for (auto i = 0; i < 4; ++i) {
+    auto inner_branches = std::unordered_set<msm_state::ptr>{};
+    auto inner_map = std::unordered_map<std::string, std::unordered_map<msm_state::ptr, std::string>>{{"ok", {}}};
+    for (auto j = 0; j < 4; ++j) {
+      auto branch = make_branch("branch_" + std::to_string(i) + "_" + std::to_string(j), "ok");
+      inner_branches.insert(branch);
+      inner_map["ok"][branch] = "ok";
+    }
+    auto inner = std::make_shared<parallel_state>(inner_branches, "failed", inner_map, pool);
+    outer_branches.insert(inner);
+    outer_map["all_ok"][inner] = "ok";
+  }
+  auto outer = parallel_state{outer_branches, "failed", outer_map, pool};
+
+  auto bb = std::make_shared<blackboard>();
+  auto outcome = outer(bb);
+  if (outcome != "all_ok" || bb->size() != 16) {
+    std::cerr << "unexpected outcome " << outcome << " with " << bb->size() << " branches run\n";
+    return 1;
+  }
+
+  // a failing branch leaves the composite outcome unsatisfied
+  auto good = make_branch("good", "ok");
+  auto bad = make_branch("bad", "failed");
+  auto mixed = parallel_state{{good, bad}, "failed", {{"all_ok", {{good, "ok"}, {bad, "ok"}}}}};
+  if (mixed(bb) != "failed") {
+    std::cerr << "mixed branches should fall back to the default outcome\n";
+    return 1;
+  }
+
+  return 0;
+}
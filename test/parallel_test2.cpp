@@ -0,0 +1,76 @@
+#include "engine.hpp"
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+using msm::blackboard;
+using msm::callback_state;
+using msm::join_policy;
+using msm::msm_state;
+using msm::parallel_state;
+
+namespace {
+// Runs until cancelled (or for a long time), then reports whether it was cancelled
+class slow_state : public msm_state {
+ public:
+  std::atomic<bool> started{false};
+  std::atomic<bool> finished{false};
+
+  slow_state() : msm_state{{"done", "cancelled"}} {}
+
+  auto execute(blackboard::ptr bb) -> std::string override {
+    started.store(true);
+    for (auto i = 0; i < 2000 && !is_cancelled(); ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    finished.store(true);
+    return is_cancelled() ? "cancelled" : "done";
+  }
+
+  auto to_string() const -> std::string override { return "Slow State"; }
+};
+
+auto elapsed_since(std::chrono::steady_clock::time_point start) -> std::chrono::milliseconds {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+}
+}  // namespace
+
+auto main(int argc, char** argv) -> int {
+  auto pool = std::make_shared<msm::thread_pool_executor>(2);
+  auto fast = std::make_shared<callback_state>([](blackboard::ptr) -> std::string { return "ok"; },
+                                               std::unordered_set<std::string>{"ok", "failed"});
+
+  for (auto mode : {join_policy::first_decisive, join_policy::first_completed}) {
+    auto slow = std::make_shared<slow_state>();
+    auto race = parallel_state{{fast, slow}, "lost", {{"fast_won", {{fast, "ok"}}}, {"slow_won", {{slow, "done"}}}}, pool};
+    race.set_join_policy(mode);
+
+    auto start = std::chrono::steady_clock::now();
+    auto outcome = race(std::make_shared<blackboard>());
+    if (outcome != "fast_won" || elapsed_since(start) > std::chrono::milliseconds(1000)) {
+      std::cerr << "early exit failed: " << outcome << " after " << elapsed_since(start).count() << "ms\n";
+      return 1;
+    }
+
+    // the losing branch is cancelled through msm_state::cancel(), or skipped if it had not started yet
+    for (auto i = 0; i < 1000 && slow->started.load() && !slow->finished.load(); ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (slow->started.load() && !(slow->finished.load() && slow->is_cancelled())) {
+      std::cerr << "slow branch was not cancelled\n";
+      return 1;
+    }
+  }
+
+  // first_decisive returns the default outcome as soon as no outcome can be met anymore
+  auto slow = std::make_shared<slow_state>();
+  auto doomed = parallel_state{{fast, slow}, "lost", {{"both", {{fast, "failed"}, {slow, "done"}}}}, pool};
+  doomed.set_join_policy(join_policy::first_decisive);
+  auto start = std::chrono::steady_clock::now();
+  if (doomed(std::make_shared<blackboard>()) != "lost" || elapsed_since(start) > std::chrono::milliseconds(1000)) {
+    std::cerr << "impossible outcomes should short-circuit\n";
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,51 @@
+#include "engine.hpp"
+#include <iostream>
+
+using msm::blackboard;
+using msm::callback_state;
+using msm::join_policy;
+using msm::msm_state;
+using msm::parallel_state;
+
+auto main(int argc, char** argv) -> int {
+  // 40 branches with two outcomes each need more than one word of result bits
+  constexpr auto count = 40;
+  constexpr auto failing = 7;
+  auto branches = std::vector<msm_state::ptr>{};
+  for (auto i = 0; i < count; ++i) {
+    branches.push_back(std::make_shared<callback_state>(
+        [i](blackboard::ptr) -> std::string { return i == failing ? "fail" : "ok"; },
+        std::unordered_set<std::string>{"ok", "fail"}));
+  }
+
+  // all_ok, and for every branch only_<i>: that branch failed and every other one succeeded
+  auto outcome_map = std::unordered_map<std::string, std::unordered_map<msm_state::ptr, std::string>>{};
+  for (auto i = 0; i < count; ++i) {
+    outcome_map["all_ok"][branches[i]] = "ok";
+    for (auto j = 0; j < count; ++j) outcome_map["only_" + std::to_string(j)][branches[i]] = i == j ? "fail" : "ok";
+  }
+
+  auto pool = std::make_shared<msm::thread_pool_executor>(4);
+  auto fan_out = parallel_state{{branches.begin(), branches.end()}, "mixed", outcome_map, pool};
+  for (auto mode : {join_policy::wait_all, join_policy::first_decisive}) {
+    fan_out.set_join_policy(mode);
+    auto outcome = fan_out(std::make_shared<blackboard>());
+    if (outcome != "only_" + std::to_string(failing)) {
+      std::cerr << "unexpected outcome: " << outcome << '\n';
+      return 1;
+    }
+  }
+
+  // a branch returning an outcome it did not declare is an error, as in msm_state::operator()
+  auto rogue = std::make_shared<callback_state>([](blackboard::ptr) -> std::string { return "surprise"; },
+                                                std::unordered_set<std::string>{"ok"});
+  auto checked = parallel_state{{rogue}, "failed", {{"done", {{rogue, "ok"}}}}, pool};
+  try {
+    checked(std::make_shared<blackboard>());
+    std::cerr << "undeclared branch outcome was accepted\n";
+    return 1;
+  } catch (const std::logic_error&) {
+  }
+
+  return 0;
+}
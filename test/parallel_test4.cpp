@@ -0,0 +1,138 @@
+#include "engine.hpp"
+#include <iostream>
+#include <thread>
+
+using msm::blackboard;
+using msm::join_policy;
+using msm::msm_state;
+using msm::parallel_state;
+
+namespace {
+// Spins until cancelled (or gives up after two seconds), remembering whether two runs ever overlapped
+class spinning_state final : public msm_state {
+ public:
+  std::atomic<int> inside{0};
+  std::atomic<bool> overlapped{false};
+  std::atomic<bool> gave_up{false};
+  std::atomic<bool> on_caller{false};
+  std::thread::id caller;
+
+  spinning_state() : msm_state{{"done"}} {}
+
+  auto execute(blackboard::ptr) -> std::string override {
+    if (this->inside.fetch_add(1) != 0) this->overlapped = true;
+    if (std::this_thread::get_id() == this->caller) this->on_caller = true;
+    auto start = std::chrono::steady_clock::now();
+    while (!this->is_cancelled()) {
+      if (std::chrono::steady_clock::now() - start > std::chrono::seconds(2)) {
+        this->gave_up = true;
+        break;
+      }
+      std::this_thread::yield();
+    }
+    this->inside.fetch_sub(1);
+    return "done";
+  }
+
+  auto to_string() const -> std::string override { return "Spinning State"; }
+};
+
+// Sleeps a little, then finishes
+class quick_state final : public msm_state {
+ public:
+  std::atomic<bool> on_caller{false};
+  std::thread::id caller;
+
+  quick_state() : msm_state{{"done"}} {}
+
+  auto execute(blackboard::ptr) -> std::string override {
+    if (std::this_thread::get_id() == this->caller) this->on_caller = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    return "done";
+  }
+
+  auto to_string() const -> std::string override { return "Quick State"; }
+};
+
+// Cancelled after its execution has begun but before the join exists, as by an engine cancel() racing the start
+class early_cancelled_state final : public parallel_state {
+ public:
+  using parallel_state::parallel_state;
+
+  auto execute(blackboard::ptr bb) -> std::string override {
+    this->cancel();
+    return parallel_state::execute(std::move(bb));
+  }
+};
+}  // namespace
+
+auto main(int argc, char** argv) -> int {
+  // two workers for three branches: the third one waits in the queue while the caller joins
+  auto pool = std::make_shared<msm::thread_pool_executor>(2);
+  auto spinner = std::make_shared<spinning_state>();
+  auto quick = std::make_shared<quick_state>();
+  auto other = std::make_shared<quick_state>();
+  spinner->caller = quick->caller = other->caller = std::this_thread::get_id();
+
+  auto race = parallel_state{{spinner, quick, other}, "none", {{"quick", {{quick, "done"}}}}, pool};
+  race.set_join_policy(join_policy::first_completed);
+
+  for (auto run = 0; run < 5; ++run) {
+    auto start = std::chrono::steady_clock::now();
+    auto outcome = race.execute(std::make_shared<blackboard>());
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    if (elapsed > std::chrono::seconds(1)) {
+      std::cerr << "first_completed waited for the slow branch\n";
+      return 1;
+    }
+    if (outcome != "quick" && outcome != "none") {
+      std::cerr << "unexpected outcome: " << outcome << '\n';
+      return 1;
+    }
+  }
+
+  // the next execute() waits for the branches the previous one abandoned
+  race.execute(std::make_shared<blackboard>());
+  while (spinner->inside.load() != 0) std::this_thread::yield();
+
+  if (spinner->on_caller || quick->on_caller || other->on_caller) {
+    std::cerr << "an early-exit join ran one of its branches on the calling thread\n";
+    return 1;
+  }
+  if (spinner->gave_up) {
+    std::cerr << "an abandoned branch was not cancelled\n";
+    return 1;
+  }
+  if (spinner->overlapped) {
+    std::cerr << "a branch state ran for two executions at once\n";
+    return 1;
+  }
+
+  // cancelling the execution reaches its running branches and ends the join
+  auto held = std::make_shared<spinning_state>();
+  auto waiting = parallel_state{{held}, "cancelled", {{"finished", {{held, "done"}}}}, pool};
+  waiting.set_join_policy(join_policy::first_decisive);
+  auto canceller = std::thread([&waiting, &held]() -> void {
+    while (held->inside.load() == 0) std::this_thread::yield();
+    waiting.cancel();
+  });
+  auto cancelled = waiting.execute(std::make_shared<blackboard>());
+  canceller.join();
+  while (held->inside.load() != 0) std::this_thread::yield();
+  if (cancelled != "cancelled" || held->gave_up) {
+    std::cerr << "cancelling a parallel state did not reach its branch\n";
+    return 1;
+  }
+
+  // a cancel() before the join is published is not lost, and shows in is_cancelled()
+  auto early = std::make_shared<spinning_state>();
+  auto racing = early_cancelled_state{{early}, "cancelled", {{"finished", {{early, "done"}}}}, pool};
+  auto early_outcome = racing.invoke(std::make_shared<blackboard>());
+  while (early->inside.load() != 0) std::this_thread::yield();
+  if (early_outcome != "cancelled" || early->gave_up || !racing.is_cancelled()) {
+    std::cerr << "a cancel() before the branches started was lost\n";
+    return 1;
+  }
+
+  return 0;
+}
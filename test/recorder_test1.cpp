@@ -0,0 +1,113 @@
+#include "recorder.hpp"
+#include <filesystem>
+#include <iostream>
+#include <random>
+
+using msm::blackboard;
+using msm::callback_state;
+using msm::msm_engine;
+using msm::recorder;
+using msm::replayer;
+
+namespace {
+using state_fn = std::function<std::string(blackboard::ptr)>;
+
+// the values a run leaves behind, independent of key order
+auto describe(const blackboard& bb) -> std::string {
+  auto text = std::string{};
+  for (const auto* key : {"run", "draws", "last"}) text += std::to_string(bb.get<int>(key).value_or(-1)) + " ";
+  return text + bb.get<std::string>("kept").value_or("-");
+}
+
+// draw -> draw (again) | keep -> done, with transitions logged
+auto build(state_fn draw, state_fn keep, std::vector<std::string>& log) -> std::shared_ptr<msm_engine> {
+  auto engine = std::make_shared<msm_engine>(std::unordered_set<std::string>{"done"});
+  engine->add_state("draw", std::make_shared<callback_state>(draw, std::unordered_set<std::string>{"again", "stop"}),
+                    {{"again", "draw"}, {"stop", "keep"}});
+  engine->add_state("keep", std::make_shared<callback_state>(keep, std::unordered_set<std::string>{"done"}));
+  engine->add_transition_callback([&log](blackboard::ptr bb, const std::string& from, const std::string& to,
+                                         const std::string& outcome, const std::vector<std::string>&) -> void {
+    log.push_back(from + " -> " + to + " on " + outcome + " with " + describe(*bb));
+  });
+  return engine;
+}
+}  // namespace
+
+auto main(int argc, char** argv) -> int {
+  auto path = (std::filesystem::temp_directory_path() / "msm_recorder_test1.log").string();
+  auto random = std::mt19937{std::random_device{}()};
+  auto failing = false;
+
+  // the recorded states are nondeterministic; keep removes the last draw and fails on request
+  auto recorded_log = std::vector<std::string>{};
+  auto recorded_bb = std::vector<std::string>{};
+  auto engine = build(
+      [&random](blackboard::ptr bb) -> std::string {
+        auto value = static_cast<int>(random() % 100);
+        bb->set<int>("draws", bb->get<int>("draws").value_or(0) + 1);
+        bb->set<int>("last", value);
+        return value < 60 ? "again" : "stop";
+      },
+      [&failing](blackboard::ptr bb) -> std::string {
+        if (failing) throw std::runtime_error("keep failed");
+        bb->set<std::string>("kept", std::to_string(*bb->get<int>("last")));
+        bb->remove("last");
+        return "done";
+      },
+      recorded_log);
+
+  {
+    auto log = std::make_shared<recorder>(path, msm::recorder_options{64});  // small ring, so records wrap
+    engine->set_recorder(log);
+    for (auto run = 0; run < 3; ++run) {
+      auto bb = std::make_shared<blackboard>();
+      bb->set<int>("run", run);
+      engine->execute(bb);
+      recorded_bb.push_back(describe(*bb));
+    }
+    failing = true;
+    try {
+      engine->execute(std::make_shared<blackboard>());
+    } catch (const std::runtime_error&) {
+    }
+    engine->set_recorder(nullptr);
+  }
+
+  // the replaying engine has the same shape but states that must never run
+  auto never = [](blackboard::ptr) -> std::string { throw std::logic_error("state executed during replay"); };
+  auto replayed_log = std::vector<std::string>{};
+  auto replaying = build(never, never, replayed_log);
+  auto replay = replayer{path};
+  if (replay.run_count() != 4) {
+    std::cerr << "expected 4 recorded runs, found " << replay.run_count() << '\n';
+    return 1;
+  }
+  for (auto run = std::size_t{0}; run < 3; ++run) {
+    auto bb = std::make_shared<blackboard>();
+    auto outcome = replay.replay(*replaying, bb, run);
+    if (outcome != "done" || describe(*bb) != recorded_bb[run]) {
+      std::cerr << "run " << run << " replayed to " << describe(*bb) << " instead of " << recorded_bb[run] << '\n';
+      return 1;
+    }
+  }
+  // the failed run replays up to where it threw
+  if (replay.replay(*replaying, std::make_shared<blackboard>(), 3).has_value() || replayed_log != recorded_log) {
+    std::cerr << "replayed transitions differ from the recorded ones\n";
+    return 1;
+  }
+
+  // a machine with another shape is refused
+  auto other_log = std::vector<std::string>{};
+  auto other = build(never, never, other_log);
+  other->add_state("extra", std::make_shared<callback_state>(never, std::unordered_set<std::string>{"done"}));
+  other->set_initial_state("extra");
+  try {
+    replay.replay(*other, std::make_shared<blackboard>(), 0);
+    std::cerr << "replay on a different machine was accepted\n";
+    return 1;
+  } catch (const std::runtime_error&) {
+  }
+
+  std::filesystem::remove(path);
+  return 0;
+}
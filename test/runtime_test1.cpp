@@ -0,0 +1,109 @@
+#include "runtime.hpp"
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+using msm::blackboard;
+using msm::callback_state;
+using msm::msm_engine;
+using msm::sharded_runtime;
+using namespace std::chrono_literals;
+
+namespace {
+// count -> count (again) | done, flagging any run that overlaps another run of the same engine
+auto make_counter(std::atomic<int>& active, std::atomic<bool>& overlapped, std::chrono::milliseconds pause = 0ms)
+    -> std::shared_ptr<msm_engine> {
+  auto engine = std::make_shared<msm_engine>(std::unordered_set<std::string>{"done"});
+  engine->add_state("count",
+                    std::make_shared<callback_state>(
+                        [&active, &overlapped, pause](blackboard::ptr bb) -> std::string {
+                          if (active.fetch_add(1) != 0) overlapped.store(true);
+                          std::this_thread::sleep_for(pause);
+                          auto steps = bb->get<int>("steps").value_or(0) + 1;
+                          bb->set<int>("steps", steps);
+                          active.fetch_sub(1);
+                          return steps < 3 ? "again" : "stop";
+                        },
+                        std::unordered_set<std::string>{"again", "stop"}),
+                    {{"again", "count"}, {"stop", "done"}});
+  return engine;
+}
+}  // namespace
+
+auto main(int argc, char** argv) -> int {
+  constexpr auto engines = 16;
+  constexpr auto runs = 50;
+  auto active = std::vector<std::atomic<int>>(engines);
+  auto overlapped = std::atomic<bool>{false};
+  auto completed = std::atomic<int>{0};
+
+  {
+    auto runtime = sharded_runtime{4, false, 4};
+    auto machines = std::vector<std::shared_ptr<msm_engine>>{};
+    for (auto i = 0; i < engines; ++i) machines.push_back(make_counter(active[i], overlapped));
+
+    // every other run reports through a callback, the rest through a future
+    auto futures = std::vector<std::future<std::string>>{};
+    auto boards = std::vector<blackboard::ptr>{};
+    for (auto r = 0; r < runs; ++r) {
+      for (auto i = 0; i < engines; ++i) {
+        auto bb = std::make_shared<blackboard>();
+        boards.push_back(bb);
+        if ((r + i) % 2 == 0) {
+          futures.push_back(runtime.submit(machines[i], bb));
+        } else {
+          runtime.submit(machines[i], bb, [&completed](std::optional<std::string> outcome, std::exception_ptr error) {
+            if (outcome == "done" && !error) completed.fetch_add(1);
+          });
+        }
+      }
+    }
+    for (auto& future : futures) {
+      if (future.get() == "done") completed.fetch_add(1);
+    }
+    for (auto i = 0; i < 1000 && completed.load() < engines * runs; ++i) std::this_thread::sleep_for(1ms);
+
+    for (const auto& bb : boards) {
+      if (bb->get<int>("steps") != 3) {
+        std::cerr << "a run did not finish its machine\n";
+        return 1;
+      }
+    }
+    if (completed.load() != engines * runs || overlapped.load() || runtime.get_stats().runs != engines * runs) {
+      std::cerr << "completed " << completed.load() << " of " << engines * runs << " runs, overlapped "
+                << overlapped.load() << '\n';
+      return 1;
+    }
+  }
+
+  // a slow engine does not hold up the others queued behind it, and errors reach the future
+  {
+    auto runtime = sharded_runtime{2, false};
+    auto slow_active = std::atomic<int>{0};
+    auto fast_active = std::atomic<int>{0};
+    auto slow = make_counter(slow_active, overlapped, 100ms);
+    auto fast = make_counter(fast_active, overlapped);
+    auto slow_done = runtime.submit(slow, nullptr);
+    std::this_thread::sleep_for(10ms);
+    auto fast_done = runtime.submit(fast, nullptr);
+    if (fast_done.wait_for(200ms) != std::future_status::ready ||
+        slow_done.wait_for(0ms) == std::future_status::ready) {
+      std::cerr << "fast engine waited for the slow one\n";
+      return 1;
+    }
+    slow_done.get();
+
+    auto broken = std::make_shared<msm_engine>(std::unordered_set<std::string>{"done"});
+    broken->add_state("fail", std::make_shared<callback_state>(
+                                  [](blackboard::ptr) -> std::string { throw std::runtime_error("failed"); },
+                                  std::unordered_set<std::string>{"done"}));
+    try {
+      runtime.submit(broken, nullptr).get();
+      std::cerr << "error was not reported\n";
+      return 1;
+    } catch (const std::runtime_error&) {
+    }
+  }
+
+  return 0;
+}
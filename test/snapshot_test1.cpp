@@ -0,0 +1,175 @@
+#include "engine.hpp"
+#include <filesystem>
+#include <iostream>
+#include <thread>
+
+using msm::blackboard;
+using msm::callback_state;
+using msm::msm_engine;
+
+namespace {
+struct point {
+  double x;
+  double y;
+};
+}  // namespace
+
+template <>
+struct msm::snapshot_codec<std::vector<int>> {
+  static auto size(const std::vector<int>& value) noexcept -> std::size_t { return value.size() * sizeof(int); }
+  static auto encode(const std::vector<int>& value, std::byte* out) noexcept -> void {
+    std::memcpy(out, value.data(), value.size() * sizeof(int));
+  }
+  static auto decode(std::span<const std::byte> in) -> std::vector<int> {
+    auto value = std::vector<int>(in.size() / sizeof(int));
+    std::memcpy(value.data(), in.data(), in.size());
+    return value;
+  }
+};
+
+auto main(int argc, char** argv) -> int {
+  blackboard::register_codec<point>("point");
+  blackboard::register_codec<std::vector<int>>("vector<int>");
+
+  auto bb = blackboard{};
+  bb.set<int>("count", 7);
+  bb.set<double>("ratio", 0.25);
+  bb.set<std::string>("name", "checkpoint");
+  bb.set<point>("origin", point{1.5, -2.0});
+  bb.set<std::vector<int>>("history", {1, 2, 3});
+
+  // written in place into a caller buffer, restored onto a board with a resolved key
+  auto buffer = std::vector<std::byte>(bb.snapshot_size());
+  auto written = bb.snapshot(buffer);
+  auto copy = blackboard{};
+  auto count = copy.resolve<int>("count");
+  copy.set<int>("stale", 1);
+  copy.restore(std::span<const std::byte>{buffer.data(), written});
+
+  if (written != buffer.size() || copy.get(count) != 7 || copy.get<double>("ratio") != 0.25 ||
+      copy.get<std::string>("name") != "checkpoint" || copy.get<point>("origin")->y != -2.0 ||
+      copy.get<std::vector<int>>("history") != std::vector<int>{1, 2, 3} || copy.contains("stale")) {
+    std::cerr << "blackboard snapshot round trip failed: " << copy.serialize() << '\n';
+    return 1;
+  }
+
+  auto too_small = std::vector<std::byte>(written - 1);
+  try {
+    bb.snapshot(too_small);
+    std::cerr << "snapshot overran a small buffer\n";
+    return 1;
+  } catch (const std::length_error&) {
+  }
+
+  // through a memory-mapped file
+  auto path = (std::filesystem::temp_directory_path() / "msm_snapshot_test1.bin").string();
+  bb.save(path);
+  auto loaded = blackboard{};
+  loaded.load(path);
+  std::filesystem::remove(path);
+  if (loaded.serialize().size() != bb.serialize().size() || loaded.get<int>("count") != 7) {
+    std::cerr << "loading a snapshot file failed\n";
+    return 1;
+  }
+
+  // concurrent writers of one path each rename a complete file of their own over it, and leave no temporaries
+  auto directory = std::filesystem::temp_directory_path() / "msm_snapshot_test1";
+  std::filesystem::create_directories(directory);
+  auto shared_path = (directory / "shared.bin").string();
+  auto writers = std::vector<std::thread>{};
+  for (auto w = 0; w < 4; ++w) {
+    writers.emplace_back([&shared_path, w]() -> void {
+      auto board = blackboard{};
+      board.set<int>("writer", w);
+      for (auto i = 0; i < 20; ++i) board.save(shared_path);
+    });
+  }
+  for (auto& writer : writers) writer.join();
+  auto shared = blackboard{};
+  shared.load(shared_path);
+  auto files = std::distance(std::filesystem::directory_iterator{directory}, std::filesystem::directory_iterator{});
+  std::filesystem::remove_all(directory);
+  if (shared.get<int>("writer").value_or(-1) < 0 || files != 1) {
+    std::cerr << "concurrent snapshot writers collided, " << files << " files left\n";
+    return 1;
+  }
+
+  // a checkpoint taken inside a nested engine resumes there after a crash
+  auto engine_snapshot = std::vector<std::byte>{};
+  auto board_snapshot = std::vector<std::byte>{};
+  auto inner = std::make_shared<msm_engine>(std::unordered_set<std::string>{"done"});
+  auto outer = std::make_shared<msm_engine>(std::unordered_set<std::string>{"finished"});
+  inner->add_state("step",
+                   std::make_shared<callback_state>(
+                       [&](blackboard::ptr board) -> std::string {
+                         auto steps = ++board->operator[]<int>("steps");
+                         if (steps == 2 && engine_snapshot.empty()) {
+                           engine_snapshot = outer->snapshot();
+                           board_snapshot = board->snapshot();
+                           throw std::runtime_error("crash");
+                         }
+                         return steps < 3 ? "again" : "done";
+                       },
+                       std::unordered_set<std::string>{"again", "done"}),
+                   {{"again", "step"}, {"done", "done"}});
+  outer->add_state("inner", inner, {{"done", "finished"}});
+
+  auto starts = 0;
+  outer->add_start_callback(
+      [&starts](blackboard::ptr, const std::string&, const std::vector<std::string>&) -> void { ++starts; });
+
+  try {
+    outer->execute(std::make_shared<blackboard>());
+  } catch (const std::runtime_error&) {
+  }
+
+  auto recovered = std::make_shared<blackboard>();
+  recovered->restore(board_snapshot);
+  outer->restore(engine_snapshot);
+  if (outer->execute(recovered) != "finished" || recovered->get<int>("steps") != 3 || starts != 1) {
+    std::cerr << "resumed engine did not continue from the checkpoint\n";
+    return 1;
+  }
+
+  // a state added after restore() renumbers the graph, the run still resumes where the snapshot was taken
+  auto chain_snapshot = std::vector<std::byte>{};
+  auto chain = std::make_shared<msm_engine>(std::unordered_set<std::string>{"done"});
+  auto counting = [](const std::string& key, const std::string& outcome) {
+    return std::make_shared<callback_state>(
+        [key, outcome](blackboard::ptr board) -> std::string {
+          ++board->operator[]<int>(key);
+          return outcome;
+        },
+        std::unordered_set<std::string>{outcome});
+  };
+  chain->add_state("a", counting("a", "next"), {{"next", "b"}});
+  chain->add_state("b", counting("b", "next"), {{"next", "c"}});
+  chain->add_state("c",
+                   std::make_shared<callback_state>(
+                       [&](blackboard::ptr board) -> std::string {
+                         if (chain_snapshot.empty()) {
+                           chain_snapshot = chain->snapshot();
+                           throw std::runtime_error("crash");
+                         }
+                         ++board->operator[]<int>("c");
+                         return "done";
+                       },
+                       std::unordered_set<std::string>{"done"}),
+                   {{"done", "done"}});
+  try {
+    chain->execute(std::make_shared<blackboard>());
+  } catch (const std::runtime_error&) {
+  }
+
+  chain->restore(chain_snapshot);
+  chain->add_state("z", counting("z", "next"), {{"next", "a"}});
+  chain->set_initial_state("z");
+  auto resumed = std::make_shared<blackboard>();
+  if (chain->execute(resumed) != "done" || resumed->get<int>("c") != 1 || resumed->contains("b") ||
+      resumed->contains("z")) {
+    std::cerr << "resuming after a recompile ran the wrong states: " << resumed->serialize() << '\n';
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,92 @@
+#include "engine.hpp"
+#include "static_machine.hpp"
+#include <iostream>
+
+using msm::blackboard;
+using msm::exit_with;
+using msm::msm_engine;
+using msm::static_machine;
+using msm::static_machine_state;
+using msm::transition;
+
+namespace {
+enum class outcome { again, next, done, failed };
+
+struct counters {
+  int count = 0;
+  int finished = 0;
+};
+
+struct count_state {
+  static constexpr std::array outcomes{outcome::again, outcome::next};
+  auto execute(counters& context) -> outcome { return ++context.count < 3 ? outcome::again : outcome::next; }
+};
+
+struct finish_state {
+  static constexpr std::array outcomes{outcome::done};
+  auto execute(counters& context) -> outcome {
+    ++context.finished;
+    return outcome::done;
+  }
+};
+
+using counting = static_machine<outcome, counters, count_state,
+                                transition<count_state, outcome::again, count_state>,
+                                transition<count_state, outcome::next, finish_state>,
+                                transition<finish_state, outcome::done, exit_with<outcome::done>>>;
+
+// a static machine is itself a state, so machines nest without going through msm_state
+using nested =
+    static_machine<outcome, counters, counting, transition<counting, outcome::done, exit_with<outcome::failed>>>;
+
+struct flag_state {
+  static constexpr std::array outcomes{outcome::done};
+  auto execute(blackboard& bb) -> outcome {
+    bb.set<bool>("flagged", true);
+    return outcome::done;
+  }
+};
+
+using flagging =
+    static_machine<outcome, blackboard, flag_state, transition<flag_state, outcome::done, exit_with<outcome::done>>>;
+
+static_assert(counting::state_count() == 2);
+static_assert(counting::outcomes.size() == 1 && counting::outcomes[0] == outcome::done);
+static_assert(nested::outcomes[0] == outcome::failed);
+}  // namespace
+
+auto main(int argc, char** argv) -> int {
+  auto context = counters{};
+  auto machine = counting{};
+  if (machine.execute(context) != outcome::done || context.count != 3 || context.finished != 1) {
+    std::cerr << "static machine ran " << context.count << " counts\n";
+    return 1;
+  }
+
+  context = counters{};
+  if (nested{}.execute(context) != outcome::failed || context.count != 3) {
+    std::cerr << "nested static machine failed\n";
+    return 1;
+  }
+
+  // nested in a runtime engine, with the context kept on the blackboard
+  auto engine = msm_engine{{"finished"}};
+  engine.add_state("count",
+                   std::make_shared<static_machine_state<counting>>(
+                       std::vector<std::pair<outcome, std::string>>{{outcome::done, "counted"}}, "counters"),
+                   {{"counted", "flag"}});
+  engine.add_state("flag",
+                   std::make_shared<static_machine_state<flagging>>(
+                       std::vector<std::pair<outcome, std::string>>{{outcome::done, "ok"}}),
+                   {{"ok", "finished"}});
+  engine.validate(true);
+
+  auto bb = std::make_shared<blackboard>();
+  if (engine.execute(bb) != "finished" || bb->get<counters>("counters")->count != 3 ||
+      bb->get<bool>("flagged") != true) {
+    std::cerr << "static machine states did not run inside msm_engine\n";
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,149 @@
+#include "engine.hpp"
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+using msm::blackboard;
+using msm::callback_state;
+using msm::msm_engine;
+using msm::msm_state;
+using msm::parallel_state;
+using msm::timer_wheel;
+using namespace std::chrono_literals;
+
+namespace {
+// Sleeps for up to a second, polling for cancellation unless stubborn
+class sleeper_state : public msm_state {
+ public:
+  std::atomic<bool> saw_deadline{false};
+  std::atomic<bool> finished{false};
+  bool stubborn;
+
+  explicit sleeper_state(bool stubborn_ = false, std::chrono::milliseconds length_ = 1000ms)
+      : msm_state{{"done", "timeout"}}, stubborn{stubborn_}, length{length_} {}
+
+  auto execute(blackboard::ptr bb) -> std::string override {
+    saw_deadline.store(get_deadline() != clock::time_point::max());
+    auto until = clock::now() + length;
+    while (clock::now() < until && (stubborn || !is_cancelled())) std::this_thread::sleep_for(1ms);
+    finished.store(true);
+    return "done";
+  }
+
+  auto to_string() const -> std::string override { return "Sleeper State"; }
+
+ private:
+  std::chrono::milliseconds length;
+};
+
+auto elapsed_since(std::chrono::steady_clock::time_point start) -> std::chrono::milliseconds {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+}
+
+auto constant(const std::string& outcome) -> std::shared_ptr<callback_state> {
+  return std::make_shared<callback_state>([outcome](blackboard::ptr) -> std::string { return outcome; },
+                                          std::unordered_set<std::string>{outcome});
+}
+}  // namespace
+
+auto main(int argc, char** argv) -> int {
+  // timers fire in deadline order, also when they are more than one turn of the wheel away, and can be cancelled
+  {
+    auto wheel = timer_wheel{1ms, 8};
+    auto mtx = std::mutex{};
+    auto fired = std::vector<int>{};
+    auto record = [&](int delay) {
+      return [&, delay] {
+        auto lock = std::lock_guard(mtx);
+        fired.push_back(delay);
+      };
+    };
+    auto late = wheel.schedule(30ms, record(30));
+    wheel.schedule(5ms, record(5));
+    auto cancelled = wheel.schedule(15ms, record(15));
+    if (!wheel.cancel(cancelled)) {
+      std::cerr << "pending timer could not be cancelled\n";
+      return 1;
+    }
+    std::this_thread::sleep_for(100ms);
+    auto lock = std::lock_guard(mtx);
+    if (fired != std::vector<int>{5, 30} || wheel.cancel(late)) {
+      std::cerr << "timers fired out of order or more than once\n";
+      return 1;
+    }
+  }
+
+  // a state that overruns its budget continues the run with its timeout outcome
+  {
+    auto work = std::make_shared<sleeper_state>();
+    auto engine = msm_engine{{"done", "recovered"}};
+    engine.add_state("work", work, {{"timeout", "recover"}});
+    engine.add_state("recover", constant("recovered"));
+    engine.set_state_timeout("work", 20ms, "timeout");
+
+    auto start = std::chrono::steady_clock::now();
+    auto outcome = engine.execute(std::make_shared<blackboard>());
+    if (outcome != "recovered" || !work->saw_deadline.load() || elapsed_since(start) > 500ms) {
+      std::cerr << "state timeout: " << outcome << " after " << elapsed_since(start).count() << "ms\n";
+      return 1;
+    }
+  }
+
+  // a run that overruns the engine's budget ends with the engine's timeout outcome
+  {
+    auto engine = msm_engine{{"done", "late"}};
+    engine.add_state("first", constant("next"), {{"next", "work"}});
+    engine.add_state("work", std::make_shared<sleeper_state>());
+    engine.set_timeout(20ms, "late");
+
+    auto start = std::chrono::steady_clock::now();
+    auto outcome = engine.execute(std::make_shared<blackboard>());
+    if (outcome != "late" || elapsed_since(start) > 500ms) {
+      std::cerr << "run timeout: " << outcome << " after " << elapsed_since(start).count() << "ms\n";
+      return 1;
+    }
+  }
+
+  // a nested engine inherits the deadline of the state it runs as
+  {
+    auto inner = std::make_shared<msm_engine>(std::unordered_set<std::string>{"done", "slow"});
+    inner->add_state("work", std::make_shared<sleeper_state>());
+    auto outer = msm_engine{{"done", "gave_up"}};
+    outer.add_state("inner", inner, {{"slow", "give_up"}});
+    outer.add_state("give_up", constant("gave_up"));
+    outer.set_state_timeout("inner", 20ms, "slow");
+
+    auto start = std::chrono::steady_clock::now();
+    auto outcome = outer.execute(std::make_shared<blackboard>());
+    if (outcome != "gave_up" || elapsed_since(start) > 500ms) {
+      std::cerr << "nested timeout: " << outcome << " after " << elapsed_since(start).count() << "ms\n";
+      return 1;
+    }
+  }
+
+  // a parallel_state under a deadline abandons a branch that ignores cancellation
+  {
+    auto pool = std::make_shared<msm::thread_pool_executor>(2);
+    auto stubborn = std::make_shared<sleeper_state>(true, 300ms);
+    auto fast = constant("ok");
+    auto race = std::make_shared<parallel_state>(
+        std::unordered_set<msm_state::ptr>{stubborn, fast}, "timeout",
+        std::unordered_map<std::string, std::unordered_map<msm_state::ptr, std::string>>{
+            {"ok", {{stubborn, "done"}, {fast, "ok"}}}},
+        pool);
+    auto engine = msm_engine{{"ok", "timeout"}};
+    engine.add_state("race", race);
+    engine.set_state_timeout("race", 20ms, "timeout");
+
+    auto start = std::chrono::steady_clock::now();
+    auto outcome = engine.execute(std::make_shared<blackboard>());
+    if (outcome != "timeout" || elapsed_since(start) > 200ms) {
+      std::cerr << "parallel timeout: " << outcome << " after " << elapsed_since(start).count() << "ms\n";
+      return 1;
+    }
+    while (!stubborn->finished.load()) std::this_thread::sleep_for(1ms);
+  }
+
+  return 0;
+}
@@ -0,0 +1,68 @@
+#include "engine.hpp"
+#include "trace.hpp"
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+using msm::blackboard;
+using msm::callback_state;
+using msm::msm_engine;
+using msm::parallel_state;
+using msm::tracer;
+
+auto main(int argc, char** argv) -> int {
+  auto sleeper = [](blackboard::ptr) -> std::string {
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    return "ok";
+  };
+  auto left = std::make_shared<callback_state>(sleeper, std::unordered_set<std::string>{"ok"});
+  auto right = std::make_shared<callback_state>(sleeper, std::unordered_set<std::string>{"ok"});
+
+  auto engine = msm_engine{{"done"}};
+  engine.add_state("count",
+                   std::make_shared<callback_state>(
+                       [](blackboard::ptr bb) -> std::string {
+                         return ++bb->operator[]<int>("count") < 3 ? "again" : "next";
+                       },
+                       std::unordered_set<std::string>{"again", "next"}),
+                   {{"again", "count"}, {"next", "fan_out"}});
+  auto outcome_map = std::unordered_map<std::string, std::unordered_map<msm::msm_state::ptr, std::string>>{
+      {"joined", {{left, "ok"}, {right, "ok"}}}};
+  engine.add_state("fan_out",
+                   std::make_shared<parallel_state>(std::unordered_set<msm::msm_state::ptr>{left, right}, "failed",
+                                                    outcome_map),
+                   {{"joined", "done"}, {"failed", "done"}});
+
+  tracer::clear();
+  engine.execute(std::make_shared<blackboard>());
+
+  auto chrome = std::ostringstream{};
+  tracer::write_chrome_trace(chrome);
+  if (chrome.str().rfind("{\"traceEvents\":[", 0) != 0) {
+    std::cerr << "malformed chrome trace\n";
+    return 1;
+  }
+
+#ifdef MSM_ENABLE_TRACING
+  auto states = tracer::state_histograms();
+  auto transitions = tracer::transition_counts();
+  if (states["count"].count != 3 || states["fan_out"].count != 1 || states["fan_out"].max_ns < 2000000 ||
+      transitions["count -> count"] != 2 || transitions["count -> fan_out"] != 1 ||
+      transitions["fan_out -> done"] != 1) {
+    std::cerr << "unexpected trace:\n" << tracer::summary();
+    return 1;
+  }
+  if (tracer::summary().find("parallel_state join") == std::string::npos ||
+      chrome.str().find("\"name\":\"count -> fan_out\"") == std::string::npos) {
+    std::cerr << "joins or transitions missing from the exports\n";
+    return 1;
+  }
+#else
+  if (!tracer::state_histograms().empty() || !tracer::summary().empty()) {
+    std::cerr << "tracing recorded events while disabled\n";
+    return 1;
+  }
+#endif
+
+  return 0;
+}